@@ -1,4 +1,5 @@
 #include "FastaRecord.h"
+#include "kmerencoder.h"
 
 #include <cstring>
 #include <errno.h>
@@ -12,7 +13,16 @@ void
 FastaRecord::readsinglefasta(std::ifstream& is) 
 {
     static unsigned int line = 1;
-    const std::string bases = "ABCDEFGHIKLMNPQRSTUVWXYZ-*abcdefghiklmnpqrstuvwxyz";
+    // When the bases are words, such as the x86 operators REX.W or
+    // CVTDQ2PD (see kmerencoder), they are separated by white space, line
+    // ends included, and may hold any printable character.
+    static const std::string separator = kmerencoder().separator();
+    std::string bases = "ABCDEFGHIKLMNPQRSTUVWXYZ-*abcdefghiklmnpqrstuvwxyz";
+    if (!separator.empty()) {
+        bases = " \t";
+        for (char c='!'; c<='~'; ++c)
+            bases += c;
+    }
 
     if (is.eof()) {
         std::cerr << "end of file before >id";
@@ -36,7 +46,8 @@ FastaRecord::readsinglefasta(std::ifstream& is)
     while (!is.eof() && is.peek() != '>') {
 	std::string s;
         std::getline(is, s);
-	seq += s;
+	if (!s.empty())
+	    seq += (seq.empty() ? "" : separator) + s;
 	line++;
     }
     std::string::size_type p;
@@ -66,3 +77,33 @@ fastavec_t readfastafile(const std::string& fastafile)
 
     return sequences;
 }
+
+// FNV-1a, so hash values are the same across runs, compilers and machines.
+static void
+fnv1a(uint64_t& hash, const std::string& s)
+{
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+// Identify the first n records of a sequence set by a hash of their ids.
+uint64_t
+hashids(const fastavec_t& sequences, const unsigned int n)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned int i=0; i<n && i<sequences.size(); ++i)
+        fnv1a(hash, sequences[i].get_id() + "\n");
+    return hash;
+}
+
+// Identify a sequence set (in order) by a hash of the sequences themselves.
+uint64_t
+hashsequences(const fastavec_t& sequences)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned int i=0; i<sequences.size(); ++i)
+        fnv1a(hash, sequences[i].get_seq() + "\n");
+    return hash;
+}
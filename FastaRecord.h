@@ -7,6 +7,7 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <cstdint>
 
 class FastaRecord {
     std::string id, seq;
@@ -17,10 +18,10 @@ public:
         seq = iseq;
     };
     FastaRecord() {};
-    std::string get_id() const {
+    const std::string& get_id() const {
         return id;
     };
-    std::string get_seq() const {
+    const std::string& get_seq() const {
         return seq;
     };
     bool operator<(const FastaRecord& rhs) const {
@@ -32,5 +33,7 @@ public:
 
 typedef std::vector<FastaRecord> fastavec_t;
 fastavec_t readfastafile(const std::string&);
+uint64_t hashids(const fastavec_t&, const unsigned int n);
+uint64_t hashsequences(const fastavec_t&);
 
 #endif // FASTA_H
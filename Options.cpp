@@ -5,6 +5,7 @@
 #include <getopt.h>
 #include <string.h>
 #include "utils.h"
+#include "kmermeasure.h"
 
 Options::Options(int argc, char **argv)
 {
@@ -19,11 +20,38 @@ Options::Options(int argc, char **argv)
             return std::string("");
         return std::string("File '" + value + "' does not exist.");
     };
+    auto validateoptionalfile = [](const std::string value) {
+        if (value.length() == 0 || fileexists(value))
+            return std::string("");
+        return std::string("File '" + value + "' does not exist.");
+    };
     auto validatedir = [](const std::string value) {
         if (direxists(value))
             return std::string("");
         return std::string("Directory '" + value + "' does not exist.");
     };
+    auto validateoptionaldir = [](const std::string value) {
+        if (value.length() == 0 || direxists(value))
+            return std::string("");
+        return std::string("Directory '" + value + "' does not exist.");
+    };
+    auto validatemeasures = [](const std::string value) {
+        std::string errmsg;
+        std::vector<std::string> specs = measure::splitspecs(value);
+        for (auto spec=specs.begin(); spec != specs.end(); ++spec) {
+            std::string name, subname, measureopt;
+            measure::parsespec(*spec, name, subname, measureopt);
+            errmsg += measure::validatemeasure(name);
+        }
+        return errmsg;
+    };
+    auto validateprecision = [](const std::string value) {
+        precision_t p;
+        if (kmermeasure::parseprecision(value, p))
+            return std::string("");
+        return std::string("Precision '" + value +
+                           "' is not one of exact, double, float or longdouble.");
+    };
     auto validatecores = [](const std::string value) {
         unsigned int ncores = stoi(value);
         if (ncores > 0 && ncores <= std::thread::hardware_concurrency())
@@ -32,6 +60,11 @@ Options::Options(int argc, char **argv)
         return std::string("ncores '" + value + "' is greater than system cores (" +
                            std::to_string(std::thread::hardware_concurrency()) + ").");
     };
+    auto validateseconds = [](const std::string value) {
+        if (value.length() > 0 && value.find_first_not_of("0123456789") == std::string::npos)
+            return std::string("");
+        return std::string("'" + value + "' is not a whole number of seconds.");
+    };
     auto novalidation = [](const std::string value) {
         return std::string("");
     };
@@ -48,6 +81,18 @@ Options::Options(int argc, char **argv)
     option_defs[findoption("distmatfname")].checksanity = novalidation;
     option_defs[findoption("ncores")].checksanity = validatecores;
     option_defs[findoption("checkpointdir")].checksanity = novalidation;
+    option_defs[findoption("printresult")].checksanity = validateboolean;
+    // checked below, since with --measures it is only the start of the names
+    option_defs[findoption("extendmatrix")].checksanity = novalidation;
+    option_defs[findoption("fasta2")].checksanity = validateoptionalfile;
+    option_defs[findoption("serve")].checksanity = novalidation;
+    option_defs[findoption("measures")].checksanity = validatemeasures;
+    option_defs[findoption("profilecache")].checksanity = validateoptionaldir;
+    option_defs[findoption("packprofiles")].checksanity = validateboolean;
+    option_defs[findoption("precision")].checksanity = validateprecision;
+    option_defs[findoption("verifyprecision")].checksanity = validateboolean;
+    option_defs[findoption("progress")].checksanity = validateseconds;
+    option_defs[findoption("progressfile")].checksanity = novalidation;
 
     // Default values
     set("checkpointdir", "./measuretest.checkpoint");
@@ -104,7 +149,7 @@ Options::Options(int argc, char **argv)
     
     // Nothing elsewhere verified checkpointdir as being OK.
     std::string errmsg = validatedir(option_defs[findoption("checkpointdir")].value);
-    if (errmsg.length() != 0) {
+    if (errmsg.length() != 0 && get("serve").length() == 0) {
         std::cerr << errmsg << std::endl;
         error = true;
     }
@@ -112,9 +157,17 @@ Options::Options(int argc, char **argv)
     if (get_restart())
         restore();
 
-    /* verify all mandatory options are set. */
+    /* verify all mandatory options are set.  A server gets its measures from
+     * the queries and writes no matrix; --measures replaces --measure. */
+    auto notneeded = [this](const std::string name) {
+        if (name.compare("measure") == 0 && get("measures").length() > 0)
+            return true;
+        return get("serve").length() > 0 &&
+               (name.compare("measure") == 0 || name.compare("distmatfname") == 0);
+    };
     for (unsigned int i=0; i<nopts; ++i) {
-        if (option_defs[i].mandatory && !get_restart() && option_defs[i].value.length() == 0) {
+        if (option_defs[i].mandatory && !get_restart() && option_defs[i].value.length() == 0 &&
+            !notneeded(option_defs[i].name)) {
             std::cerr << "Missing mandatory option '" << option_defs[i].name
                       << "' (" << option_defs[i].description << ")"
                       << std::endl;
@@ -122,6 +175,24 @@ Options::Options(int argc, char **argv)
         }
     }
 
+    if (get("fasta2").length() > 0 && get("extendmatrix").length() > 0) {
+        std::cerr << "fasta2 and extendmatrix cannot be used together." << std::endl;
+        error = true;
+    }
+
+    if (get("measures").length() == 0) {
+        std::string errmsg = validateoptionalfile(get("extendmatrix"));
+        if (errmsg.length() > 0) {
+            std::cerr << "Error in extendmatrix: " << errmsg << std::endl;
+            error = true;
+        }
+    }
+
+    if (get("measures").length() > 0 && get("measure").length() > 0) {
+        std::cerr << "measure and measures cannot be used together." << std::endl;
+        error = true;
+    }
+
     if (error) {
         std::cerr << "One or more errors detected." << std::endl;
         std::cerr << "Valid options:" << std::endl;
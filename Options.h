@@ -30,7 +30,7 @@ struct Option {
 };
 
 class Options {
-    const static unsigned int nopts = 9;
+    const static unsigned int nopts = 19;
     struct Option option_defs[nopts] {
 	{ "restart", 'r', 'b', "restart from checkpoint; optional; default: not restarting from checkpoint",
 	  false, false, "", nullptr },
@@ -50,6 +50,26 @@ class Options {
 	  false, true, "", nullptr },
 	{ "printresult", 'p', 's', "print the resulting distance matrix.  Default: false",
 	  false, true, "false", nullptr },
+	{ "extendmatrix", 'e', 's', "existing distance matrix for the leading sequences in the fasta file; only rows and columns for the appended sequences are calculated; optional",
+	  false, true, "", nullptr },
+	{ "fasta2", 'F', 's', "second fasta file; every sequence in fasta is compared with every sequence in fasta2 and the distance matrix is a full |fasta| x |fasta2| matrix; optional",
+	  false, true, "", nullptr },
+	{ "serve", 'S', 's', "answer nearest-reference queries against the fasta sequences instead of calculating a distance matrix; 'stdio' or the path for a Unix domain socket; optional",
+	  false, true, "", nullptr },
+	{ "measures", 'M', 's', "several measures to calculate in one pass, e.g. kmer:cosine:7+kmer:euclidean:7+edit; each writes its own matrix, distmatfname.<measure>; instead of measure, submeasure and measureopt; optional",
+	  false, true, "", nullptr },
+	{ "profilecache", 'P', 's', "directory for kmer profile cache files, which later runs (and concurrent runs) on the same fasta file map instead of recalculating; optional",
+	  false, true, "", nullptr },
+	{ "packprofiles", 'z', 's', "keep kmer profiles in compressed blocks, for several times less memory at some cost in speed; optional; default: false",
+	  false, true, "false", nullptr },
+	{ "precision", 'x', 's', "arithmetic for kmer measures: exact (integer dot products, double for the rest), double, float or longdouble; optional; default: exact",
+	  false, true, "exact", nullptr },
+	{ "verifyprecision", 'V', 's', "also calculate each kmer distance in long double and report the largest difference; optional; default: false",
+	  false, true, "false", nullptr },
+	{ "progress", 'g', 'i', "seconds between progress reports (pairs done, pairs/s, per-thread utilization, ETA) on stderr; 0 for none; optional; default: 0",
+	  false, true, "0", nullptr },
+	{ "progressfile", 'j', 's', "also write each progress report as JSON to this file, replacing it each time; needs progress; optional",
+	  false, true, "", nullptr },
     };
     
     std::string checkpointfname = "options.checkpoint";
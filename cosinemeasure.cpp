@@ -19,57 +19,20 @@
 
 #include "cosinemeasure.h"
 
-//! @brief precalculate the sums needed by the consine measure
-void
-cosinemeasure::calculate_sum(const FastaRecord& fr)
-{
-    long double count;
-    long double sum = 0.0;
-    kmerset* ks;
-
-    if (kmers.count(fr) == 0) {
-        ks = new kmerset(k);
-        ks->calculate(fr);
-        kmers.emplace(fr, ks);
-    } else
-        ks = kmers.at(fr);
+static measureregistrar registration("kmer", "cosine", [](const std::string& measureopt) {
+    return (measure *)new cosinemeasure(measureopt);
+});
 
-    for (auto kmi : *ks) {
-        kmer_t km = kmi.first;
-        count = ks->at(km);
-        sum += count*count;
-    }
-    sums.emplace(fr, sum);
-};
-
-/*!
- * @brief cosine distance based on frequency counts
- * https://en.wikipedia.org/wiki/Cosine_similarity
- */
-long double
-cosinemeasure::compare(const FastaRecord& a, const FastaRecord& b)
+// cos(angle between a and b), in real_t; 0 if either has no kmers, though
+// the distance is then 1 exactly (see empty())
+template <class real_t>
+static real_t
+cosineof(const kmerprofile& pa, const kmerprofile& pb, const long double dot)
 {
-// long double
-// cosinecompare(const std::string& aseq, const std::string& bseq) const
-// {
-    long double dotproduct = 0.0;
-    kmerset* ksa = get_counts(a);
-    kmerset* ksb = get_counts(b);
-
-    if (sums.count(a) == 0)
-        calculate_sum(a);
-    if (sums.count(b) == 0)
-        calculate_sum(b);
-
-    // for the dot product, all we care about are those kmers in common;
-    // others have a 0 product and contribute nothing to the final result.
-    for (auto kmi : *ksa) {
-        kmer_t km = kmi.first;
-        if (ksb->count(km) > 0)
-            dotproduct += ksa->at(km) * ksb->at(km);
-    }
+    if (pa.sqnorm == 0 || pb.sqnorm == 0)
+        return 0.0;
 
-    long double cosine  = dotproduct / (sums[a] * sums[b]);
+    real_t cosine = (real_t)dot / std::sqrt((real_t)pa.sqnorm * (real_t)pb.sqnorm);
     if (cosine < -1.0) {
         //std::cerr << "Warning: cosine " << cosine << " is < -1.0." << std::endl;
         cosine = -1.0;
@@ -78,14 +41,69 @@ cosinemeasure::compare(const FastaRecord& a, const FastaRecord& b)
         //std::cerr << "Warning: cosine " << cosine << " is > 1.0." << std::endl;
         cosine = 1.0;
     }
+    return cosine;
+}
 
-    long double result = acosl(cosine)/halfpi;
-    if (result <= 2.09629e-10)
-        return 0.0;
-    else
-        return result;
+//! the angle, scaled into [0,1]; values that are 0 but for rounding are 0
+template <class real_t>
+static real_t
+distanceof(const real_t cosine, const real_t halfpi)
+{
+    real_t result = std::acos(cosine)/halfpi;
+    return result <= (real_t)2.09629e-10 ? 0.0 : result;
+}
+
+// A profile with no kmers has no kmers in common with anything, even
+// another empty one: the distance is 1, as it always has been, and not
+// the arccosine of 0 rounded in whatever precision.
+static bool
+empty(const kmerprofile& pa, const kmerprofile& pb)
+{
+    return pa.sqnorm == 0 || pb.sqnorm == 0;
+}
+
+/*!
+ * @brief cosine distance based on frequency counts
+ * https://en.wikipedia.org/wiki/Cosine_similarity
+ */
+long double
+cosinemeasure::fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                         const mergestats_t& s, const precision_t p)
+{
+    if (empty(pa, pb))
+        return 1.0;
+    switch (p) {
+    case precision_float:
+        return distanceof<float>(cosineof<float>(pa, pb, s.dot), halfpi);
+    case precision_longdouble:
+        return distanceof<long double>(cosineof<long double>(pa, pb, s.dot), halfpi);
+    default:
+        return distanceof<double>(cosineof<double>(pa, pb, s.dot), halfpi);
+    }
 };
 
+/*! @brief a row of cosine distances, with the arccosines done together in
+ * double, in a loop the compiler can vectorise (e.g., with glibc's vector
+ * maths library under -O3 -ffast-math)
+ */
+void
+cosinemeasure::fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                            const mergestats_t *ss, const size_t n, long double *out)
+{
+    if (precision == precision_float || precision == precision_longdouble) {
+        kmermeasure::fromstatsrow(pa, pbs, ss, n, out);
+        return;
+    }
+
+    std::vector<double> row(n);
+    for (size_t j=0; j<n; ++j)
+        row[j] = cosineof<double>(pa, pbs[j], ss[j].dot);
+    const double dhalfpi = halfpi;
+    for (size_t j=0; j<n; ++j)
+        row[j] = std::acos(row[j])/dhalfpi;
+    for (size_t j=0; j<n; ++j)
+        out[j] = empty(pa, pbs[j]) ? 1.0 : row[j] <= 2.09629e-10 ? 0.0 : row[j];
+}
 
 // //------- old code start
 // enum variants {euclidean, cosine};
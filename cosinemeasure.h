@@ -20,29 +20,39 @@
 #define COSINEMEASURE_H
 
 #include "kmermeasure.h"
-#include "kmerset.h"
 #include "FastaRecord.h"
 
-#include <map>
+#include <cmath>
 
 class cosinemeasure : public kmermeasure
 {
-    static std::map<FastaRecord, long double> sums;
     const long double halfpi = 2.0 * atanl(1.0);
 
-    void calculate_sum(const FastaRecord& fr);
-
 public:
     cosinemeasure(const unsigned int k_p) : kmermeasure(k_p) {};
     cosinemeasure(const std::string kstr) : kmermeasure(kstr) {};
     ~cosinemeasure() {};
 
-    long double compare(const FastaRecord& a, const FastaRecord& b);
-    void init(const fastavec_t& seqs);
+    long double fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                          const mergestats_t& s, const precision_t p);
+    void fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                      const mergestats_t *ss, const size_t n, long double *out);
     void printdetails() {
         kmermeasure::printdetails();
         std::cout << "  Cosine measure." << std::endl;
     };
+    //! the angle between the profiles is a metric (on the directions of
+    //! the profiles); rows are finished together by fromstatsrow().  The
+    //! arccosine near 0 turns a rounding error e in the cosine into about
+    //! sqrt(2e) in the angle, which bounds the roundoff.
+    measurecaps_t capabilities() const {
+        measurecaps_t caps = kmermeasure::capabilities();
+        caps.metric = true;
+        caps.rowbatch = true;
+        caps.tilesize = 1024;
+        caps.roundoff = 4 * std::sqrt(epsilon(precision));
+        return caps;
+    };
 
     void test() {}; //!< @todo implement this
 };
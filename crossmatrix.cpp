@@ -0,0 +1,146 @@
+#include "crossmatrix.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+// rows x cols, row-major; row i holds one sequence from the first set
+// against every sequence in the second set, so each worker writes
+// contiguous memory.
+
+crossmatrix::crossmatrix(const unsigned int rowsp, const unsigned int colsp,
+                         const std::string filename, const bool existing)
+{
+    init(rowsp, colsp, filename, existing);
+}
+
+crossmatrix::crossmatrix()
+{
+}
+
+// A new matrix starts out empty.  An existing one (when restarting) must
+// have the expected size, since the shape cannot be recovered from the file.
+void
+crossmatrix::init(const unsigned int rowsp, const unsigned int colsp,
+                  const std::string filename, const bool existing)
+{
+    rows = rowsp;
+    cols = colsp;
+    vecsize = (size_t)rows * cols;
+    allocsize = vecsize * sizeof(long double);
+
+    if (existing) {
+        std::cerr << "Open existing " << rows << "x" << cols << " matrix " << filename << std::endl;
+        fd = open(filename.c_str(), O_RDWR);
+        if (fd < 0) err(1, "Cannot open %s", filename.c_str());
+
+        struct stat sb;
+        if (fstat(fd, &sb) < 0) err(1, "Cannot stat %s", filename.c_str());
+        if ((size_t)sb.st_size != allocsize)
+            errx(1, "%s is %lu bytes; a %ux%u matrix needs %lu", filename.c_str(),
+                 (size_t)sb.st_size, rows, cols, allocsize);
+    } else {
+        std::cerr << "Create empty " << rows << "x" << cols << " matrix " << filename << std::endl;
+        fd = open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, filemode);
+        if (fd < 0) err(1, "Cannot open %s", filename.c_str());
+
+        if (ftruncate(fd, allocsize) < 0)
+            err(1, "ftruncate fd for %s size %lu failed", filename.c_str(), allocsize);
+    }
+
+    vec = (long double *)mmap((void *)0, allocsize, PROT_READ|PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+    if (vec == MAP_FAILED) err(1, "Cannot map %s to size %lu", filename.c_str(),
+                               allocsize);
+
+    if (close(fd) < 0) err(1, "close fd for %s failed", filename.c_str());
+
+    valid = true;
+}
+
+crossmatrix::~crossmatrix()
+{
+    if (valid && munmap(vec, allocsize) < 0) err(1, "munmap failed");
+}
+
+size_t
+crossmatrix::sub(const unsigned int i, const unsigned int j) const
+{
+    return (size_t)i * cols + j;
+}
+
+void
+crossmatrix::checkij(const unsigned int i, const unsigned int j) const
+{
+    if (i >= rows)
+        errx(1, "i too big: %u (rows: %u)", i, rows);
+    if (j >= cols)
+        errx(1, "j too big: %u (cols: %u)", j, cols);
+}
+
+long double
+crossmatrix::get(const unsigned int i, const unsigned int j) const
+{
+    if (valid) {
+        checkij(i, j);
+        return vec[sub(i, j)];
+    } else {
+        warnx("Cross matrix is invalid.");
+        abort();
+    }
+}
+
+void
+crossmatrix::set(const unsigned int i, const unsigned int j, const long double d)
+{
+    if (valid) {
+        checkij(i, j);
+        size_t k = sub(i, j);
+        if (vec[k] != 0)
+            errx(1, "matrix[%u][%u] (k: %lu) not zero!", i, j, k);
+        vec[k] = d;
+    } else {
+        warnx("Cross matrix is invalid.");
+        abort();
+    }
+}
+
+// Unlike the triangular matrix there is no diagonal; a zero distance only
+// means a sequence appears in both sets, so just report how many there are.
+void
+crossmatrix::checksanity()
+{
+    size_t n = 0;
+    for (size_t k=0; k<vecsize; ++k)
+        if (vec[k] == 0.0)
+            ++n;
+
+    if (n > 0)
+        std::cerr << n << " zero distances" << std::endl;
+}
+
+void
+crossmatrix::print(void) const
+{
+    long double max = 0;
+    for (size_t k=0; k<vecsize; ++k)
+        if (max < vec[k]) max = vec[k];
+    unsigned int w = (int)log10(max)+4;
+
+    std::cout << rows << " " << cols << std::endl;
+    std::cout << std::fixed;
+    for (unsigned int i=0; i<rows; ++i) {
+        for (unsigned int j=0; j<cols; ++j) {
+            std::cout << std::setprecision(2) << std::setw(w) << vec[sub(i, j)];
+            if (j < cols-1) std::cout << ", ";
+        }
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef CROSSMATRIX_H
+#define CROSSMATRIX_H
+
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// dense rectangular matrix: every sequence in one set (rows) against
+// every sequence in another (columns)
+
+class crossmatrix {
+private:
+    bool valid = false;
+    unsigned int rows;
+    unsigned int cols;
+    int fd;
+    long double *vec;
+    size_t allocsize;
+    size_t vecsize;
+    const mode_t filemode = S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH;
+
+    size_t sub(const unsigned int i, const unsigned int j) const;
+    void checkij(const unsigned int i, const unsigned int j) const;
+
+public:
+    crossmatrix(const unsigned int rowsp, const unsigned int colsp,
+                const std::string filenamep, const bool existing = false);
+    crossmatrix(void);
+    void init(const unsigned int rowsp, const unsigned int colsp,
+              const std::string filenamep, const bool existing = false);
+    ~crossmatrix();
+    long double get(const unsigned int, const unsigned int) const;
+    void set(const unsigned int, const unsigned int, const long double);
+    void checksanity();
+    void print(void) const;
+    unsigned int get_rows() const {
+        return rows;
+    };
+    unsigned int get_cols() const {
+        return cols;
+    };
+};
+
+#endif // CROSSMATRIX_H
@@ -7,7 +7,11 @@
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <algorithm>
+#include <vector>
 #include "deBruijnGraph.h"
+#include "sparsedebruijn.h"
+#include "trace.h"
 
 deBruijnGraph::deBruijnGraph(const unsigned int k_p) {
     k = k_p;
@@ -32,10 +36,13 @@ deBruijnGraph::~deBruijnGraph() { // free up all storage allocated in this class
 }
 
 deBruijnNode* deBruijnGraph::find_node(const kmerint& kmer, bool create) {
-    if (graph.count(kmer) == 0 && create) {
-        graph.emplace(kmer, new deBruijnNode(k));
-    }
-    return graph.count(kmer) == 0 ? nullptr : graph[kmer];
+    // one lookup, rather than count() and then operator[]
+    auto it = graph.find(kmer);
+    if (it != graph.end())
+        return it->second;
+    if (!create)
+        return nullptr;
+    return graph.emplace(kmer, new deBruijnNode(kmer)).first->second;
 }
 
 void
@@ -69,6 +76,49 @@ deBruijnGraph::graphviz(std::string fname, std::string comment) {
     outf.close();
 }
 
+/*! @brief the graph as a sparsedebruijn file: each kmer with its
+ * frequency, and each out pointer as an edge with the edge's frequency.
+ * The file's counts are whole numbers, so the frequencies are rounded.
+ * kmerint packs a kmer the way kmerencoder does, so its hash is the key;
+ * as for sparsedebruijn, k+1 bases must fit in 64 bits.
+ */
+void
+deBruijnGraph::save(const std::string& fname) {
+    kmerencoder encoder;
+    if (!encoder.exact(k + 1))
+        errx(1, "deBruijnGraph::save: k = %u is too big; k+1 bases must fit in 64 bits", k);
+    const unsigned int nbits = encoder.get_nbits();
+
+    std::vector<std::pair<profilekey_t, profilecount_t>> nodecounts, edgecounts;
+    nodecounts.reserve(graph.size());
+    for (auto it=graph.begin(); it != graph.end(); ++it) {
+        if (it->second == nullptr)
+            continue;
+        const profilekey_t key = (profilekey_t)it->first.get_kmerhash();
+        nodecounts.push_back(std::make_pair(key, (profilecount_t)llround(it->second->get_freq())));
+        for (unsigned int b=0; b<encoder.get_alphabetsize(); ++b)
+            if (it->second->get_outptr(b) != nullptr)
+                edgecounts.push_back(std::make_pair((key << nbits) | b,
+                                                    (profilecount_t)llround(it->second->get_edgefreq(b))));
+    }
+
+    auto toprofile = [](std::vector<std::pair<profilekey_t, profilecount_t>>& v, ownedprofile& p) {
+        std::sort(v.begin(), v.end());
+        for (auto n=v.begin(); n != v.end(); ++n) {
+            p.keys.push_back(n->first);
+            p.counts.push_back(n->second);
+            p.sqnorm += (uint64_t)n->second * n->second;
+        }
+    };
+    ownedprofile nodes, edges;
+    toprofile(nodecounts, nodes);
+    toprofile(edgecounts, edges);
+
+    sparsedebruijn g(k);
+    g.build(nodes, edges);
+    g.save(fname);
+}
+
 // create complete deBruijn graph for size k; this gets large for large k; beware!
 // number of nodes is alphabet_size ^ k
 void
@@ -91,7 +141,7 @@ deBruijnGraph::make_complete_graph(void) {
     // Now that all nodes exist, set up pointers.  Only set out pointers since the
     // deBruijnNode code maintains the corresponding in pointers.
     for (ki.set_kmerhash(ki.begin()); ki<ki.end(); ++ki) {
-        for (intbase b(b.begin()); b<b.end(); ++b) {
+        for (intbase_t b; b<b.end(); ++b) {
             kmerint next = ki + b;
             //std::cout << "ki: " << ki << "; base: " << b << "; next: " << next << std::endl;
             deBruijnNode *nextp = graph[next];
@@ -100,10 +150,8 @@ deBruijnGraph::make_complete_graph(void) {
         }
     }
 
-    std::string comment = "Complete deBruijn graph for k = " + std::to_string(k);
-    //std::string fname = "graph" + std::to_string(k) + ".dot";
-    //graphviz(fname, comment);
-    print(comment);
+    // print() and graphviz() are there for anyone who wants the whole graph
+    TRACE_INFO("dbg.complete", k, graph.size());
 }
 
 void
@@ -41,11 +41,16 @@ public:
     void consistency_check(void);
     void print(std::string comment = "", std::string prefix = "");
     void graphviz(std::string fname, std::string comment = "");
+    //! @brief write the graph, frequencies included, in the binary format of
+    //! sparsedebruijn, which later runs map with sparsedebruijn::load()
+    void save(const std::string& fname);
     
     // copy constructor for a node needs access to the containing graph.
     //friend deBruijnNode::deBruijnNode(const deBruijnNode* srcnode, const deBruijnGraph *dstgraph);
     
-    //! @todo Need the Earth mover distance function(s) (somewhere; maybe not here
+    //! The earth mover's distance is emdmeasure, which works from the kmer profiles.
+    //! For the complete graph at larger k, see implicitdebruijn, which computes
+    //! the edges instead of storing nodes.
     //! @todo need test code for graph operations such as find_node
     //! @todo need test code for copy constructor    
 };
@@ -6,16 +6,15 @@
  */
 
 #include <string>
+#include <sstream>
 #include <iostream>
 #include <fstream>
-#include <map>
-#include <typeinfo>
-#include <unordered_map>
-#include <iterator>
+#include <vector>
+#include <utility>
 #include "kmerint.h"
 #include "intbase.h"
 #include "deBruijnGraph.h"
-#include "myname.h"
+#include "trace.h"
 
 class deBruijnGraph;
 
@@ -25,9 +24,10 @@ class deBruijnGraph;
     A node has in and out edges.  Setting an out edge means that we need to update the corresponding in edge.
     Each node can have only one out edge per base, but multiple nodes can have pointers to a given node.  This
     means that we have to use a set for in edges, while a simple array indexed by the base is sufficient for
-    out edges.
+    out edges.  Bases are the int values of intbase_t.
 
     Some measures need to know the occurrence frequency of a given kmer, so we store that and make it accessible by a getter.
+    The same goes for the frequency of each out edge, the (k+1)-mer of the kmer and the base.
 
     @author Kenneth Ingham
 
@@ -35,28 +35,35 @@ class deBruijnGraph;
 */
 
 class deBruijnNode {
-    typedef std::unordered_multimap<intbase, deBruijnNode*> in_set_t;
+    //! (base, node) for each node whose out edge on base is us
+    typedef std::vector<std::pair<unsigned int, deBruijnNode*>> in_set_t;
 
-    std::map<intbase, deBruijnNode*> out_edges; //!< The out edges from this node
+    std::vector<deBruijnNode*> out_edges; //!< The out edges from this node
+    std::vector<double> edgefreqs;        //!< occurrence frequency of each out edge
     in_set_t in_edges;      //!< The in edges to this node
     kmerint nodevalue;      //!< The hash of the kmer that this node represents
     double kmerfreq;        //!< Optional occurrence frequency for this kmer; some measures use this
-    bool verbose = true;   //!< whether or not to emit debugging statements.
 
     void init_edges(void) {
-        for (intbase b=b.begin(); b != b.end(); ++b) {
-            out_edges.emplace(b, nullptr);
-        }
+        intbase_t ib;
+        out_edges.assign(ib.get_alphabetsize(), nullptr);
+        edgefreqs.assign(ib.get_alphabetsize(), 0.0);
         in_edges.clear();
     }
 
+    static std::string kmerstring(const sequence_t& kmer) {
+        std::stringstream s;
+        s << kmer;
+        return s.str();
+    };
+
 public:
-    /*! @brief Constructor taking a string representation of a kmer
+    /*! @brief Constructor taking the bases of a kmer
      *  @param[in] k the length of the kmer
-     *  @param[in] value a string holding the kmer to store in thie node
+     *  @param[in] value the kmer to store in thie node
      *  @param[in] nodefreq_p the occurrence frequency for the node; optional
      */
-    deBruijnNode(const unsigned int k, const std::string value, const double nodefreq_p = 0.0) : nodevalue(k, value) {
+    deBruijnNode(const unsigned int k, const sequence_t value, const double nodefreq_p = 0.0) : nodevalue(k, value) {
         init_edges();
         kmerfreq = nodefreq_p;
     };
@@ -100,33 +107,30 @@ public:
         // clear all pointers that point to us
         clear_allptrs();
     };
-    
+
     void clear_allptrs() {
-        for (intbase b=b.begin(); b != b.end(); ++b) {
-            if (out_edges[b] != nullptr) {
-                out_edges[b]->clear_inptr(b, this);
-                out_edges[b] = nullptr;
-            }
-            while (!in_edges.empty()) {
-                deBruijnNode* n = in_edges.begin()->second;
-                in_edges.erase(in_edges.begin());
-                n->clear_outptr(b);
-            }
+        for (unsigned int b=0; b<out_edges.size(); ++b) {
+            clear_outptr(b);
+        }
+        while (!in_edges.empty()) {
+            std::pair<unsigned int, deBruijnNode*> in = in_edges.back();
+            in_edges.pop_back();
+            in.second->clear_outptr(in.first);
         }
     };
 
-    //! getter for kmer node value as a string
-    std::string get_kmer(void) const {
+    //! getter for kmer node value
+    sequence_t get_kmer(void) const {
         return nodevalue.get_kmer();
     };
     //! getter for kmer hash value
-    kmerint get_kmerhash(void) {
+    kmerint get_kmerhash(void) const {
         return nodevalue;
     };
-    std::string get_prefix(void) {
+    sequence_t get_prefix(void) const {
         return nodevalue.get_prefix();
     };
-    std::string get_suffix(void) {
+    sequence_t get_suffix(void) const {
         return nodevalue.get_suffix();
     };
     double get_freq(void) const {
@@ -135,91 +139,84 @@ public:
     void set_freq(const double freq_p) {
         kmerfreq = freq_p;
     };
-
-    // out edge maintenance
-    deBruijnNode* get_outptr(const intbase& base) {
-        if (out_edges[base] != nullptr)
-            return out_edges[base];
-        else
-            return nullptr;
+    //! the occurrence frequency of the out edge on base; 0 if there is none
+    double get_edgefreq(const unsigned int base) const {
+        return out_edges.at(base) != nullptr ? edgefreqs[base] : 0.0;
+    };
+    double get_edgefreq(const intbase_t& base) const {
+        return get_edgefreq(base.get_int());
     };
-    deBruijnNode* get_outptr(const unsigned int base) {
-        return get_outptr(intbase(base));
+    void set_edgefreq(const unsigned int base, const double freq_p) {
+        edgefreqs.at(base) = freq_p;
     };
-    deBruijnNode* get_outptr(const char base) {
-        return get_outptr(intbase(base));
+    void set_edgefreq(const intbase_t& base, const double freq_p) {
+        set_edgefreq(base.get_int(), freq_p);
     };
 
-    void set_outptr(const intbase& base, deBruijnNode* value) {
-        set_myname;
+    // out edge maintenance
+    deBruijnNode* get_outptr(const unsigned int base) const {
+        return out_edges.at(base);
+    };
+    deBruijnNode* get_outptr(const intbase_t& base) const {
+        return get_outptr(base.get_int());
+    };
 
+    void set_outptr(const intbase_t& base, deBruijnNode* value) {
         // Sanity checking
         assert(value != nullptr);
 
-        if (verbose) {
-            std::cout << myname << ": asked to set" << std::endl;
-            std::cout << "    " << nodevalue << std::endl;
-            std::cout << "    + " << std::endl;
-            std::cout << "    " << base << std::endl;
-            std::cout << "    -> " << std::endl;
-            std::cout << "    " << value << std::endl;
-        }
+        TRACE_DEBUG("dbg.set_outptr", (uint64_t)nodevalue.get_kmerhash(), base.get_int());
 
         // verify that this->suffix + base matches value->kmer
-        inout_consistency(myname, this, base, value);
-        //consistent_ptrs();
+        inout_consistency(__PRETTY_FUNCTION__, this, base, value);
 
         if (out_edges[base.get_int()] != value) {
+            if (out_edges[base.get_int()] != nullptr)
+                clear_outptr(base.get_int());
             out_edges[base.get_int()] = value;
             value->set_inptr(base, this); // ensure a consistent pair of pointers
-        } /*else {
-            std::cout << "set_outptr: Edge already set" << std::endl;
-        }*/
+        }
         // assume that if the edge is already set, so is the pointer
-
-//         value->consistent_ptrs();
-//         consistent_ptrs();
-        std::cout  << std::endl;
     };
-    void set_outptr(const char base, deBruijnNode* value) {
-        set_outptr(intbase(base), value);
+    void set_outptr(const unsigned int base, deBruijnNode* value) {
+        set_outptr(intbase_t(base), value);
     };
 
-    void clear_outptr(const intbase base) {
-        if (out_edges[base] != nullptr) {
+    void clear_outptr(const unsigned int base) {
+        if (out_edges.at(base) != nullptr) {
             deBruijnNode* t = out_edges[base];
             out_edges[base] = nullptr; // this prevents infinte loop in clearing in/out ptrs
+            edgefreqs[base] = 0.0;
             t->clear_inptr(base, this);
         }
         // else nothing to do
     };
-    void clear_outptr(const char base) {
-        clear_outptr(intbase(base));
+    void clear_outptr(const intbase_t& base) {
+        clear_outptr(base.get_int());
     };
 
     // in edge maintenance
-    auto get_inptrs(const intbase& base) -> decltype(in_edges.find(base)) {
-        return in_edges.find(base);
+    //! the nodes whose out edge on base is us
+    std::vector<deBruijnNode*> get_inptrs(const unsigned int base) const {
+        std::vector<deBruijnNode*> result;
+        for (auto in=in_edges.begin(); in != in_edges.end(); ++in)
+            if (in->first == base)
+                result.push_back(in->second);
+        return result;
     };
-    auto get_inptrs(const char base) -> decltype(in_edges.find(base)) {
-        return get_inptrs(intbase(base));
+    std::vector<deBruijnNode*> get_inptrs(const intbase_t& base) const {
+        return get_inptrs(base.get_int());
     };
     // More than one node can point to us
-    void set_inptr(const intbase& base, deBruijnNode* value) {
-        set_myname;
+    void set_inptr(const intbase_t& base, deBruijnNode* value) {
         assert(value != nullptr);
-        inout_consistency(myname, value, base, this);
+        inout_consistency(__PRETTY_FUNCTION__, value, base, this);
         // Consistency check passed.
 
-        if (verbose) {
-            std::cout << myname << std::endl;
-            std::cout << "  asked to set " << value->get_kmer() << " + " << base
-                      << " -> " << nodevalue.get_kmer();
-        }
+        TRACE_DEBUG("dbg.set_inptr", (uint64_t)nodevalue.get_kmerhash(), base.get_int());
 
-        if (!inptr_exists(base, value)) { // not found, add
-            if (verbose) std::cout << "; setting";
-            in_edges.emplace(base, value);
+        if (!inptr_exists(base.get_int(), value)) { // not found, add
+            in_edges.emplace_back(base.get_int(), value);
             if (value->out_edges[base.get_int()] != this) {
                 if (value->out_edges[base.get_int()] != nullptr) {
                     std::cerr << "Should not change someone's outptr!" << std::endl;
@@ -229,61 +226,47 @@ public:
             }
         } else {
             // else: assume that if the edge is already set, so is the back pointer
-            if (verbose) std::cout << "; Edge already set" << std::endl;
+            TRACE_DEBUG("dbg.set_inptr.exists", (uint64_t)nodevalue.get_kmerhash(), base.get_int());
         }
-
-//         value->consistent_ptrs();
-//         consistent_ptrs();
-    };
-    void set_inptr(const char base, deBruijnNode* value) {
-        set_inptr(intbase(base), value);
-    };
-    void clear_inptr(const intbase base, const deBruijnNode* from) {
-        auto it = in_edges.equal_range(base);
-        if (it.first != in_edges.end()) {
-            for (auto b=it.first; b != it.second; ++b) {
-                if (b->second == from) {
-                    // the order of operations prevents infinte loop in clearing in/out ptrs
-                    deBruijnNode* t = b->second;
-                    in_edges.erase(b);
-                    t->clear_outptr(base);
-                    break; // No need to continue
-                }
+    };
+    void set_inptr(const unsigned int base, deBruijnNode* value) {
+        set_inptr(intbase_t(base), value);
+    };
+    void clear_inptr(const unsigned int base, const deBruijnNode* from) {
+        for (auto in=in_edges.begin(); in != in_edges.end(); ++in) {
+            if (in->first == base && in->second == from) {
+                // the order of operations prevents infinte loop in clearing in/out ptrs
+                deBruijnNode* t = in->second;
+                in_edges.erase(in);
+                t->clear_outptr(base);
+                break; // No need to continue
             }
         }
     };
-    void clear_inptr(const char base, const deBruijnNode* from) {
-        clear_inptr(intbase(base), from);
+    void clear_inptr(const intbase_t& base, const deBruijnNode* from) {
+        clear_inptr(base.get_int(), from);
     };
-    bool inptr_exists(const intbase& base, const deBruijnNode* from) {
-        bool result = false;
-        if (in_edges.empty())
-            return result;
-
-        auto it = in_edges.equal_range(base);
-        if (it.first == it.second)
-            return result;
-
-        for (auto b=it.first; b != it.second; ++b) {
-            if (b->second == from) {
-                result = true;
-                break;
-            }
-        }
-        return result;
+    bool inptr_exists(const unsigned int base, const deBruijnNode* from) const {
+        for (auto in=in_edges.begin(); in != in_edges.end(); ++in)
+            if (in->first == base && in->second == from)
+                return true;
+        return false;
+    };
+    bool inptr_exists(const intbase_t& base, const deBruijnNode* from) const {
+        return inptr_exists(base.get_int(), from);
     };
 
     void consistent_ptrs() {
         // This function does not return in the event of inconsistency
         // verify that all outptrs have inptrs from us
         bool OK = true;
-        for (intbase b=b.begin(); b < b.end(); ++b) {
+        for (unsigned int b=0; b<out_edges.size(); ++b) {
             if (out_edges[b] != nullptr) {
                 bool c = out_edges[b]->inptr_exists(b, this);
                 if (!c) {
                     std::cout << "Out edge inconsistency error." << std::endl;
                     std::cout << "This node is: " << std::endl << this;
-                    std::cout << "Offending base is: " << intbase(b) << std::endl;
+                    std::cout << "Offending base is: " << intbase_t(b) << std::endl;
                     std::cout << "Offending node is: " << std::endl << out_edges[b] << std::endl;
                     OK = false;
                 }
@@ -294,8 +277,8 @@ public:
         for (auto ip=in_edges.begin(); ip != in_edges.end(); ++ip) {
             if (ip->second->get_outptr(ip->first) != this) {
                 std::cout << "In edge consistency error." << std::endl;
-                std::cout << "This node is: " << std::endl << *this;
-                std::cout << "offending base is: " << ip->first << std::endl;
+                std::cout << "This node is: " << std::endl << this;
+                std::cout << "offending base is: " << intbase_t(ip->first) << std::endl;
                 std::cout << "offending node is: " << std::endl << ip->second << std::endl;
                 OK = false;
             }
@@ -303,92 +286,60 @@ public:
         assert(OK);
     };
 
-    static void inout_consistency(const std::string where, deBruijnNode *in, const intbase& ib, deBruijnNode *out) {
-        set_myname;
-        if (true) { // Cannot use verbose because this is a static function
-            std::cout << myname << std::endl;
-            std::cout << "    in: " << in;
-            std::cout << "  base: " << ib << std::endl;
-            std::cout << "    out: " << out << std::endl;
-        }
-        char basec = ib.get_base();
+    static void inout_consistency(const char *where, deBruijnNode *in, const intbase_t& ib, deBruijnNode *out) {
+        TRACE_DEBUG("dbg.inout_consistency", (uint64_t)in->nodevalue.get_kmerhash(), ib.get_int());
         // verify that value->suffix + base matches this->kmer
-        std::string suffix = in->get_suffix();
-        std::string expectedkmer = suffix + basec;
-        if (expectedkmer.compare(out->get_kmer()) != 0) {
-            std::cerr << where << " expected value->suffix (" << suffix << ") + base (" << basec << ") == kmer (";
+        sequence_t expectedkmer = in->get_suffix();
+        expectedkmer.push_back(ib.get_base());
+        if (expectedkmer != out->get_kmer()) {
+            std::cerr << where << " expected value->suffix (" << in->get_suffix() << ") + base (" << ib.get_base() << ") == kmer (";
             std::cerr << out->get_kmer() << ").  kmer should be " << expectedkmer << std::endl;
-            assert(expectedkmer.compare(out->get_kmer()) == 0);
+            assert(expectedkmer == out->get_kmer());
         }
     };
 
     void print(const std::string p = "") const {
         std::cout << p << "Node value: " << nodevalue.get_kmer() << std::endl;
         std::string prefix = p + "    ";
-        //nodevalue.print(prefix + "    ");
-
-        for (intbase b=b.begin(); b != b.end(); ++b) {
-            if (out_edges.at(b) != nullptr) {
-                std::cout << prefix << "Out edge exists for " << b;
-                std::cout << " to " << out_edges.at(b)->get_kmer() << "." << std::endl;
-            } else {
-                std::cout << prefix << "No out edge on " << b << "." << std::endl;
-            }
-            auto it = in_edges.equal_range(b);
-            if (it.first != in_edges.end()) {
-                for (auto ba=it.first; ba != in_edges.end(); ++ba) {
-                    std::cout << prefix << "In edge from " << ba->second->get_kmer();
-                    std::cout << " on " << b << "." << std::endl;
-                }
-            } else {
-                std::cout << prefix << "No in edge on " << b << "." << std::endl;
+
+        for (unsigned int b=0; b<out_edges.size(); ++b) {
+            if (out_edges[b] != nullptr) {
+                std::cout << prefix << "Out edge exists for " << intbase_t(b);
+                std::cout << " to " << out_edges[b]->get_kmer() << "." << std::endl;
             }
         }
+        for (auto in=in_edges.begin(); in != in_edges.end(); ++in) {
+            std::cout << prefix << "In edge from " << in->second->get_kmer();
+            std::cout << " on " << intbase_t(in->first) << "." << std::endl;
+        }
     };
-    friend std::ostream& operator<< (std::ostream &stream, deBruijnNode node) {
-        stream << &node;
-        return stream;
-    };
-    friend std::ostream& operator<< (std::ostream &stream, deBruijnNode *node) {
+    friend std::ostream& operator<< (std::ostream &stream, const deBruijnNode *node) {
         if (node == nullptr) abort();
         stream << "Node value: " << node->nodevalue << std::endl;
         stream << "    Out edges: ";
-        for (unsigned i=0; i<alphabet_size; ++i) {
-            if (node->out_edges[i] != nullptr) {
-                stream << intbase(i) << " -> " << node->out_edges[i]->get_kmer() << "; ";
+        for (unsigned int b=0; b<node->out_edges.size(); ++b) {
+            if (node->out_edges[b] != nullptr) {
+                stream << intbase_t(b) << " -> " << node->out_edges[b]->get_kmer() << "; ";
             }
         }
         stream << std::endl << "    In edges: ";
-        for (intbase ib(ib.begin()); ib < ib.end(); ++ib) {
-            auto it = node->in_edges.equal_range(ib);
-            if (it.first != node->in_edges.end()) {
-                for (auto b=it.first; b != node->in_edges.end(); ++b) {
-                    stream << b->second->get_kmer() << " + " << ib << "; ";
-                }
-            }
+        for (auto in=node->in_edges.begin(); in != node->in_edges.end(); ++in) {
+            stream << in->second->get_kmer() << " + " << intbase_t(in->first) << "; ";
         }
         stream << std::endl;
 
         return stream;
     };
 
-    void graphviz(std::ofstream& outf) {
-        for (unsigned i=0; i<alphabet_size; ++i) {
-            std::string msg;
-            if (out_edges[i] != nullptr) {
-                msg = nodevalue.get_kmer() + " -> " + out_edges[i]->get_kmer();
-                msg += "[label=\"" + std::to_string(intbase::int_to_base(i)) + "\"];";
-                outf << msg << std::endl;
-            }
-            auto it = in_edges.equal_range(intbase(i));
-            if (it.first != in_edges.end()) {
-                for (auto b=it.first; b != in_edges.end(); ++b) {
-                    msg = b->second->get_kmer() + " -> " + nodevalue.get_kmer();
-                    msg += "[label=\"" + std::to_string(intbase::int_to_base(i)) + "\"];";
-                    outf << msg << std::endl;
-                }
+    void graphviz(std::ofstream& outf) const {
+        // Each edge once, from the node it leaves
+        for (unsigned int b=0; b<out_edges.size(); ++b) {
+            if (out_edges[b] != nullptr) {
+                outf << "\"" << kmerstring(nodevalue.get_kmer()) << "\" -> \"";
+                outf << kmerstring(out_edges[b]->get_kmer()) << "\"";
+                outf << "[label=\"" << intbase_t(b).get_base() << "\"];" << std::endl;
             }
-        };
+        }
     };
 
     /**
@@ -401,18 +352,17 @@ public:
 
         // At creation time, all pointers are null
         assert(in_edges.empty());
-        for (unsigned int base=0; base<alphabet_size; ++base) {
+        for (unsigned int base=0; base<out_edges.size(); ++base) {
             assert(out_edges[base] == nullptr);
         }
         if (verbose) std::cout << "At creation, all pointers are null." << std::endl;
 
         // Simple checks for adding and deleting pointers
         // outptr test 1
-        intbase b1(b1.begin());
+        intbase_t b1;
         kmerint next1(nodevalue);
         next1 += b1;
         deBruijnNode* n1 = new deBruijnNode(next1);
-//         std::cout << nodevalue << " + " << b1 << " -> " << next1 << std::endl;
         set_outptr(b1, n1);
         consistent_ptrs();
         n1->consistent_ptrs();
@@ -425,25 +375,25 @@ public:
 
         // inptr test 1
         n1 = new deBruijnNode(next1);
-//         std::cout << nodevalue << " + " << b1 << " -> " << next1 << std::endl;
         n1->set_inptr(b1, this);
         consistent_ptrs();
         n1->consistent_ptrs();
-        delete n1; // destructor with no pointers set works OK?
+        delete n1; // destructor with set pointers works OK?
         consistent_ptrs();
+        assert(get_outptr(b1) == nullptr);
         if (verbose) std::cout << "Simple in pointer test 1 OK." << std::endl;
 
         // outptr test 2
         clear_allptrs();
         kmerint prior1(nodevalue);
         nodevalue = next1;
-//         std::cout << prior1 << " + " << b1 << " -> " << nodevalue << std::endl;
         n1 = new deBruijnNode(prior1);
         n1->set_outptr(b1, this);
         consistent_ptrs();
         n1->consistent_ptrs();
         delete n1; // destructor with set pointers set works OK?
         consistent_ptrs();
+        assert(in_edges.empty());
         if (verbose) std::cout << "Simple out pointer test 2 OK." << std::endl;
 
         // inptr test 2
@@ -454,23 +404,27 @@ public:
         clear_inptr(b1, n1);
         consistent_ptrs();
         n1->consistent_ptrs();
+        delete n1;
         if (verbose) std::cout << "Simple in pointer test 2 OK." << std::endl;
         clear_allptrs(); // Leave no mess behind from tests above
 
-        // Add out pointer and corresponding in pointer is updated
-        for (intbase b2(b2.begin()); b2<b2.end(); ++b2) {
+        // Add out pointer and corresponding in pointer is updated; an
+        // edge's frequency goes with it
+        for (intbase_t b2; b2<b2.end(); ++b2) {
             kmerint next2(nodevalue);
             next2 += b2;
-            //if (verbose) std::cout << "nodevalue: " << nodevalue << "; b: " << b << "; next: " << next2 << std::endl;
 
             deBruijnNode* n2 = new deBruijnNode(next2);
             if (verbose) std::cout << "n2: " << n2 << std::endl;
 
             set_outptr(b2, n2);
-            //inout_consistency("deBruijnNode::test", this, b2, n2);
+            set_edgefreq(b2, 2.0);
+            assert(get_edgefreq(b2) == 2.0);
+            assert(n2->get_inptrs(b2).size() == 1 && n2->get_inptrs(b2)[0] == this);
             consistent_ptrs();
             n2->consistent_ptrs();
             delete n2;
+            assert(get_outptr(b2) == nullptr && get_edgefreq(b2) == 0.0);
             clear_allptrs(); // leave no mess behind for next iteration
 
             if (verbose) std::cout << "----------" << std::endl;
@@ -0,0 +1,118 @@
+/*!
+ * @brief overlap of the edge sets of the de Bruijn graphs of two sequences
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "debruijnmeasure.h"
+
+#include <stdexcept>
+#include <vector>
+
+static measureregistrar registration("debruijn", "", [](const std::string& measureopt) {
+    return (measure *)new debruijnmeasure(measureopt);
+});
+
+/*! @brief the kmer options for the edges of the graph measureopt asks
+ * for: k+1 in place of k, without "weighted"
+ */
+std::string
+debruijnmeasure::edgeoptions(const std::string& measureopt)
+{
+    std::string kmeropt;
+    std::string::size_type start = 0;
+    while (start <= measureopt.length()) {
+        std::string::size_type end = measureopt.find(',', start);
+        if (end == std::string::npos)
+            end = measureopt.length();
+        std::string token = measureopt.substr(start, end - start);
+        if (token.compare("weighted") != 0)
+            kmeropt += (kmeropt.length() > 0 ? "," : "") + token;
+        start = end + 1;
+    }
+
+    kmeroptions o = kmeroptions::parse(kmeropt);
+    if (!o.seeds.empty())
+        throw std::invalid_argument("debruijn needs contiguous kmers, not '" + measureopt + "'");
+    std::string::size_type comma = kmeropt.find(',');
+    return std::to_string(o.k + 1) + (comma == std::string::npos ? "" : kmeropt.substr(comma));
+}
+
+debruijnmeasure::debruijnmeasure(const std::string measureopt) : kmermeasure(edgeoptions(measureopt))
+{
+    std::string::size_type at = measureopt.find("weighted");
+    weighted = at != std::string::npos && (at + 8 == measureopt.length() || measureopt[at + 8] == ',');
+}
+
+// the distance in real_t, from the sizes of the two edge sets (or the
+// squared norms of their counts) and of their intersection
+template <class real_t>
+static real_t
+distanceof(const real_t na, const real_t nb, const real_t shared)
+{
+    const real_t all = na + nb - shared;
+    if (all <= 0)
+        return 0.0; // two empty graphs
+    real_t result = 1 - shared / all;
+    return result < 0 ? 0.0 : result;
+}
+
+/*!
+ * @brief Jaccard distance of the edge sets, or Tanimoto distance of the
+ * edge counts
+ * https://en.wikipedia.org/wiki/Jaccard_index
+ */
+long double
+debruijnmeasure::fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                           const mergestats_t& s, const precision_t p)
+{
+    const long double na = weighted ? (long double)pa.sqnorm : (long double)pa.n;
+    const long double nb = weighted ? (long double)pb.sqnorm : (long double)pb.n;
+    const long double shared = weighted ? s.dot : (long double)s.shared;
+    switch (p) {
+    case precision_float:
+        return distanceof<float>(na, nb, shared);
+    case precision_longdouble:
+        return distanceof<long double>(na, nb, shared);
+    default:
+        return distanceof<double>(na, nb, shared);
+    }
+}
+
+/*! @brief a row of distances, in double, with the divisions in a loop
+ * the compiler can vectorise
+ */
+void
+debruijnmeasure::fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                              const mergestats_t *ss, const size_t n, long double *out)
+{
+    if (precision == precision_float || precision == precision_longdouble) {
+        kmermeasure::fromstatsrow(pa, pbs, ss, n, out);
+        return;
+    }
+
+    const double na = weighted ? (double)pa.sqnorm : (double)pa.n;
+    std::vector<double> shared(n), all(n);
+    for (size_t j=0; j<n; ++j) {
+        shared[j] = weighted ? (double)ss[j].dot : (double)ss[j].shared;
+        all[j] = na + (weighted ? (double)pbs[j].sqnorm : (double)pbs[j].n) - shared[j];
+    }
+    std::vector<double> row(n);
+    for (size_t j=0; j<n; ++j)
+        row[j] = all[j] > 0 ? 1 - shared[j] / all[j] : 0.0;
+    for (size_t j=0; j<n; ++j)
+        out[j] = row[j] < 0 ? 0.0 : row[j];
+}
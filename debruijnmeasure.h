@@ -0,0 +1,79 @@
+/*!
+ * @brief overlap of the edge sets of the de Bruijn graphs of two sequences
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEBRUIJNMEASURE_H
+#define DEBRUIJNMEASURE_H
+
+#include "kmermeasure.h"
+
+/*! @class debruijnmeasure
+ * @brief how far apart the de Bruijn graphs of two sequences are, from
+ * the edges they share
+ *
+ * An edge of a sequence's graph of kmers is a (k+1)-mer of the sequence,
+ * and how often the edge is walked is the (k+1)-mer's count, so the
+ * graph's edges are the (k+1)-mer profile and no graph is built.  The
+ * profiles come from the same store as kmer:...:k+1, and the distance
+ * comes from the same merge, so comparing graphs costs what comparing
+ * (k+1)-mer profiles does.
+ *
+ * The distance is the Jaccard distance of the edge sets, 1 - |A & B| /
+ * |A | B|, a metric; with the "weighted" option (e.g. "7,weighted") it
+ * is the Tanimoto distance of the edge counts, 1 - a.b / (|a|^2 + |b|^2
+ * - a.b), which is not.  Two empty graphs are the same graph.
+ */
+class debruijnmeasure : public kmermeasure
+{
+    bool weighted = false;
+
+    static std::string edgeoptions(const std::string& measureopt);
+
+public:
+    debruijnmeasure(const std::string measureopt);
+    ~debruijnmeasure() {};
+
+    long double fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                          const mergestats_t& s, const precision_t p);
+    void fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                      const mergestats_t *ss, const size_t n, long double *out);
+    void printdetails() {
+        std::cout << "de Bruijn measure, k = " << kopts.k - 1 << " (edges are the "
+                  << kopts.k << "-mers)" << std::endl;
+        if (kopts.canonical)
+            std::cout << "  Canonical kmers (a kmer and its reverse complement are the same)." << std::endl;
+        if (weighted)
+            std::cout << "  Tanimoto distance of the edge counts." << std::endl;
+        else
+            std::cout << "  Jaccard distance of the edge sets." << std::endl;
+    };
+    //! only the Jaccard distance is a metric; rows are finished together
+    //! by fromstatsrow().  It is one division and a subtraction.
+    measurecaps_t capabilities() const {
+        measurecaps_t caps = kmermeasure::capabilities();
+        caps.metric = !weighted;
+        caps.rowbatch = true;
+        caps.tilesize = 1024;
+        caps.roundoff = 4 * epsilon(precision);
+        return caps;
+    };
+
+    void test() {}; //!< @todo implement this
+};
+
+#endif // DEBRUIJNMEASURE_H
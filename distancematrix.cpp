@@ -30,6 +30,12 @@ distancematrix::distancematrix(const std::string filename)
     init(filename);
 }
 
+distancematrix::distancematrix(const unsigned int sizep, const std::string filename,
+                               const std::string oldfilename, const unsigned int oldsizep)
+{
+    init(sizep, filename, oldfilename, oldsizep);
+}
+
 distancematrix::distancematrix()
 {
 }
@@ -82,7 +88,11 @@ distancematrix::init(const std::string filename)
     vecsize = allocsize / sizeof(long double);
     std::cerr << "vecsize " << vecsize << std::endl;
 
+    // vecsize is size*size/2 + size; sqrt(2*vecsize + 1) can overshoot by
+    // one (e.g., it is exactly size+1 for even sizes), so step back down.
     size = sqrt(2*vecsize + 1);
+    while (size > 0 && size*size/2 + size > vecsize)
+        --size;
     std::cerr << "size (matrix n of nxn) " << size << std::endl;
 
     // Sanity check
@@ -99,6 +109,43 @@ distancematrix::init(const std::string filename)
     valid = true;
 }
 
+// Extend an existing (smaller) matrix: create an empty matrix of the new
+// size and copy the old triangle into place.  Row i of the old matrix is
+// contiguous and lands at the start of row i of the new one, so the copy
+// streams through both files once, in order.  The caller fills in the rest.
+// The old matrix must have oldsizep rows (what its ids file says), and
+// cannot be the new file: creating that truncates it before the copy.
+void
+distancematrix::init(const unsigned int sizep, const std::string filename,
+                     const std::string oldfilename, const unsigned int oldsizep)
+{
+    struct stat oldsb, sb;
+    if (stat(oldfilename.c_str(), &oldsb) < 0) err(1, "Cannot stat %s", oldfilename.c_str());
+    if (stat(filename.c_str(), &sb) == 0 && sb.st_dev == oldsb.st_dev && sb.st_ino == oldsb.st_ino)
+        errx(1, "Cannot extend %s into itself; write the extended matrix to another file",
+             oldfilename.c_str());
+
+    distancematrix old(oldfilename);
+    if (old.size != oldsizep)
+        errx(1, "%s has %u rows, but its ids file has %u sequences",
+             oldfilename.c_str(), old.size, oldsizep);
+    if (old.size > sizep)
+        errx(1, "Cannot extend %s (size %u) to smaller size %u",
+             oldfilename.c_str(), old.size, sizep);
+
+    init(sizep, filename);
+
+    std::cerr << "Copy " << old.size << " rows from " << oldfilename << std::endl;
+    if (madvise(old.vec, old.allocsize, MADV_SEQUENTIAL) < 0)
+        warn("madvise on %s failed", oldfilename.c_str());
+
+    for (unsigned int i=0; i<old.size; ++i) {
+        long double *src = &old.vec[old.sub(i, i)];
+        long double *dst = &vec[sub(i, i)];
+        memcpy(dst, src, (old.size - i) * sizeof(long double));
+    }
+}
+
 distancematrix::~distancematrix() 
 {
     if (munmap(vec, allocsize) < 0) err(1, "munmap failed");
@@ -24,9 +24,13 @@ private:
 public:
     distancematrix(const unsigned int sizep, const std::string filenamep);
     distancematrix(const std::string filenamep);
+    distancematrix(const unsigned int sizep, const std::string filenamep,
+                   const std::string oldfilenamep, const unsigned int oldsizep);
     distancematrix(void);
     void init(const unsigned int sizep, const std::string filenamep);
     void init(const std::string filenamep);
+    void init(const unsigned int sizep, const std::string filenamep,
+              const std::string oldfilenamep, const unsigned int oldsizep);
     ~distancematrix();
     long double get(const unsigned int, const unsigned int) const;
     void set(const unsigned int, const unsigned int, const long double);
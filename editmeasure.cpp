@@ -5,6 +5,10 @@
 #include <err.h>
 #include <ctype.h>
 
+static measureregistrar registration("edit", "", [](const std::string& measureopt) {
+    return (measure *)new editmeasure(measureopt);
+});
+
 editmeasure::editmeasure(std::string costfname)
 {
     if (costfname.length() > 0) {
@@ -25,6 +29,18 @@ editmeasure::compare(const FastaRecord& a, const FastaRecord& b) {
         return edit_distance(a.get_seq(), b.get_seq());
 }
 
+/*! @brief unit cost edit distance is a metric; with a cost matrix it is
+ * only symmetric (the matrix must be), since the costs need not obey the
+ * triangle inequality
+ */
+measurecaps_t
+editmeasure::capabilities() const
+{
+    measurecaps_t caps;
+    caps.metric = !use_cost;
+    return caps;
+}
+
 void 
 editmeasure::printdetails(void)
 {
@@ -22,6 +22,7 @@ class editmeasure : public measure {
 	long double compare(const FastaRecord& a, const FastaRecord& b);
 
 	void printdetails(void);
+	measurecaps_t capabilities() const;
     void test() {}; //!< @todo implement this
 };
 #endif // EDITMEASURE_H
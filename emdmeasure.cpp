@@ -0,0 +1,363 @@
+/*!
+ * @brief Earth mover's distance between the de Bruijn graphs of two sequences
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "emdmeasure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+static measureregistrar registration("emd", "", [](const std::string& measureopt) {
+    return (measure *)new emdmeasure(measureopt);
+});
+
+// Sinkhorn stops once b's weights are met to within this, times epsilon
+const double sinkhorntolerance = 0.01;
+
+//! @brief measureopt without the emd options, for the kmer profiles
+std::string
+emdmeasure::kmerpart(const std::string& measureopt)
+{
+    std::string kmeropt;
+    std::string::size_type start = 0;
+    while (start <= measureopt.length()) {
+        std::string::size_type end = measureopt.find(',', start);
+        if (end == std::string::npos)
+            end = measureopt.length();
+        std::string token = measureopt.substr(start, end - start);
+        if (token.compare(0, 8, "sinkhorn") != 0)
+            kmeropt += (kmeropt.length() > 0 ? "," : "") + token;
+        start = end + 1;
+    }
+    return kmeropt;
+}
+
+emdmeasure::emdmeasure(const std::string measureopt) : kmermeasure(kmerpart(measureopt))
+{
+    kmerencoder encoder;
+    nbits = encoder.get_nbits();
+    if (kopts.canonical || !kopts.seeds.empty() || kopts.hashed || !encoder.exact(kopts.k))
+        throw std::invalid_argument("emd needs plain kmers that fit in 64 bits, not '" +
+                                    measureopt + "'");
+
+    std::string::size_type at = measureopt.find("sinkhorn");
+    if (at == std::string::npos)
+        return;
+    approximate = true;
+    std::string rest = measureopt.substr(at + 8, measureopt.find(',', at) - at - 8);
+    if (rest.length() == 0)
+        return;
+    char *end = nullptr;
+    epsilon = rest[0] == '=' ? strtod(rest.c_str() + 1, &end) : 0;
+    // smaller would underflow the kernel
+    if (end == nullptr || *end != '\0' || epsilon < 0.01)
+        throw std::invalid_argument("sinkhorn needs an epsilon of at least 0.01, not '" +
+                                    rest.substr(1) + "'");
+}
+
+/*! @brief the cost of reaching a hub
+ * Levels: 0 is the empty overlap; 1..k-1 a suffix of a's kmer that is a
+ * prefix of b's, of that length; k..2k-2 a prefix of a's kmer that is a
+ * suffix of b's, of length level-k+1; 2k-1 the same kmer.
+ */
+int64_t
+emdmeasure::levelcost(const uint32_t level) const
+{
+    const uint32_t k = kopts.k;
+    if (level == 0)
+        return k;
+    if (level < k)
+        return k - level;
+    if (level < 2*k - 1)
+        return k - (level - k + 1);
+    return 0;
+}
+
+/*! @brief the kmers of p with their hub entries; the supplier (a) meets
+ * the other side at its suffixes for the forward levels and its prefixes
+ * for the backward ones, and the other side the opposite way round
+ */
+void
+emdmeasure::makeside(const kmerprofile& p, const bool supplier, side_t& s) const
+{
+    const uint32_t k = kopts.k;
+    s.keys.clear();
+    s.counts.clear();
+    s.hubs.clear();
+    s.total = 0;
+    uint32_t i = 0;
+    for (profilecursor c(p); !c.done(); c.advance(), ++i) {
+        const profilekey_t key = c.key();
+        s.keys.push_back(key);
+        s.counts.push_back(c.count());
+        s.total += c.count();
+        s.hubs.push_back(hubentry_t{0, i, 0});
+        for (uint32_t l=1; l<k; ++l) {
+            const uint64_t suffix = key & ((1ULL << (l*nbits)) - 1);
+            const uint64_t prefix = key >> ((k - l)*nbits);
+            s.hubs.push_back(hubentry_t{l, i, supplier ? suffix : prefix});
+            s.hubs.push_back(hubentry_t{k - 1 + l, i, supplier ? prefix : suffix});
+        }
+        s.hubs.push_back(hubentry_t{2*k - 1, i, key});
+    }
+    std::sort(s.hubs.begin(), s.hubs.end());
+}
+
+/*! @brief the hubs both sides have, with their members; a and b meet at
+ * hubs with the same level and overlap
+ */
+void
+emdmeasure::makenetwork(const side_t& a, const side_t& b, network_t& net) const
+{
+    net.cost.clear();
+    net.afirst.assign(1, 0);
+    net.amembers.clear();
+    net.bfirst.assign(1, 0);
+    net.bmembers.clear();
+    size_t i = 0, j = 0;
+    while (i < a.hubs.size() && j < b.hubs.size()) {
+        if (a.hubs[i] < b.hubs[j]) {
+            ++i;
+            continue;
+        }
+        if (b.hubs[j] < a.hubs[i]) {
+            ++j;
+            continue;
+        }
+        net.cost.push_back(levelcost(a.hubs[i].level));
+        const size_t ifirst = i, jfirst = j;
+        for (; i < a.hubs.size() && !(a.hubs[ifirst] < a.hubs[i]); ++i)
+            net.amembers.push_back(a.hubs[i].node);
+        for (; j < b.hubs.size() && !(b.hubs[jfirst] < b.hubs[j]); ++j)
+            net.bmembers.push_back(b.hubs[j].node);
+        net.afirst.push_back(net.amembers.size());
+        net.bfirst.push_back(net.bmembers.size());
+    }
+}
+
+/*! @brief the earth mover's distance from a to b, divided by k
+ * Each of a's kmers supplies its count times b's total and each of b's
+ * demands its count times a's total (both divided by the totals' gcd), so
+ * the two weigh the same and everything stays in integers.
+ */
+long double
+emdmeasure::exact(const side_t& a, const side_t& b, workspace_t& w) const
+{
+    const network_t& net = w.net;
+    const uint64_t g = std::gcd(a.total, b.total);
+    const uint32_t na = a.counts.size(), nb = b.counts.size();
+    w.solver.reset(na + nb);
+    for (uint32_t i=0; i<na; ++i)
+        w.solver.set_supply(i, a.counts[i] * (b.total / g));
+    for (uint32_t j=0; j<nb; ++j)
+        w.solver.set_supply(na + j, -(int64_t)(b.counts[j] * (a.total / g)));
+    for (uint32_t h=0; h<net.cost.size(); ++h) {
+        const uint32_t hub = w.solver.addnode();
+        for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+            w.solver.addarc(net.amembers[m], hub, net.cost[h]);
+        for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+            w.solver.addarc(hub, na + net.bmembers[m], 0);
+    }
+
+    const int64_t cost = w.solver.solve();
+    return (long double)cost / ((long double)a.total * (b.total / g)) / kopts.k;
+}
+
+/*! @brief the Sinkhorn estimate of the earth mover's distance from a to
+ * b, divided by k, and the most it can be from the exact distance
+ *
+ * The plan sends u[i] kernel[h] v[j] from a's kmer i through hub h to b's
+ * kmer j, with kernel[h] = exp(-cost[h] / (epsilon k)).  Sums over a hub's
+ * members make each iteration linear in the arcs.  Afterwards the plan is
+ * scaled down to fit both sides' weights and whatever is left over goes
+ * through the empty overlap at cost k, which gives a feasible plan and so
+ * an upper bound.  The potentials epsilon k log u, each side c-transformed
+ * from the other, are dual feasible and give a lower bound.
+ */
+long double
+emdmeasure::sinkhorn(const side_t& a, const side_t& b, workspace_t& w, long double& error) const
+{
+    const network_t& net = w.net;
+    const uint32_t na = a.counts.size(), nb = b.counts.size(), nhubs = net.cost.size();
+    const double scale = epsilon * kopts.k;
+
+    w.kernel.resize(nhubs);
+    for (uint32_t h=0; h<nhubs; ++h)
+        w.kernel[h] = exp(-net.cost[h] / scale);
+    w.ma.resize(na);
+    for (uint32_t i=0; i<na; ++i)
+        w.ma[i] = (double)a.counts[i] / a.total;
+    w.mb.resize(nb);
+    for (uint32_t j=0; j<nb; ++j)
+        w.mb[j] = (double)b.counts[j] / b.total;
+    w.u.assign(na, 1.0);
+    w.v.assign(nb, 1.0);
+
+    // kv = K v: what each of a's kmers would send, less its u
+    auto sendable = [&]() {
+        w.kv.assign(na, 0.0);
+        for (uint32_t h=0; h<nhubs; ++h) {
+            double s = 0;
+            for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+                s += w.v[net.bmembers[m]];
+            s *= w.kernel[h];
+            for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+                w.kv[net.amembers[m]] += s;
+        }
+    };
+    // ku = K^T u: what each of b's kmers would receive, less its v
+    auto receivable = [&]() {
+        w.ku.assign(nb, 0.0);
+        for (uint32_t h=0; h<nhubs; ++h) {
+            double s = 0;
+            for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+                s += w.u[net.amembers[m]];
+            s *= w.kernel[h];
+            for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+                w.ku[net.bmembers[m]] += s;
+        }
+    };
+
+    for (unsigned int iteration=0; iteration<maxiterations; ++iteration) {
+        sendable();
+        for (uint32_t i=0; i<na; ++i)
+            w.u[i] = w.ma[i] / w.kv[i];
+        receivable();
+        double unmet = 0;
+        for (uint32_t j=0; j<nb; ++j) {
+            unmet += fabs(w.v[j] * w.ku[j] - w.mb[j]);
+            w.v[j] = w.mb[j] / w.ku[j];
+        }
+        if (unmet < sinkhorntolerance * epsilon)
+            break;
+    }
+
+    // lower bound: g from f, then f from g
+    const double inf = std::numeric_limits<double>::infinity();
+    w.f.resize(na);
+    for (uint32_t i=0; i<na; ++i)
+        w.f[i] = scale * log(w.u[i]);
+    w.g.assign(nb, inf);
+    for (uint32_t h=0; h<nhubs; ++h) {
+        double most = -inf;
+        for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+            most = std::max(most, w.f[net.amembers[m]]);
+        for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+            w.g[net.bmembers[m]] = std::min(w.g[net.bmembers[m]], net.cost[h] - most);
+    }
+    w.f.assign(na, inf);
+    for (uint32_t h=0; h<nhubs; ++h) {
+        double most = -inf;
+        for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+            most = std::max(most, w.g[net.bmembers[m]]);
+        for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+            w.f[net.amembers[m]] = std::min(w.f[net.amembers[m]], net.cost[h] - most);
+    }
+    long double lower = 0;
+    for (uint32_t i=0; i<na; ++i)
+        lower += w.ma[i] * w.f[i];
+    for (uint32_t j=0; j<nb; ++j)
+        lower += w.mb[j] * w.g[j];
+
+    // upper bound: fit the plan to a's weights, then b's, then send the rest directly
+    sendable();
+    for (uint32_t i=0; i<na; ++i)
+        if (w.u[i] * w.kv[i] > w.ma[i])
+            w.u[i] *= w.ma[i] / (w.u[i] * w.kv[i]);
+    receivable();
+    for (uint32_t j=0; j<nb; ++j)
+        if (w.v[j] * w.ku[j] > w.mb[j])
+            w.v[j] *= w.mb[j] / (w.v[j] * w.ku[j]);
+    sendable();
+    long double upper = 0, left = 1;
+    for (uint32_t i=0; i<na; ++i)
+        left -= w.u[i] * w.kv[i];
+    for (uint32_t h=0; h<nhubs; ++h) {
+        double sa = 0, sb = 0;
+        for (uint32_t m=net.afirst[h]; m<net.afirst[h+1]; ++m)
+            sa += w.u[net.amembers[m]];
+        for (uint32_t m=net.bfirst[h]; m<net.bfirst[h+1]; ++m)
+            sb += w.v[net.bmembers[m]];
+        upper += w.kernel[h] * net.cost[h] * sa * sb;
+    }
+    upper += std::max(left, (long double)0) * kopts.k;
+
+    lower = std::max(lower / kopts.k, (long double)0);
+    upper = std::min(upper / kopts.k, (long double)1);
+    if (lower > upper)
+        lower = upper = (lower + upper) / 2;    // rounding
+    error = (upper - lower) / 2;
+    return (upper + lower) / 2;
+}
+
+//! @brief the distance from a to b, and how far it can be from the exact one
+long double
+emdmeasure::distance(const side_t& a, const side_t& b, workspace_t& w, long double& error) const
+{
+    error = 0;
+    if (a.total == 0 || b.total == 0)
+        return a.total == b.total ? 0 : 1;
+    // the approximation would not quite give 0
+    if (a.keys == b.keys && a.counts == b.counts)
+        return 0;
+    makenetwork(a, b, w.net);
+    if (approximate)
+        return sinkhorn(a, b, w, error);
+    return exact(a, b, w);
+}
+
+//! The merge is not needed; the distance comes from the whole profiles.
+long double
+emdmeasure::fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                      const mergestats_t& s, const precision_t p)
+{
+    side_t a, b;
+    makeside(pa, true, a);
+    makeside(pb, false, b);
+    workspace_t w;
+    long double error;
+    long double d = distance(a, b, w, error);
+    if (approximate) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        maxerror = std::max(maxerror, error);
+    }
+    return d;
+}
+
+//! a's side and the workspace serve the whole row
+void
+emdmeasure::fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                         const mergestats_t *ss, const size_t n, long double *out)
+{
+    side_t a, b;
+    makeside(pa, true, a);
+    workspace_t w;
+    long double error, worst = 0;
+    for (size_t j=0; j<n; ++j) {
+        makeside(pbs[j], false, b);
+        out[j] = distance(a, b, w, error);
+        worst = std::max(worst, error);
+    }
+    if (approximate) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        maxerror = std::max(maxerror, worst);
+    }
+}
@@ -0,0 +1,150 @@
+/*!
+ * @brief Earth mover's distance between the de Bruijn graphs of two sequences
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EMDMEASURE_H
+#define EMDMEASURE_H
+
+#include <mutex>
+#include <vector>
+
+#include "kmermeasure.h"
+#include "networksimplex.h"
+
+/*! @class emdmeasure
+ * @brief the earth mover's distance between the kmer frequencies of two
+ * sequences, moving along the complete de Bruijn graph, after Mangul &
+ * Koslicki, dx.doi.org/10.1145%2F2975167.2975174
+ *
+ * A sequence's frequency-weighted de Bruijn graph is its kmer profile:
+ * every kmer is a node weighted by its share of the sequence's kmers.
+ * The ground distance between kmers u and v is the length of the shorter
+ * directed path between them, k less the longest overlap of a suffix of
+ * one with a prefix of the other, so 0 for the same kmer and at most k.
+ * The distance is the cheapest way of moving a's weights onto b's,
+ * divided by k so that it lies in [0,1].
+ *
+ * The transport problem is not solved on all |a| x |b| kmer pairs.  Each
+ * overlap (of length l, in either direction) is a hub node: a kmer of a
+ * goes to the hub for its suffix (or prefix) at a cost of k - l, and the
+ * hub reaches every kmer of b with that prefix (or suffix) for free.  The
+ * cheapest route between two kmers is through their longest overlap, so
+ * the minimum cost flow through the hubs is the earth mover's distance,
+ * with O(k (|a| + |b|)) arcs.  Weights are scaled to integers so that
+ * networksimplex solves it exactly.
+ *
+ * With the "sinkhorn" option (e.g. "7,sinkhorn" or "7,sinkhorn=0.02") the
+ * transport is approximated by Sinkhorn iterations with entropy weight
+ * epsilon (in units of the distance) on the same hub network, so each
+ * iteration is a few multiply-adds per arc.  Every distance comes with a
+ * bound: the Sinkhorn plan, rounded to a feasible one, costs at least the
+ * exact distance, and the potentials, made dual feasible by c-transforms,
+ * give at most the exact distance.  The distance reported is midway, so
+ * it is within half the gap of the exact one; printdetails() reports the
+ * largest half gap.
+ *
+ * The kmers are packed, so only plain kmers that fit in 64 bits will do
+ * (no canonical, spaced seed or hashed kmers).  The profiles come from the
+ * kmer profile stores, shared with any kmer measure with the same k.
+ */
+class emdmeasure : public kmermeasure
+{
+    unsigned int nbits;
+
+    //! a kmer's place at a hub: level names the kind of overlap, w is the overlap
+    struct hubentry_t {
+        uint32_t level;
+        uint32_t node;
+        uint64_t w;
+        bool operator<(const hubentry_t& o) const {
+            return level != o.level ? level < o.level : w < o.w;
+        };
+    };
+    //! one side of a transport problem
+    struct side_t {
+        std::vector<profilekey_t> keys;
+        std::vector<profilecount_t> counts;
+        std::vector<hubentry_t> hubs;   //!< sorted
+        uint64_t total = 0;             //!< sum of the counts
+    };
+    /*! @brief the hubs two sides share, with their members: hub h costs
+     * cost[h] and holds a's kmers amembers[afirst[h]..afirst[h+1]) and b's
+     * bmembers[bfirst[h]..bfirst[h+1])
+     */
+    struct network_t {
+        std::vector<int64_t> cost;
+        std::vector<uint32_t> afirst, amembers;
+        std::vector<uint32_t> bfirst, bmembers;
+    };
+    //! what one thread reuses from pair to pair
+    struct workspace_t {
+        network_t net;
+        networksimplex solver;
+        std::vector<double> ma, mb, u, v, ku, kv, kernel, f, g;
+    };
+
+    //! approximate with Sinkhorn iterations, rather than solve exactly
+    bool approximate = false;
+    double epsilon = 0.05;
+    //! most Sinkhorn iterations per pair
+    static const unsigned int maxiterations = 10000;
+    //! largest half gap between the bounds seen so far
+    long double maxerror = 0;
+    std::mutex error_mutex;
+
+    static std::string kmerpart(const std::string& measureopt);
+    int64_t levelcost(const uint32_t level) const;
+    void makeside(const kmerprofile& p, const bool supplier, side_t& s) const;
+    void makenetwork(const side_t& a, const side_t& b, network_t& net) const;
+    long double exact(const side_t& a, const side_t& b, workspace_t& w) const;
+    long double sinkhorn(const side_t& a, const side_t& b, workspace_t& w, long double& error) const;
+    long double distance(const side_t& a, const side_t& b, workspace_t& w, long double& error) const;
+
+public:
+    emdmeasure(const std::string measureopt);
+    ~emdmeasure() {};
+
+    long double fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                          const mergestats_t& s, const precision_t p);
+    void fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                      const mergestats_t *ss, const size_t n, long double *out);
+    void printdetails() {
+        kmermeasure::printdetails();
+        if (!approximate) {
+            std::cout << "  Earth mover's distance over the de Bruijn graph, solved exactly." << std::endl;
+            return;
+        }
+        std::cout << "  Earth mover's distance over the de Bruijn graph, by Sinkhorn iterations"
+                  << " with epsilon " << epsilon << "." << std::endl;
+        std::cout << "  Largest error bound: " << maxerror << std::endl;
+    };
+    //! the largest error bound so far; 0 when solving exactly
+    long double get_maxerror() const {
+        return maxerror;
+    };
+    //! a's side of the transport problem is set up once per row
+    measurecaps_t capabilities() const {
+        measurecaps_t caps = kmermeasure::capabilities();
+        caps.rowbatch = true;
+        return caps;
+    };
+
+    void test() {}; //!< @todo implement this
+};
+
+#endif // EMDMEASURE_H
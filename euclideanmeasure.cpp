@@ -20,32 +20,44 @@
 #include "euclideanmeasure.h"
 
 
-long double
-euclideanmeasure::compare(const FastaRecord& a, const FastaRecord& b)
+static measureregistrar registration("kmer", "euclidean", [](const std::string& measureopt) {
+    return (measure *)new euclideanmeasure(measureopt);
+});
+
+// |a - b|^2 = |a|^2 + |b|^2 - 2 a.b, in real_t.  For nearly equal
+// profiles the three terms round differently and the difference can come
+// out below 0 (e.g. -16 for runs of 8194 and 8195 AAAs in float); it is 0.
+template <class real_t>
+static real_t
+sqdistance(const kmerprofile& pa, const kmerprofile& pb, const long double dot)
 {
-    long double dist = 0.0;
-    kmerset* ksa = get_counts(a);
-    kmerset* ksb = get_counts(b);
-
-    // a -> b
-    for (auto kmi : *ksa) {
-        int t;
-        kmer_t km = kmi.first;
-        if (ksb->count(km) > 0)
-            t = ksa->at(km) - ksb->at(km);
-        else
-            t = ksa->at(km);
-        dist += t*t;
-    }
+    real_t dist = (real_t)pa.sqnorm + (real_t)pb.sqnorm - 2*(real_t)dot;
+    return dist < 0 ? 0 : dist;
+}
 
-    // b -> a, but only for the kmers that are in b and not in a
-    for (auto kmi : *ksb) {
-        int t;
-        kmer_t km = kmi.first;
-        if (ksa->count(km) == 0) {
-            t = ksb->at(km);
-            dist += t*t;
-        }
+/*! @brief squared Euclidean distance between the kmer counts
+ * It comes from the stored squared norms and the dot product the merge
+ * shares with cosine, so the kmers of the two profiles are walked once
+ * for both; for integer counts (precision exact) it is exact.
+ */
+long double
+euclideanmeasure::fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                            const mergestats_t& s, const precision_t p)
+{
+    long double dist;
+    switch (p) {
+    case precision_double:
+        dist = sqdistance<double>(pa, pb, s.dot);
+        break;
+    case precision_float:
+        dist = sqdistance<float>(pa, pb, s.dot);
+        break;
+    case precision_longdouble:
+        dist = sqdistance<long double>(pa, pb, s.dot);
+        break;
+    default:
+        dist = sqdistance<uint64_t>(pa, pb, s.dot);
+        break;
     }
 
     // mapped into [0,1]
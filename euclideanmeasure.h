@@ -22,24 +22,22 @@
 
 #include <iostream>
 #include "kmermeasure.h"
-#include "kmerset.h"
 #include "FastaRecord.h"
 
-#include <map>
-
 class euclideanmeasure : public kmermeasure
 {
 public:
     euclideanmeasure(const unsigned int k_p) : kmermeasure(k_p) {};
+    euclideanmeasure(const std::string kstr) : kmermeasure(kstr) {};
     ~euclideanmeasure() {};
 
-    long double compare(const FastaRecord& a, const FastaRecord& b);
+    long double fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                          const mergestats_t& s, const precision_t p);
     void printdetails() {
         kmermeasure::printdetails();
         std::cout << "  Euclidean measure." << std::endl;
     };
     void test() {}; //!< @todo implement this
-    void init(const fastavec_t& seqs);
 };
 
 #endif // EUCLIDEANMEASURE_H
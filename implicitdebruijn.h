@@ -0,0 +1,248 @@
+/*!
+ * @brief complete de Bruijn graph whose edges are computed, not stored
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMPLICITDEBRUIJN_H
+#define IMPLICITDEBRUIJN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <err.h>
+
+#include "kmerencoder.h"
+
+/*! @class implicitdebruijn
+ * @brief the complete de Bruijn graph for k, as one count (and one flag
+ * bit) per kmer
+ *
+ * Node x is a kmer written as a number in base alphabet size, first base
+ * most significant, so the nodes are 0..alphabet^k-1.  Every node has an
+ * edge for each base b, to the kmer that shifts b in at the right,
+ * (x mod alphabet^(k-1)) * alphabet + b, and one from the kmer that
+ * shifts b in at the left, x / alphabet + b * alphabet^(k-1).  Nothing
+ * about the edges is stored, so the graph costs sizeof(count_t) bytes
+ * and one bit per node: a bit over 512MB for k = 14 DNA with the default
+ * 16-bit counts, and half that with count_t = uint8_t.  deBruijnGraph
+ * with all its nodes made runs out of memory well before that.
+ *
+ * Counts saturate rather than wrap.  For an alphabet whose size is a power
+ * of two (DNA) the node is the same number as the kmerencoder key.
+ */
+template <typename count_t = uint16_t>
+class implicitdebruijn {
+public:
+    typedef uint64_t node_t;
+
+private:
+    unsigned int k;
+    unsigned int alphabet_size;
+    unsigned int nbits;         //!< bits per base in a kmerencoder key
+    bool packed;                //!< keys and nodes are the same numbers
+    node_t nnodes;              //!< alphabet^k
+    node_t top;                 //!< alphabet^(k-1), the place of the first base
+    std::vector<count_t> counts;
+    std::vector<uint64_t> flags;
+    kmerencoder encoder;
+    intbase_t ib;
+
+public:
+    implicitdebruijn(const unsigned int k_p) {
+        k = k_p;
+        alphabet_size = encoder.get_alphabetsize();
+        nbits = encoder.get_nbits();
+        packed = alphabet_size == (1u << nbits);
+        if (k == 0 || !encoder.exact(k))
+            errx(1, "implicitdebruijn: k = %u kmers do not fit in 64 bits", k);
+        top = 1;
+        for (unsigned int i=1; i<k; ++i)
+            top *= alphabet_size;
+        if (top > std::numeric_limits<size_t>::max() / alphabet_size / sizeof(count_t))
+            errx(1, "implicitdebruijn: %u^%u nodes cannot be addressed", alphabet_size, k);
+        nnodes = top * alphabet_size;
+        counts.assign(nnodes, 0);
+        flags.assign((nnodes + 63) / 64, 0);
+    };
+
+    unsigned int get_k() const {
+        return k;
+    };
+    unsigned int get_alphabetsize() const {
+        return alphabet_size;
+    };
+    node_t get_nnodes() const {
+        return nnodes;
+    };
+    //! bytes held by the counts and flags
+    size_t get_memory() const {
+        return counts.size() * sizeof(count_t) + flags.size() * sizeof(uint64_t);
+    };
+
+    //! @brief the node for a kmerencoder key of a plain kmer of length k
+    node_t node(profilekey_t key) const {
+        if (packed)
+            return key;
+        node_t x = 0, place = 1;
+        for (unsigned int i=0; i<k; ++i) {
+            x += (key & ((1ULL << nbits) - 1)) * place;
+            key >>= nbits;
+            place *= alphabet_size;
+        }
+        return x;
+    };
+    //! @brief the kmerencoder key for a node
+    profilekey_t key(node_t x) const {
+        if (packed)
+            return x;
+        profilekey_t key = 0;
+        for (unsigned int i=0; i<k; ++i) {
+            key |= (profilekey_t)(x % alphabet_size) << (i*nbits);
+            x /= alphabet_size;
+        }
+        return key;
+    };
+    //! @brief the kmer as text, for printing
+    std::string kmer(node_t x) {
+        std::string s;
+        for (node_t place=top; place>0; place /= alphabet_size) {
+            s += (place != top ? encoder.separator() : "") + ib.int_to_base(x / place);
+            x %= place;
+        }
+        return s;
+    };
+    //! @brief the base at the left (pos 0) ... right (pos k-1) of the kmer
+    unsigned int base(const node_t x, const unsigned int pos) const {
+        node_t place = top;
+        for (unsigned int i=0; i<pos; ++i)
+            place /= alphabet_size;
+        return x / place % alphabet_size;
+    };
+
+    //! @brief the node reached by shifting b in at the right
+    node_t successor(const node_t x, const unsigned int b) const {
+        return (x % top) * alphabet_size + b;
+    };
+    //! @brief the node that reaches x by shifting b out at the left
+    node_t predecessor(const node_t x, const unsigned int b) const {
+        return x / alphabet_size + b * top;
+    };
+    /*! @brief f(y, b) for each edge x -> y, y = successor(x, b), in order
+     * of b; the edges of a node whose bases are all the same include a loop
+     */
+    template <typename F>
+    void out_edges(const node_t x, F f) const {
+        const node_t first = (x % top) * alphabet_size;
+        for (unsigned int b=0; b<alphabet_size; ++b)
+            f(first + b, b);
+    };
+    //! @brief f(w, b) for each edge w -> x, w = predecessor(x, b), in order of b
+    template <typename F>
+    void in_edges(const node_t x, F f) const {
+        const node_t last = x / alphabet_size;
+        for (unsigned int b=0; b<alphabet_size; ++b)
+            f(last + b * top, b);
+    };
+    /*! @brief f(x, y) for every edge between two nodes with non-zero
+     * counts, i.e. every (k+1)-mer that could have been seen given the
+     * kmers that were
+     */
+    template <typename F>
+    void observed_edges(F f) const {
+        for (node_t x=0; x<nnodes; ++x) {
+            if (counts[x] == 0)
+                continue;
+            out_edges(x, [&](const node_t y, const unsigned int) {
+                if (counts[y] != 0)
+                    f(x, y);
+            });
+        }
+    };
+
+    count_t count(const node_t x) const {
+        return counts[x];
+    };
+    void set_count(const node_t x, const count_t c) {
+        counts[x] = c;
+    };
+    void increment(const node_t x) {
+        if (counts[x] != std::numeric_limits<count_t>::max())
+            ++counts[x];
+    };
+    //! @brief count the kmers of seq; the window starts over after non-bases
+    void add(const std::string& seq) {
+        std::vector<profilekey_t> keys;
+        encoder.kmers(seq, kmeroptions(k), keys);
+        for (auto key=keys.begin(); key != keys.end(); ++key)
+            increment(node(*key));
+    };
+    void clear_counts() {
+        std::fill(counts.begin(), counts.end(), 0);
+    };
+
+    bool flag(const node_t x) const {
+        return (flags[x >> 6] >> (x & 63)) & 1;
+    };
+    void set_flag(const node_t x, const bool on = true) {
+        if (on)
+            flags[x >> 6] |= 1ULL << (x & 63);
+        else
+            flags[x >> 6] &= ~(1ULL << (x & 63));
+    };
+    void clear_flags() {
+        std::fill(flags.begin(), flags.end(), 0);
+    };
+
+    //! @brief every successor's predecessor is the node again, and vice versa
+    void consistency_check() const {
+        for (node_t x=0; x<nnodes; ++x)
+            for (unsigned int b=0; b<alphabet_size; ++b) {
+                const node_t y = successor(x, b);
+                if (y >= nnodes || predecessor(y, x / top) != x)
+                    errx(1, "implicitdebruijn: edge %llu -> %llu does not go back",
+                         (unsigned long long)x, (unsigned long long)y);
+                const node_t w = predecessor(x, b);
+                if (w >= nnodes || successor(w, x % alphabet_size) != x)
+                    errx(1, "implicitdebruijn: edge %llu <- %llu does not go back",
+                         (unsigned long long)x, (unsigned long long)w);
+            }
+        std::cout << "Passed consistency check\n";
+    };
+
+    //! @brief the nodes with non-zero counts and the edges between them
+    void graphviz(const std::string fname, const std::string comment = "") {
+        std::ofstream outf;
+        outf.open(fname);
+        outf << "digraph G {" << std::endl;
+        outf << "graph [fontname = \"helvetica\"];" << std::endl;
+        outf << "graph [label = \"" << comment << "\"];" << std::endl;
+        for (node_t x=0; x<nnodes; ++x)
+            if (counts[x] != 0)
+                outf << "  " << x << " [label=\"" << kmer(x) << " " << (unsigned long)counts[x] << "\"];" << std::endl;
+        observed_edges([&](const node_t x, const node_t y) {
+            outf << "  " << x << " -> " << y << ";" << std::endl;
+        });
+        outf << "}"  << std::endl;
+        outf.close();
+    };
+};
+
+#endif // IMPLICITDEBRUIJN_H
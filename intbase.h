@@ -8,6 +8,9 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
+#include <map>
+#include <iostream>
 #include <log4cxx/logger.h>
 
 /*! @class intbase
@@ -41,8 +44,8 @@ protected:
         alphabet_size = bases.size()-1;
         base_nbits = 0;
         base_bitmask = 0;
-        unsigned int t = alphabet_size;
-        while (t >>= 1) {
+        // enough bits for every base value, including non-powers of 2
+        while ((1u << base_nbits) < alphabet_size) {
             base_bitmask |= 1 << base_nbits;
             ++base_nbits;
         }
@@ -51,16 +54,16 @@ protected:
         }
     };
 
-    // logging
-    log4cxx::LoggerPtr logger = nullptr;
-    void init_logging(void) {
-        logger = log4cxx::Logger::getLogger("intbase");
+    // logging, only ever for errors and tests; looked up once, not for
+    // every base made.  Tracing is trace.h.
+    static log4cxx::LoggerPtr logger(void) {
+        static log4cxx::LoggerPtr l(log4cxx::Logger::getLogger("intbase"));
+        return l;
     };
 
 public:
     intbase() {
         // set_consts must be called by subclass
-        init_logging();
         base_value = begin(); // initialized to first legal value unless via a constructor with an initial value.
     };
 
@@ -72,7 +75,7 @@ public:
     };
     unsigned int get_alphabetsize() const {
         if (alphabet_size == 0) {
-            LOG4CXX_FATAL(logger, "alphabet_size is 0!");
+            LOG4CXX_FATAL(logger(), "alphabet_size is 0!");
             abort();
         }
         return alphabet_size;
@@ -87,7 +90,7 @@ public:
         if (b < get_alphabetsize()) {
             base_value = b;
         } else {
-            LOG4CXX_FATAL(logger, "base " << b << " >= alphabet size " << get_alphabetsize());
+            LOG4CXX_FATAL(logger(), "base " << b << " >= alphabet size " << get_alphabetsize());
             abort();
         }
     };
@@ -101,8 +104,7 @@ public:
             if (b.compare(bases[i]) == 0)
                 return i;
         }
-        log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("base"));
-        LOG4CXX_FATAL(logger, "base_to_int: unknown base '" << b << "'");
+        LOG4CXX_FATAL(logger(), "base_to_int: unknown base '" << b << "'");
         abort();
         /*NOTREACHED*/
     };
@@ -120,9 +122,7 @@ public:
         } else if (value == get_alphabetsize()) {
             return endmarker;
         } else { // fatal error
-            log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("base"));
-
-            LOG4CXX_FATAL(logger, "int_to_base: invalid base value: " << value << " (max " << alphabet_size << ")");
+            LOG4CXX_FATAL(logger(), "int_to_base: invalid base value: " << value << " (max " << alphabet_size << ")");
             abort();
         }
         /*NOTREACHED*/
@@ -137,7 +137,7 @@ public:
     };
     intbase& operator=(const unsigned int i) {
         if (i >= alphabet_size) {
-            LOG4CXX_FATAL(logger, "i >= alphabet_size");
+            LOG4CXX_FATAL(logger(), "i >= alphabet_size");
             abort();
         }
         base_value = i;
@@ -150,7 +150,7 @@ public:
             // do nothing; we are at the end and cannot increment more
         }
         else { // base > get_alphabetsize(); we should never be here
-            LOG4CXX_FATAL(logger, "base ++ on too-large value!");
+            LOG4CXX_FATAL(logger(), "base ++ on too-large value!");
             abort();
         }
         return *this;
@@ -198,76 +198,76 @@ public:
     //! ibp must be a freshly-created instance
     friend void test_intbase(intbase& ibp) {
         if (ibp.alphabet_size == 0) {
-            LOG4CXX_FATAL(ibp.logger, "test_base must be called on a subclass!");
+            LOG4CXX_FATAL(logger(), "test_base must be called on a subclass!");
             abort();
         }
 
         if (ibp.bases.size() != ibp.get_alphabetsize()+1) {
-            LOG4CXX_FATAL(ibp.logger, "number of bases " << ibp.bases.size() << " does not equal alphabet_size(" << ibp.get_alphabetsize() << ") + 1 !");
+            LOG4CXX_FATAL(logger(), "number of bases " << ibp.bases.size() << " does not equal alphabet_size(" << ibp.get_alphabetsize() << ") + 1 !");
             abort();
         }
 
         // base_to_int and int_to_base work
         for (unsigned int i=0; i<ibp.get_alphabetsize(); ++i) {
-            LOG4CXX_TRACE(ibp.logger, "i: " << i << "; base: " << ibp.bases[i]);
+            LOG4CXX_TRACE(logger(), "i: " << i << "; base: " << ibp.bases[i]);
             if (ibp.int_to_base(i) != ibp.bases[i]) {
-                LOG4CXX_FATAL(ibp.logger, "int_to_base(i) != bases[i]");
+                LOG4CXX_FATAL(logger(), "int_to_base(i) != bases[i]");
                 abort();
             }
             if (ibp.base_to_int(ibp.bases[i]) != i) {
-                LOG4CXX_FATAL(ibp.logger, "base_to_int(bases[i]) != i");
+                LOG4CXX_FATAL(logger(), "base_to_int(bases[i]) != i");
                 abort();
             }
 
             base_t b = ibp.int_to_base(i);
             unsigned int ui = ibp.base_to_int(b);
             if (ui != i) {
-                LOG4CXX_FATAL(ibp.logger, "base_to_int(bases[i]) != i");
+                LOG4CXX_FATAL(logger(), "base_to_int(bases[i]) != i");
                 abort();
             }
 
-            LOG4CXX_TRACE(ibp.logger, "i: " << std::dec << i << " converts to '" << b << "'.");
+            LOG4CXX_TRACE(logger(), "i: " << std::dec << i << " converts to '" << b << "'.");
 
             b = ibp.bases.at(i);
             ui = ibp.base_to_int(b);
             if (ui != i) {
-                LOG4CXX_FATAL(ibp.logger, "ui != i");
+                LOG4CXX_FATAL(logger(), "ui != i");
                 abort();
             }
 
-            LOG4CXX_TRACE(ibp.logger, "base '" << b << "' converts to " << std::dec << ui << ".");
+            LOG4CXX_TRACE(logger(), "base '" << b << "' converts to " << std::dec << ui << ".");
         }
-        LOG4CXX_INFO(ibp.logger, "base_to_int and int_to_base work OK.");
+        LOG4CXX_INFO(logger(), "base_to_int and int_to_base work OK.");
 
-        LOG4CXX_DEBUG(ibp.logger, "Newly-created base: " << ibp);
+        LOG4CXX_DEBUG(logger(), "Newly-created base: " << ibp);
 
         // start at min value
         if (ibp.get_int() != ibp.begin()) {
-            LOG4CXX_FATAL(ibp.logger, "ib.get_int() != begin()");
+            LOG4CXX_FATAL(logger(), "ib.get_int() != begin()");
             abort();
         }
 
         // ++ operator works
         for (unsigned int i=1; i<ibp.end(); ++i) {
             ++ibp;
-            LOG4CXX_DEBUG(ibp.logger, "i: " << i << "; ib: " << ibp);
+            LOG4CXX_DEBUG(logger(), "i: " << i << "; ib: " << ibp);
             if (ibp.get_base() != ibp.int_to_base(i)) {
-                LOG4CXX_FATAL(ibp.logger, "ib.get_base() != int_to_base(i)");
+                LOG4CXX_FATAL(logger(), "ib.get_base() != int_to_base(i)");
                 abort();
             }
         }
-        LOG4CXX_DEBUG(ibp.logger, "After ++ loop, ib is: " << ibp);
+        LOG4CXX_DEBUG(logger(), "After ++ loop, ib is: " << ibp);
 
         // -- operator works
         for (unsigned int i=ibp.alphabet_size; i>0; --i) {
-            LOG4CXX_DEBUG(ibp.logger, "i: " << i << "; ib: " << ibp);
+            LOG4CXX_DEBUG(logger(), "i: " << i << "; ib: " << ibp);
             if (ibp.get_base() != ibp.int_to_base(i-1)) {
-                LOG4CXX_FATAL(ibp.logger, "ib.get_base() != int_to_base(i-1)");
+                LOG4CXX_FATAL(logger(), "ib.get_base() != int_to_base(i-1)");
                 abort();
             }
             --ibp;
         }
-        LOG4CXX_DEBUG(ibp.logger, "After -- loop, ib is: " << ibp);
+        LOG4CXX_DEBUG(logger(), "After -- loop, ib is: " << ibp);
     };
     friend std::ostream& operator<< (std::ostream &stream, intbase ib) {
         stream << "{" << std::dec << ib.get_base() << " (" << ib.get_int() << ")}";
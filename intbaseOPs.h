@@ -562,7 +562,6 @@ public:
     };
     intbaseOPs(base_t b) : intbase() {
         set_consts();
-        intbase::init_logging();
         base_value = base_to_int(b);
     };
     intbaseOPs(const unsigned int b) : intbase() {
@@ -570,7 +569,7 @@ public:
         if (b <= get_alphabetsize())
             base_value = b;
         else {
-            LOG4CXX_FATAL(logger, "intbaseOPs constructor: Invalid int base value b " << b << " should be in [0.." << get_alphabetsize() << "].  " << get_alphabetsize() << " is invalid, but is the end indicator.");
+            LOG4CXX_FATAL(logger(), "intbaseOPs constructor: Invalid int base value b " << b << " should be in [0.." << get_alphabetsize() << "].  " << get_alphabetsize() << " is invalid, but is the end indicator.");
             abort();
         }
     };
@@ -584,22 +583,22 @@ public:
         intbaseOPs ib2;
         ib2.set_base((unsigned int)0);
         if (!(ib2 < ib)) {
-            LOG4CXX_FATAL(ib.logger, "ib2 " << ib2 << " >= ib " << ib);
+            LOG4CXX_FATAL(logger(), "ib2 " << ib2 << " >= ib " << ib);
             abort();
         }
         if (!(ib > ib2)) {
-            LOG4CXX_FATAL(ib.logger, "ib <= ib2");
+            LOG4CXX_FATAL(logger(), "ib <= ib2");
             abort();
         }
         if (!(ib == ib)) {
-            LOG4CXX_FATAL(ib.logger, "ib != ib");
+            LOG4CXX_FATAL(logger(), "ib != ib");
             abort();
         }
         if (!(ib2 != ib)) {
-            LOG4CXX_FATAL(ib.logger, "ib2 == ib");
+            LOG4CXX_FATAL(logger(), "ib2 == ib");
             abort();
         }
-        LOG4CXX_INFO(ib.logger, "Relational operators work.");
+        LOG4CXX_INFO(logger(), "Relational operators work.");
     }
 };
 
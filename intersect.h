@@ -0,0 +1,149 @@
+/*!
+ * @brief intersection kernels for two sorted kmer profiles: the dot
+ * product of their counts and the number of kmers they share
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include <algorithm>
+#include <cstdint>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "profilestore.h"
+
+/*! @brief what the intersection of two profiles yields
+ * acc_t is what the dot product is accumulated in: uint64_t is exact, and
+ * double, float or long double trade exactness for other arithmetic.
+ */
+template <class acc_t = uint64_t>
+struct overlap_t {
+    acc_t dot = 0;          //!< sum over shared kmers of the product of the counts
+    uint64_t shared = 0;    //!< number of shared kmers
+};
+
+/*! @brief when the larger profile has at least this many times the kmers
+ * of the smaller, galloping beats walking both.  testintersect measures
+ * the crossover.
+ */
+const size_t gallopratio = 4;
+
+//! @brief walk both profiles in step; the loop has no unpredictable branch
+template <class acc_t>
+inline void
+overlaplinear(const kmerprofile& a, const kmerprofile& b, size_t i, size_t j, overlap_t<acc_t>& o)
+{
+    while (i < a.n && j < b.n) {
+        const profilekey_t ka = a.keys[i], kb = b.keys[j];
+        if (ka == kb) {
+            o.dot += (acc_t)a.counts[i] * b.counts[j];
+            ++o.shared;
+        }
+        i += ka <= kb;
+        j += kb <= ka;
+    }
+}
+
+template <class acc_t = uint64_t>
+inline overlap_t<acc_t>
+overlaplinear(const kmerprofile& a, const kmerprofile& b)
+{
+    overlap_t<acc_t> o;
+    overlaplinear(a, b, 0, 0, o);
+    return o;
+}
+
+/*! @brief compare four keys of each profile at a time
+ * Each block of a is compared with the four rotations of the block of b;
+ * whichever block ends with the smaller key is then done with.  Without
+ * AVX2 this is overlaplinear().
+ */
+template <class acc_t = uint64_t>
+inline overlap_t<acc_t>
+overlapblock(const kmerprofile& a, const kmerprofile& b)
+{
+    overlap_t<acc_t> o;
+    size_t i = 0, j = 0;
+#ifdef __AVX2__
+    while (i + 4 <= a.n && j + 4 <= b.n) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *)(a.keys + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b.keys + j));
+        for (unsigned int r=0; r<4; ++r) {
+            // lane l of a against b[j + (l+r)%4]
+            unsigned int m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(va, vb)));
+            while (m != 0) {
+                const unsigned int l = __builtin_ctz(m);
+                o.dot += (acc_t)a.counts[i + l] * b.counts[j + ((l + r) & 3)];
+                ++o.shared;
+                m &= m - 1;
+            }
+            vb = _mm256_permute4x64_epi64(vb, 0x39);
+        }
+        const profilekey_t amax = a.keys[i + 3], bmax = b.keys[j + 3];
+        i += amax <= bmax ? 4 : 0;
+        j += bmax <= amax ? 4 : 0;
+    }
+#endif
+    overlaplinear(a, b, i, j, o);
+    return o;
+}
+
+/*! @brief look up each kmer of small in large by exponential search from
+ * where the last one was found; the cost depends mostly on the smaller
+ * profile
+ */
+template <class acc_t = uint64_t>
+inline overlap_t<acc_t>
+overlapgallop(const kmerprofile& small, const kmerprofile& large)
+{
+    overlap_t<acc_t> o;
+    size_t j = 0;
+    for (size_t i=0; i<small.n && j<large.n; ++i) {
+        const profilekey_t key = small.keys[i];
+        size_t bound = 1;
+        while (j + bound < large.n && large.keys[j + bound] < key)
+            bound *= 2;
+        const profilekey_t *first = large.keys + j + bound/2;
+        const profilekey_t *last = large.keys + std::min(j + bound + 1, large.n);
+        j = std::lower_bound(first, last, key) - large.keys;
+        if (j < large.n && large.keys[j] == key) {
+            o.dot += (acc_t)small.counts[i] * large.counts[j];
+            ++o.shared;
+            ++j;
+        }
+    }
+    return o;
+}
+
+/*! @brief the overlap of two unpacked profiles, by whichever kernel suits
+ * their sizes
+ */
+template <class acc_t = uint64_t>
+inline overlap_t<acc_t>
+overlap(const kmerprofile& a, const kmerprofile& b)
+{
+    if (a.n >= b.n * gallopratio)
+        return overlapgallop<acc_t>(b, a);
+    if (b.n >= a.n * gallopratio)
+        return overlapgallop<acc_t>(a, b);
+    return overlapblock<acc_t>(a, b);
+}
+
+#endif // INTERSECT_H
@@ -9,6 +9,7 @@
 // #include "charbase.h"
 
 #include <vector>
+#include <cassert>
 
 // A sequence is either a k-mer or where we get the k-mers
 typedef std::vector<base_t> sequence_t;
@@ -21,12 +22,9 @@ protected:
     unsigned int k; //!< @brief the length of the kmer
 
     void validate_k_min(const unsigned int k_p) {
-        std::string init("kmer validate_k: (");
-        init += std::to_string(k_p);
-        init += std::string(") ");
-        // Error checking
+        // Error checking; the message is only built when it is needed
         if (k_p < min_k) {
-            std::cerr << init + std::string("< min k (") + std::to_string(min_k) + std::string(")") << std::endl;
+            std::cerr << "kmer validate_k: (" << k_p << ") < min k (" << min_k << ")" << std::endl;
             assert(k_p >= min_k);
         }
 
@@ -34,8 +32,8 @@ protected:
     };
 
 public:
-    static const unsigned int min_k = 2;
-    static const unsigned int max_k = 14; // 14 appears to be max practical
+    static constexpr unsigned int min_k = 2;
+    static constexpr unsigned int max_k = 14; // 14 appears to be max practical
 
     kmer(const unsigned int k_p) {
         validate_k_min(k_p);
@@ -59,7 +57,7 @@ public:
     virtual sequence_t get_suffix(void) const = 0;
 };
 
-std::ostream& operator<< (std::ostream &stream, sequence_t s) {
+inline std::ostream& operator<< (std::ostream &stream, sequence_t s) {
     for (unsigned int i=0; i<s.size(); ++i) {
         if (i != 0) stream << " ";
         stream << s[i];
@@ -0,0 +1,572 @@
+/*!
+ * @brief turn a sequence into packed integer kmers with a rolling window
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KMERENCODER_H
+#define KMERENCODER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "kmerint.h"
+
+//! a kmer as stored in a profile
+typedef uint64_t profilekey_t;
+
+/*! @brief how the kmers of a sequence are turned into profile keys
+ *
+ * Written as a measureopt: k, then optional comma-separated flags, e.g.
+ * "7" or "7,canonical".  Spaced seeds take the place of k:
+ * "seed=1101101", or several seeds, "seed=1101101,seed=1011011".  A seed
+ * keeps the bases where it has a 1; k is then the longest seed.  "hash"
+ * keys kmers on a rolling hash whatever their size, as is always done for
+ * kmers too big to pack into 64 bits.
+ */
+struct kmeroptions {
+    unsigned int k = 0;
+    //! a kmer and its reverse complement are the same key (DNA only)
+    bool canonical = false;
+    //! spaced seed patterns; empty for contiguous kmers
+    std::vector<std::string> seeds;
+    //! key on a rolling hash even when the kmer would fit in 64 bits
+    bool hashed = false;
+
+    kmeroptions() {};
+    kmeroptions(const unsigned int k_p) {
+        k = k_p;
+    };
+    //! @brief throws std::invalid_argument for anything it does not understand
+    static kmeroptions parse(const std::string& opt) {
+        kmeroptions o;
+        std::string::size_type start = 0;
+        bool first = true;
+        while (start <= opt.length()) {
+            std::string::size_type end = opt.find(',', start);
+            if (end == std::string::npos)
+                end = opt.length();
+            std::string token = opt.substr(start, end - start);
+            if (token.compare(0, 5, "seed=") == 0) {
+                std::string seed = token.substr(5);
+                if (!first && o.seeds.empty())
+                    throw std::invalid_argument("seeds take the place of k in '" + opt + "'");
+                if (seed.length() == 0 || seed.find_first_not_of("01") != std::string::npos ||
+                    seed.front() != '1' || seed.back() != '1')
+                    throw std::invalid_argument("seed '" + seed + "' is not 0s and 1s starting and ending with 1");
+                if (!o.seeds.empty() && weight(seed) != weight(o.seeds[0]))
+                    throw std::invalid_argument("seeds must all have the same number of 1s");
+                o.seeds.push_back(seed);
+                if (seed.length() > o.k)
+                    o.k = seed.length();
+                first = false;
+            } else if (first) {
+                if (token.length() == 0 || token.find_first_not_of("0123456789") != std::string::npos)
+                    throw std::invalid_argument("kmer option '" + opt + "' does not start with k");
+                o.k = std::stoi(token);
+                if (o.k == 0)
+                    throw std::invalid_argument("k must be greater than 0");
+                first = false;
+            } else if (token.compare("canonical") == 0)
+                o.canonical = true;
+            else if (token.compare("hash") == 0)
+                o.hashed = true;
+            else
+                throw std::invalid_argument("unknown kmer option '" + token + "'");
+            start = end + 1;
+        }
+        if (o.hashed && !o.seeds.empty())
+            throw std::invalid_argument("spaced seeds cannot be hashed");
+        return o;
+    };
+    //! @brief the measureopt form
+    std::string str() const {
+        std::string s;
+        if (seeds.empty())
+            s = std::to_string(k);
+        for (auto seed=seeds.begin(); seed != seeds.end(); ++seed)
+            s += (seed == seeds.begin() ? "seed=" : ",seed=") + *seed;
+        if (canonical)
+            s += ",canonical";
+        if (hashed)
+            s += ",hash";
+        return s;
+    };
+    //! @brief number of bases a seed keeps
+    static unsigned int weight(const std::string& seed) {
+        unsigned int w = 0;
+        for (char c : seed)
+            w += c == '1';
+        return w;
+    };
+    bool operator<(const kmeroptions& o) const {
+        if (k != o.k)
+            return k < o.k;
+        if (canonical != o.canonical)
+            return canonical < o.canonical;
+        if (hashed != o.hashed)
+            return hashed < o.hashed;
+        return seeds < o.seeds;
+    };
+    bool operator==(const kmeroptions& o) const {
+        return k == o.k && canonical == o.canonical && hashed == o.hashed &&
+               seeds == o.seeds;
+    };
+};
+
+/*! @class kmerencoder
+ * @brief rolling kmer encoder using the intbase_t alphabet
+ *
+ * The packing is the same as kmerint: the first base is in the
+ * highest-order bits, each base takes get_nbits() bits.  A kmer that
+ * does not fit in 64 bits (or any kmer, if asked for) is keyed instead by
+ * a 64-bit rolling hash, so such keys identify kmers only up to (very
+ * unlikely) collisions; testkmerhash measures how unlikely.
+ *
+ * For canonical kmers the reverse complement is rolled along with the
+ * kmer (entering at the high end) and the smaller of the two is the key.
+ *
+ * A spaced seed is a mask over the packed window of its length; the kept
+ * bases are gathered into a key with PEXT where the CPU has it (BMI2),
+ * and otherwise by shifting out each run of kept bases.  With several
+ * seeds the seed number goes above the gathered bases.
+ *
+ * A sequence is read a symbol at a time.  For an alphabet of single
+ * characters a symbol is a character; when the bases are longer, such as
+ * the x86 operators of intbaseOPs, they are separated by white space and
+ * a symbol is a word, e.g. "MOV ADD CVTDQ2PD".  Either way, case does not
+ * matter, and a symbol that is not a base (e.g., N) cannot be part of a
+ * kmer; the window starts over after it.
+ */
+class kmerencoder {
+    int codes[256];             //!< base value for each character; -1 if not a base
+    bool multichar = false;     //!< the bases are words, not characters
+    std::unordered_map<std::string, int> wordcodes; //!< base value of each (upper case) word
+    int complement[256];        //!< base value of the complement of a base value
+    std::vector<uint64_t> symhash; //!< random bits for each base value, for hashed kmers
+    unsigned int nbits;         //!< bits per base
+    unsigned int alphabet_size;
+    bool hascomplement = false; //!< the alphabet is DNA
+
+    static uint64_t mix(uint64_t x) {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    };
+    //! how many symbols to scan for the kmers of length k starting before nstarts
+    static size_t scanend(const size_t nstarts, const unsigned int k) {
+        return nstarts == SIZE_MAX ? SIZE_MAX : nstarts + k - 1;
+    };
+    static bool space(const char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    };
+    //! move pos to the start of the next symbol; false if there is none
+    bool more(const std::string& seq, size_t& pos) const {
+        if (multichar)
+            while (pos < seq.length() && space(seq[pos]))
+                ++pos;
+        return pos < seq.length();
+    };
+    //! the base value of the symbol at pos, or -1 if it is not a base; pos moves past it
+    int next(const std::string& seq, size_t& pos) const {
+        if (!multichar)
+            return codes[(unsigned char)seq[pos++]];
+        std::string word;
+        for ( ; pos < seq.length() && !space(seq[pos]); ++pos)
+            word += toupper((unsigned char)seq[pos]);
+        auto it = wordcodes.find(word);
+        return it == wordcodes.end() ? -1 : it->second;
+    };
+    uint64_t mask(const unsigned int k) const {
+        return k*nbits == 64 ? ~0ULL : (1ULL << (k*nbits)) - 1;
+    };
+
+    void checkoptions(const kmeroptions& o) const {
+        if (o.canonical && !hascomplement)
+            throw std::invalid_argument("canonical kmers need the DNA alphabet");
+        if (!o.seeds.empty()) {
+            unsigned int tagbits = 0;
+            while ((1u << tagbits) < o.seeds.size())
+                ++tagbits;
+            if (o.hashed || !exact(o.k) || kmeroptions::weight(o.seeds[0])*nbits + tagbits > 64)
+                throw std::invalid_argument("spaced seeds must fit in 64 bits");
+        }
+    };
+
+    //! where a seed's kept bases are in the packed window
+    struct seedmask_t {
+        unsigned int span;  //!< seed length
+        uint64_t mask;      //!< the window bits the seed keeps
+        //! (shift, width) of each run of kept bits, lowest first
+        std::vector<std::pair<unsigned int, unsigned int>> runs;
+    };
+
+    // The seed is aligned with the newest base in the low bits, the same
+    // way the window is, whatever the seed's length.
+    seedmask_t seedmask(const std::string& seed) const {
+        seedmask_t s;
+        s.span = seed.length();
+        s.mask = 0;
+        for (unsigned int i=0; i<s.span; ++i)
+            if (seed[i] == '1')
+                s.mask |= mask(1) << ((s.span-1-i)*nbits);
+        for (unsigned int bit=0; bit<64; ) {
+            if (((s.mask >> bit) & 1) == 0) {
+                ++bit;
+                continue;
+            }
+            unsigned int width = 0;
+            while (bit + width < 64 && ((s.mask >> (bit + width)) & 1))
+                ++width;
+            s.runs.emplace_back(bit, width);
+            bit += width;
+        }
+        return s;
+    };
+
+    static uint64_t gather(const uint64_t window, const seedmask_t& s) {
+#ifdef __BMI2__
+        return _pext_u64(window, s.mask);
+#else
+        uint64_t key = 0;
+        unsigned int keybits = 0;
+        for (auto r=s.runs.begin(); r != s.runs.end(); ++r) {
+            uint64_t runmask = r->second == 64 ? ~0ULL : (1ULL << r->second) - 1;
+            key |= ((window >> r->first) & runmask) << keybits;
+            keybits += r->second;
+        }
+        return key;
+#endif
+    };
+
+    void seededkmers(const std::string& seq, const kmeroptions& o,
+                     std::vector<profilekey_t>& keys, const size_t nstarts) const {
+        std::vector<seedmask_t> masks;
+        for (auto seed=o.seeds.begin(); seed != o.seeds.end(); ++seed)
+            masks.push_back(seedmask(*seed));
+        const unsigned int tagshift = kmeroptions::weight(o.seeds[0]) * nbits;
+        const bool tagged = masks.size() > 1;
+
+        const unsigned int k = o.k;
+        const uint64_t m = mask(k);
+        const unsigned int rcshift = (k-1)*nbits;
+        const size_t end = scanend(nstarts, k);
+        uint64_t window = 0, rc = 0;
+        unsigned int valid = 0;
+        size_t pos = 0;
+        for (size_t p=0; p<end && more(seq, pos); ++p) {
+            const int code = next(seq, pos);
+            if (code < 0) {
+                valid = 0;
+                continue;
+            }
+            window = ((window << nbits) | code) & m;
+            if (o.canonical)
+                rc = (rc >> nbits) | ((uint64_t)complement[code] << rcshift);
+            ++valid;
+            for (unsigned int i=0; i<masks.size(); ++i) {
+                if (valid < masks[i].span || p + 1 - masks[i].span >= nstarts)
+                    continue;
+                uint64_t key = gather(window, masks[i]);
+                if (o.canonical) {
+                    // the reverse strand's window for this seed is the
+                    // high end of rc
+                    uint64_t rckey = gather(rc >> ((k - masks[i].span)*nbits), masks[i]);
+                    if (rckey < key)
+                        key = rckey;
+                }
+                if (tagged)
+                    key |= (uint64_t)i << tagshift;
+                keys.push_back(key);
+            }
+        }
+    };
+
+    // Arithmetic modulo the Mersenne prime 2^61 - 1, for the rolling hash
+    static constexpr uint64_t hashprime = (1ULL << 61) - 1;
+    static constexpr uint64_t hashbase = 0x1e3779b97f4a7c15ULL % ((1ULL << 61) - 1);
+    static uint64_t mulmod(const uint64_t a, const uint64_t b) {
+        unsigned __int128 t = (unsigned __int128)a * b;
+        uint64_t r = ((uint64_t)t & hashprime) + (uint64_t)(t >> 61);
+        return r >= hashprime ? r - hashprime : r;
+    };
+    static uint64_t addmod(const uint64_t a, const uint64_t b) {
+        uint64_t r = a + b;
+        return r >= hashprime ? r - hashprime : r;
+    };
+    static uint64_t submod(const uint64_t a, const uint64_t b) {
+        return a >= b ? a - b : a + hashprime - b;
+    };
+    static uint64_t powmod(uint64_t a, uint64_t e) {
+        uint64_t r = 1;
+        for (; e > 0; e >>= 1) {
+            if (e & 1)
+                r = mulmod(r, a);
+            a = mulmod(a, a);
+        }
+        return r;
+    };
+
+    /* Rabin-Karp rolling hash: the window s_0..s_{k-1} hashes to
+     * sum(symhash[s_j] * B^(k-1-j)) mod 2^61-1.  The reverse complement is
+     * rolled the other way, sum(symhash[comp(s_j)] * B^j), so a kmer and
+     * its reverse complement hash alike.  The result goes through mix() to
+     * spread it over 64 bits.
+     */
+    void hashedkmers(const std::string& seq, const kmeroptions& o,
+                     std::vector<profilekey_t>& keys, const size_t nstarts) const {
+        const unsigned int k = o.k;
+        const uint64_t topweight = powmod(hashbase, k-1);   // B^(k-1)
+        const uint64_t baseinverse = powmod(hashbase, hashprime - 2);
+        std::vector<int> ring(k);   // the symbols in the window
+        unsigned int oldest = 0;    // ring position of the symbol leaving next
+        uint64_t f = 0, r = 0, weight = 1;
+        unsigned int valid = 0;
+        const size_t end = scanend(nstarts, k);
+        size_t pos = 0;
+        for (size_t p=0; p<end && more(seq, pos); ++p) {
+            const int code = next(seq, pos);
+            if (code < 0) {
+                valid = 0;
+                oldest = 0;
+                f = r = 0;
+                weight = 1;
+                continue;
+            }
+            if (valid < k) {
+                f = addmod(mulmod(f, hashbase), symhash[code]);
+                if (o.canonical) {
+                    r = addmod(r, mulmod(symhash[complement[code]], weight));
+                    weight = mulmod(weight, hashbase);
+                }
+                ring[valid++] = code;
+            } else {
+                int out = ring[oldest];
+                f = submod(f, mulmod(symhash[out], topweight));
+                f = addmod(mulmod(f, hashbase), symhash[code]);
+                if (o.canonical) {
+                    r = mulmod(submod(r, symhash[complement[out]]), baseinverse);
+                    r = addmod(r, mulmod(symhash[complement[code]], topweight));
+                }
+                ring[oldest] = code;
+                oldest = oldest + 1 == k ? 0 : oldest + 1;
+            }
+            if (valid >= k)
+                keys.push_back(mix(o.canonical && r < f ? r : f));
+        }
+    };
+
+public:
+    kmerencoder() {
+        intbase_t ib;
+        nbits = ib.get_nbits();
+        alphabet_size = ib.get_alphabetsize();
+        for (unsigned int c=0; c<256; ++c) {
+            codes[c] = -1;
+            complement[c] = -1;
+        }
+        for (unsigned int i=0; i<alphabet_size; ++i)
+            if (ib.int_to_base(i).length() != 1)
+                multichar = true;
+        for (unsigned int i=0; i<alphabet_size; ++i) {
+            base_t b = ib.int_to_base(i);
+            if (multichar) {
+                std::transform(b.begin(), b.end(), b.begin(), ::toupper);
+                wordcodes.emplace(b, i);
+            } else {
+                codes[(unsigned char)toupper(b[0])] = i;
+                codes[(unsigned char)tolower(b[0])] = i;
+            }
+        }
+
+        for (unsigned int i=0; i<alphabet_size; ++i)
+            symhash.push_back(1 + mix(0x9e3779b97f4a7c15ULL * (i + 1)) % (hashprime - 1));
+
+        const char *dna = "ACGT";
+        hascomplement = alphabet_size == 4;
+        for (unsigned int i=0; i<4; ++i)
+            if (codes[(unsigned char)dna[i]] < 0)
+                hascomplement = false;
+        if (hascomplement)
+            for (unsigned int i=0; i<4; ++i)
+                complement[codes[(unsigned char)dna[i]]] = codes[(unsigned char)dna[3-i]];
+    };
+
+    unsigned int get_nbits() const {
+        return nbits;
+    };
+    unsigned int get_alphabetsize() const {
+        return alphabet_size;
+    };
+    //! whether the alphabet is DNA, which canonical kmers need
+    bool has_complement() const {
+        return hascomplement;
+    };
+    //! whether kmers of length k are packed exactly rather than folded
+    bool exact(const unsigned int k) const {
+        return k*nbits <= 64;
+    };
+    //! what goes between two bases in the text of a sequence
+    std::string separator() const {
+        return multichar ? " " : "";
+    };
+    //! the number of symbols in seq, bases or not
+    size_t symbols(const std::string& seq) const {
+        if (!multichar)
+            return seq.length();
+        size_t n = 0;
+        for (size_t pos=0; more(seq, pos); ++n)
+            next(seq, pos);
+        return n;
+    };
+    /*! @brief where to cut seq to count its kmers in pieces of at most
+     * nstarts kmer starts: the (first character, number of characters) of
+     * each piece, each running on for k-1 symbols more so that the kmers
+     * across a cut are seen.  kmers(seq.substr(first, n), o, keys, nstarts)
+     * for every piece finds each kmer of seq once.
+     */
+    std::vector<std::pair<size_t, size_t>> pieces(const std::string& seq, const size_t nstarts,
+                                                  const unsigned int k) const {
+        std::vector<std::pair<size_t, size_t>> result;
+        if (!multichar) {
+            for (size_t start=0; start<seq.length(); start += nstarts)
+                result.emplace_back(start, std::min(seq.length() - start, nstarts + k - 1));
+            return result;
+        }
+        // piece j starts at symbol j*nstarts and ends before symbol
+        // (j+1)*nstarts + k-1, or at the end of seq
+        size_t pos = 0;
+        for (size_t n=0; more(seq, pos); ++n) {
+            if (n >= nstarts + k - 1 && (n - (k - 1)) % nstarts == 0) {
+                std::pair<size_t, size_t>& piece = result[(n - (k - 1)) / nstarts - 1];
+                piece.second = pos - piece.first;
+            }
+            if (n % nstarts == 0)
+                result.emplace_back(pos, SIZE_MAX);
+            next(seq, pos);
+        }
+        for (auto piece=result.begin(); piece != result.end(); ++piece)
+            if (piece->second == SIZE_MAX)
+                piece->second = seq.length() - piece->first;
+        return result;
+    };
+
+    /*! @brief append the key of every kmer in seq to keys, in sequence order
+     * Only kmers starting before symbol nstarts are wanted; counting a
+     * long sequence in pieces uses this to leave the kmers that start in
+     * the overlap to the next piece.
+     */
+    void kmers(const std::string& seq, const kmeroptions& o, std::vector<profilekey_t>& keys,
+               const size_t nstarts = SIZE_MAX) const {
+        checkoptions(o);
+        if (!o.seeds.empty()) {
+            seededkmers(seq, o, keys, nstarts);
+            return;
+        }
+        if (o.hashed || !exact(o.k)) {
+            hashedkmers(seq, o, keys, nstarts);
+            return;
+        }
+
+        const unsigned int k = o.k;
+        const uint64_t m = mask(k);
+        const unsigned int rcshift = (k-1)*nbits;
+        const size_t end = scanend(nstarts, k);
+        uint64_t window = 0, rc = 0;
+        unsigned int valid = 0;
+        size_t pos = 0;
+        for (size_t p=0; p<end && more(seq, pos); ++p) {
+            const int code = next(seq, pos);
+            if (code < 0) {
+                valid = 0;
+                continue;
+            }
+            window = ((window << nbits) | code) & m;
+            if (o.canonical)
+                rc = (rc >> nbits) | ((uint64_t)complement[code] << rcshift);
+            if (++valid >= k)
+                keys.push_back(o.canonical && rc < window ? rc : window);
+        }
+    };
+
+    /*! @brief kmers(seq, os[i], keys[i]) for every i, in one pass over seq
+     * The window holds the longest exactly-packed kmer; the shorter ones
+     * ending at the same place are its low-order bits.  Reverse complements
+     * do not nest that way, so each canonical k rolls its own; seeds and
+     * hashed kmers are done on their own.
+     */
+    void kmers(const std::string& seq, const std::vector<kmeroptions>& os,
+               std::vector<std::vector<profilekey_t>>& keys,
+               const size_t nstarts = SIZE_MAX) const {
+        keys.resize(os.size());
+        std::vector<uint64_t> masks(os.size(), 0);
+        std::vector<uint64_t> rcs(os.size(), 0);
+        unsigned int kmax = 0;
+        for (unsigned int i=0; i<os.size(); ++i) {
+            if (!os[i].seeds.empty() || os[i].hashed || !exact(os[i].k)) {
+                kmers(seq, os[i], keys[i], nstarts);
+                continue;
+            }
+            checkoptions(os[i]);
+            masks[i] = mask(os[i].k);
+            if (os[i].k > kmax)
+                kmax = os[i].k;
+        }
+        if (kmax == 0)
+            return;
+
+        const uint64_t m = mask(kmax);
+        const size_t end = scanend(nstarts, kmax);
+        uint64_t window = 0;
+        unsigned int valid = 0;
+        size_t pos = 0;
+        for (size_t p=0; p<end && more(seq, pos); ++p) {
+            const int code = next(seq, pos);
+            if (code < 0) {
+                valid = 0;
+                continue;
+            }
+            window = ((window << nbits) | code) & m;
+            ++valid;
+            for (unsigned int i=0; i<os.size(); ++i) {
+                if (masks[i] == 0)
+                    continue;
+                uint64_t key = window & masks[i];
+                if (os[i].canonical) {
+                    rcs[i] = (rcs[i] >> nbits) |
+                             ((uint64_t)complement[code] << ((os[i].k-1)*nbits));
+                    if (rcs[i] < key)
+                        key = rcs[i];
+                }
+                if (valid >= os[i].k && p + 1 - os[i].k < nstarts)
+                    keys[i].push_back(key);
+            }
+        }
+    };
+};
+
+#endif // KMERENCODER_H
@@ -0,0 +1,283 @@
+/*!
+ * @brief concurrent kmer counting in one open-addressing hash table
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kmerhashtable.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <err.h>
+
+kmerhashtable::kmerhashtable(const uint64_t expected)
+{
+    nkeys = 0;
+    reserved = 0;
+    emptycount = 0;
+    uint64_t slots = 16;
+    while (slots * maxload < expected)
+        slots *= 2;
+    allocate(slots);
+}
+
+void
+kmerhashtable::allocate(const uint64_t slots)
+{
+    capacity = slots;
+    mask = slots - 1;
+    keys.reset(new std::atomic<profilekey_t>[slots]);
+    counts.reset(new std::atomic<profilecount_t>[slots]);
+    for (uint64_t s=0; s<slots; ++s) {
+        keys[s].store(empty, std::memory_order_relaxed);
+        counts[s].store(0, std::memory_order_relaxed);
+    }
+}
+
+//! double the table until needed more keys fit; every batch has finished
+void
+kmerhashtable::grow(const uint64_t needed)
+{
+    std::unique_lock<std::shared_mutex> lock(growlock);
+    uint64_t slots = capacity;
+    while (reserved + needed > slots * maxload)
+        slots *= 2;
+    if (slots == capacity)
+        return;     // another thread grew it first
+
+    std::unique_ptr<std::atomic<profilekey_t>[]> oldkeys(std::move(keys));
+    std::unique_ptr<std::atomic<profilecount_t>[]> oldcounts(std::move(counts));
+    const uint64_t oldcapacity = capacity;
+    allocate(slots);
+    for (uint64_t s=0; s<oldcapacity; ++s) {
+        const profilekey_t key = oldkeys[s].load(std::memory_order_relaxed);
+        if (key != empty)
+            insert(key, oldcounts[s].load(std::memory_order_relaxed), hash(key) & mask);
+    }
+    ids.clear();
+}
+
+//! add c to key's count, probing from slot; true if the key is new
+bool
+kmerhashtable::insert(const profilekey_t key, const profilecount_t c, uint64_t slot)
+{
+    while (true) {
+        profilekey_t k = keys[slot].load(std::memory_order_acquire);
+        if (k == empty && keys[slot].compare_exchange_strong(k, key, std::memory_order_acq_rel)) {
+            counts[slot].fetch_add(c, std::memory_order_relaxed);
+            return true;
+        }
+        // k is now what is in the slot, even if another thread just put it there
+        if (k == key) {
+            counts[slot].fetch_add(c, std::memory_order_relaxed);
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void
+kmerhashtable::add(const profilekey_t *batch, const size_t n)
+{
+    // keep the room reserved at a time modest
+    const size_t most = 1 << 16;
+    for (size_t start=0; start<n; start += most) {
+        const size_t len = std::min(most, n - start);
+        const profilekey_t *b = batch + start;
+        while (true) {
+            std::shared_lock<std::shared_mutex> lock(growlock);
+            if (reserved.fetch_add(len) + len > capacity * maxload) {
+                reserved -= len;
+                lock.unlock();
+                grow(len);
+                continue;
+            }
+            uint64_t fresh = 0;
+            uint64_t slots[prefetchbatch];
+            for (size_t i=0; i<len; i += prefetchbatch) {
+                const size_t m = std::min((size_t)prefetchbatch, len - i);
+                for (size_t j=0; j<m; ++j) {
+                    slots[j] = hash(b[i+j]) & mask;
+                    __builtin_prefetch(&keys[slots[j]]);
+                    __builtin_prefetch(&counts[slots[j]]);
+                }
+                for (size_t j=0; j<m; ++j) {
+                    if (b[i+j] == empty)
+                        fresh += emptycount.fetch_add(1, std::memory_order_relaxed) == 0;
+                    else
+                        fresh += insert(b[i+j], 1, slots[j]);
+                }
+            }
+            nkeys += fresh;
+            reserved -= len - fresh;
+            break;
+        }
+    }
+}
+
+void
+kmerhashtable::add(const profilekey_t key, const profilecount_t c)
+{
+    if (c == 0)
+        return;
+    while (true) {
+        std::shared_lock<std::shared_mutex> lock(growlock);
+        if (reserved.fetch_add(1) + 1 > capacity * maxload) {
+            reserved -= 1;
+            lock.unlock();
+            grow(1);
+            continue;
+        }
+        bool fresh;
+        if (key == empty)
+            fresh = emptycount.fetch_add(c, std::memory_order_relaxed) == 0;
+        else
+            fresh = insert(key, c, hash(key) & mask);
+        if (fresh)
+            ++nkeys;
+        else
+            --reserved;
+        break;
+    }
+}
+
+/*! Sequences are cut into pieces of at most piecelength kmer starts
+ * (each extended by the longest k less one, so that the kmers across a
+ * cut are seen; see kmerencoder::pieces), and the threads take pieces in
+ * turn.
+ */
+void
+kmerhashtable::count(const std::vector<kmerhashtable*>& tables, const std::vector<kmeroptions>& os,
+                     const fastavec_t& seqs, const unsigned int nthreads)
+{
+    unsigned int kmax = 0;
+    for (auto o=os.begin(); o != os.end(); ++o)
+        kmax = std::max(kmax, o->k);
+    kmerencoder encoder;
+    // (sequence, (first character, number of characters))
+    std::vector<std::pair<size_t, std::pair<size_t, size_t>>> pieces;
+    for (size_t s=0; s<seqs.size(); ++s) {
+        const std::vector<std::pair<size_t, size_t>> cuts = encoder.pieces(seqs[s].get_seq(), piecelength, kmax);
+        for (auto c=cuts.begin(); c != cuts.end(); ++c)
+            pieces.emplace_back(s, *c);
+    }
+
+    std::atomic<size_t> next(0);
+    auto countpieces = [&]() {
+        std::vector<std::vector<profilekey_t>> all;
+        for (size_t n=next++; n<pieces.size(); n=next++) {
+            for (auto a=all.begin(); a != all.end(); ++a)
+                a->clear();
+            const std::string& seq = seqs[pieces[n].first].get_seq();
+            encoder.kmers(seq.substr(pieces[n].second.first, pieces[n].second.second), os, all, piecelength);
+            for (unsigned int i=0; i<tables.size(); ++i)
+                tables[i]->add(all[i].data(), all[i].size());
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t=0; t<nthreads; ++t)
+        threads.emplace_back(countpieces);
+    for (auto th=threads.begin(); th != threads.end(); ++th)
+        th->join();
+}
+
+//! the slot holding key, or capacity if it is not there
+uint64_t
+kmerhashtable::slot(const profilekey_t key) const
+{
+    for (uint64_t s=hash(key) & mask; ; s = (s + 1) & mask) {
+        const profilekey_t k = keys[s].load(std::memory_order_relaxed);
+        if (k == key)
+            return s;
+        if (k == empty)
+            return capacity;
+    }
+}
+
+profilecount_t
+kmerhashtable::find(const profilekey_t key) const
+{
+    if (key == empty)
+        return emptycount;
+    const uint64_t s = slot(key);
+    return s == capacity ? 0 : counts[s].load(std::memory_order_relaxed);
+}
+
+void
+kmerhashtable::profile(ownedprofile& p) const
+{
+    std::vector<std::pair<profilekey_t, profilecount_t>> all;
+    all.reserve(nkeys);
+    for (uint64_t s=0; s<capacity; ++s) {
+        const profilekey_t key = keys[s].load(std::memory_order_relaxed);
+        if (key != empty)
+            all.emplace_back(key, counts[s].load(std::memory_order_relaxed));
+    }
+    std::sort(all.begin(), all.end());
+    if (emptycount > 0)
+        all.emplace_back(empty, emptycount.load());
+
+    p.keys.resize(all.size());
+    p.counts.resize(all.size());
+    p.sqnorm = 0;
+    for (size_t i=0; i<all.size(); ++i) {
+        p.keys[i] = all[i].first;
+        p.counts[i] = all[i].second;
+        p.sqnorm += (uint64_t)all[i].second * all[i].second;
+    }
+}
+
+std::vector<uint64_t>
+kmerhashtable::spectrum() const
+{
+    std::vector<uint64_t> spectrum(1, 0);
+    auto tally = [&](const profilecount_t c) {
+        if (c >= spectrum.size())
+            spectrum.resize(c + 1, 0);
+        ++spectrum[c];
+    };
+    for (uint64_t s=0; s<capacity; ++s)
+        if (keys[s].load(std::memory_order_relaxed) != empty)
+            tally(counts[s].load(std::memory_order_relaxed));
+    if (emptycount > 0)
+        tally(emptycount);
+    return spectrum;
+}
+
+void
+kmerhashtable::assignids()
+{
+    ownedprofile p;
+    profile(p);
+    if (p.keys.size() > UINT32_MAX)
+        errx(1, "kmerhashtable: too many kmers to number");
+    ids.assign(capacity, 0);
+    for (size_t i=0; i<p.keys.size(); ++i) {
+        if (p.keys[i] == empty)
+            emptyid = i;
+        else
+            ids[slot(p.keys[i])] = i;
+    }
+}
+
+uint32_t
+kmerhashtable::id(const profilekey_t key) const
+{
+    if (ids.empty())
+        errx(1, "kmerhashtable: id() before assignids()");
+    return key == empty ? emptyid : ids[slot(key)];
+}
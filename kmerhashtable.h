@@ -0,0 +1,127 @@
+/*!
+ * @brief concurrent kmer counting in one open-addressing hash table
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KMERHASHTABLE_H
+#define KMERHASHTABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+#include "FastaRecord.h"
+#include "kmerencoder.h"
+#include "profilestore.h"
+
+/*! @class kmerhashtable
+ * @brief kmer counts for a whole data set, added to by any number of
+ * threads at once
+ *
+ * Each slot is an atomic key and an atomic count.  A thread adding a key
+ * probes linearly from the key's hash: finding the key, it adds to the
+ * count; finding an empty slot, it claims it with a compare-and-swap (and
+ * if another thread claimed it first with the same key, adds to that).
+ * Within a batch no thread waits for another.
+ *
+ * Keys are added in batches (add(keys, n)); the slots a batch will probe
+ * are prefetched before any of them is touched, which hides most of the
+ * cache misses.  Each batch holds growlock shared.  Before a batch, a
+ * thread reserves room for every key in it being new; when the table
+ * would get too full, the thread takes growlock exclusively and doubles
+ * the table.  That waits for the batches under way, and new batches wait
+ * for the doubling, so adding does block while the table grows; sizing
+ * the table for the expected keys up front avoids it.
+ *
+ * Once the adding is done, the table gives the sorted profile of
+ * everything added (for a sparsedebruijn graph, say), the kmer spectrum,
+ * and numbers for the kmers in key order; none of those may run while
+ * keys are being added.
+ */
+class kmerhashtable {
+    //! marks an empty slot; the one key equal to it is counted on its own
+    static constexpr profilekey_t empty = ~0ULL;
+    static constexpr double maxload = 0.7;
+    //! keys prefetched at a time
+    static const unsigned int prefetchbatch = 16;
+
+    std::unique_ptr<std::atomic<profilekey_t>[]> keys;
+    std::unique_ptr<std::atomic<profilecount_t>[]> counts;
+    uint64_t capacity = 0;      //!< a power of two
+    uint64_t mask = 0;
+    std::atomic<uint64_t> nkeys;
+    //! keys plus what the batches under way might add
+    std::atomic<uint64_t> reserved;
+    std::atomic<profilecount_t> emptycount;
+    std::shared_mutex growlock;
+    std::vector<uint32_t> ids;  //!< per slot, after assignids()
+    uint32_t emptyid = 0;
+
+    static uint64_t hash(uint64_t x) {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    };
+    void allocate(const uint64_t slots);
+    void grow(const uint64_t needed);
+    bool insert(const profilekey_t key, const profilecount_t c, uint64_t slot);
+    uint64_t slot(const profilekey_t key) const;
+
+public:
+    //! kmer starts in one piece of a sequence counted by one thread
+    static const size_t piecelength = 1 << 20;
+
+    //! @brief a table with room for about expected keys before it grows
+    kmerhashtable(const uint64_t expected = 1 << 16);
+
+    //! @brief count keys[0..n); safe to call from any number of threads
+    void add(const profilekey_t *keys, const size_t n);
+    //! @brief add c to one key's count; as safe, but slower than a batch
+    void add(const profilekey_t key, const profilecount_t c = 1);
+    /*! @brief count the kmers of seqs for each options o[i] into
+     * tables[i], in nthreads threads, with one pass over each piece of
+     * a sequence for all of them
+     */
+    static void count(const std::vector<kmerhashtable*>& tables, const std::vector<kmeroptions>& os,
+                      const fastavec_t& seqs, const unsigned int nthreads = 1);
+
+    //! @brief the number of distinct keys
+    uint64_t size() const {
+        return nkeys;
+    };
+    uint64_t get_capacity() const {
+        return capacity;
+    };
+    //! @brief a key's count; 0 if it was never added
+    profilecount_t find(const profilekey_t key) const;
+    //! @brief the sorted keys and their counts
+    void profile(ownedprofile& p) const;
+    //! @brief how many keys have each count: spectrum[c] for c = 0 .. the largest count
+    std::vector<uint64_t> spectrum() const;
+    //! @brief number the keys 0 .. size()-1 in key order, for id()
+    void assignids();
+    //! @brief a key's number from assignids(); the key must be in the table
+    uint32_t id(const profilekey_t key) const;
+};
+
+#endif // KMERHASHTABLE_H
@@ -19,12 +19,15 @@
 #include "intbase2.h"
 #include "intbaseOPs.h"
 
-// The specific intbase subclass we use
-//typedef intbaseDNA intbase_t;
-// typedef intbase2 intbase_t;
-typedef intbaseOPs intbase_t;
-
-std::ostream& operator<<(std::ostream& os, const unsigned __int128 i) noexcept
+// The specific intbase subclass we use; -DALPHABET=intbaseDNA (or
+// intbase2) when compiling picks another.  Everything linked together
+// must be compiled for the same one.
+#ifndef ALPHABET
+#define ALPHABET intbaseOPs
+#endif
+typedef ALPHABET intbase_t;
+
+inline std::ostream& operator<<(std::ostream& os, const unsigned __int128 i) noexcept
 {
   std::ostream::sentry s(os);
   if (s) {
@@ -84,52 +87,50 @@ class kmerint : public kmer {
 
     void validate_k_max(const unsigned int k_p) {
         // superclass validates against min, nut not max k
-        std::string init("kmerint validate_k: (");
-        init += std::to_string(k_p);
-        init += std::string(") ");
-        // Error checking
-        if (k_p > max_k) {
-            LOG4CXX_FATAL(logger, init + std::string("> max k (") + std::to_string(max_k) + std::string(")"));
+        if (k_p > get_max_k()) {
+            LOG4CXX_FATAL(logger(), "kmerint validate_k: (" << k_p << ") > max k (" << get_max_k() << ")");
             abort();
         }
     };
 
-    // logging
-    log4cxx::LoggerPtr logger = nullptr;
-    void init_logging(void) {
-        logger = log4cxx::Logger::getLogger("kmerint");
+    // logging, only ever for fatal errors; looked up once, not for every
+    // kmerint made.  Tracing is trace.h.
+    static log4cxx::LoggerPtr logger(void) {
+        static log4cxx::LoggerPtr l(log4cxx::Logger::getLogger("kmerint"));
+        return l;
     };
 
 
 public:
+    //! @brief the largest k whose bases all fit in kmer_storage_t, at most kmer::max_k
+    static unsigned int get_max_k(void) {
+        intbase_t ib;
+        return std::min(max_k, (unsigned int)(8 * sizeof(kmer_storage_t)) / ib.get_nbits());
+    };
+
     kmerint(const unsigned int k_p) : kmer(k_p) {
-        init_logging();
         validate_k_max(k_p);
         init_consts();
         set_kmerhash(0);
     };
     kmerint(const kmerint &k_p) : kmer(k_p.k) {
-        init_logging();
         validate_k_max(k_p.k);  // should always succeed since k_p called this also.
         init_consts();
         kmerhash = k_p.kmerhash;
         kmerbitmask = k_p.kmerbitmask;
     };
     kmerint(const unsigned int k_p, const sequence_t kmer_p) : kmer(k_p) {
-        init_logging();
         validate_k_max(k_p);
         init_consts();
         set_kmer(kmer_p);
     };
     kmerint(const unsigned int k_p, const kmer_storage_t hash) : kmer(k_p) {
-        init_logging();
         validate_k_max(k_p);
         init_consts();
         set_kmerhash(hash);
     };
     kmerint(void) : kmer(2) { // 2 is bogus, but we want to die here and not there.
-        init_logging();
-        LOG4CXX_FATAL(logger, "kmerint constructor called with no k; this is illegal.");
+        LOG4CXX_FATAL(logger(), "kmerint constructor called with no k; this is illegal.");
         abort();
     };
 
@@ -252,7 +253,7 @@ public:
         if (kmer.size() != k) {
             std::stringstream kmerstr;
             kmerstr << kmer;
-            LOG4CXX_FATAL(logger, "kmer '" << kmerstr.str() << "' length (" << kmer.size() << ") is not k (" << k << ")");
+            LOG4CXX_FATAL(logger(), "kmer '" << kmerstr.str() << "' length (" << kmer.size() << ") is not k (" << k << ")");
             abort();
         }
         for (unsigned int i=0; i<k; ++i) {
@@ -285,7 +286,7 @@ public:
     void print(const std::string prefix = "") const {
         std::cout << prefix << this << std::endl;
     };
-    friend std::ostream& operator<< (std::ostream &stream, kmerint& ki) {
+    friend std::ostream& operator<< (std::ostream &stream, const kmerint& ki) {
         stream << "{kmerhash: 0x" << std::hex << std::setfill('0') << std::setw(ki.k*ki.base_nbits/4);
         stream << ki.kmerhash << "; ";
         stream << "kmer: " << ki.hash_to_vector(ki.kmerhash) << "; ";
@@ -332,7 +333,7 @@ public:
             std::stringstream answerstr;
             answerstr << answer;
 
-            LOG4CXX_FATAL(ki.logger, "kmer " << kmerstr.str() << " != answer " << answerstr.str());
+            LOG4CXX_FATAL(logger(), "kmer " << kmerstr.str() << " != answer " << answerstr.str());
             abort();
         }
         assert(ki.get_kmerhash() == ki.kmerhash);
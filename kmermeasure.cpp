@@ -0,0 +1,216 @@
+/*!
+ * @brief kmer profile storage shared by all of the kmer-based measures
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kmermeasure.h"
+#include "intersect.h"
+
+#include <algorithm>
+
+std::map<kmeroptions, profilestore*> kmermeasure::stores;
+std::mutex kmermeasure::stores_mutex;
+std::map<kmeroptions, std::map<FastaRecord, kmermeasure::extra_t>> kmermeasure::extras;
+std::shared_mutex kmermeasure::extras_mutex;
+std::string kmermeasure::cachedir;
+unsigned int kmermeasure::nthreads = 1;
+bool kmermeasure::packprofiles = false;
+precision_t kmermeasure::precision = precision_exact;
+
+//! @brief the profile store for o, shared by every kmer measure using o
+profilestore*
+kmermeasure::getstore(const kmeroptions& o)
+{
+    std::lock_guard<std::mutex> lock(stores_mutex);
+    auto it = stores.find(o);
+    if (it == stores.end())
+        it = stores.emplace(o, new profilestore(o, packprofiles)).first;
+    return it->second;
+}
+
+/*! @brief calculate (or map from the cache) the profiles for seqs once,
+ * before any comparisons
+ *
+ * The first call fills the store, which finds its sequences by their
+ * place in seqs (see profilestore::find), so seqs must outlive it;
+ * sequences in later calls that are not already in it are kept with the
+ * extras.
+ */
+void
+kmermeasure::init(const fastavec_t& seqs)
+{
+    {
+        std::lock_guard<std::mutex> lock(stores_mutex);
+        if (!store->is_built()) {
+            store->init(seqs, cachedir, nthreads);
+            return;
+        }
+    }
+    for (auto s=seqs.begin(); s != seqs.end(); ++s)
+        get_profile(*s);
+}
+
+/*! @brief set up the profiles of seqs for several values of k at once,
+ * with one scan of each sequence for all of them
+ *
+ * Measures created afterwards for any of these k find their store ready.
+ */
+void
+kmermeasure::prepare(const std::vector<kmeroptions>& os, const fastavec_t& seqs)
+{
+    std::vector<profilestore*> todo;
+    for (auto o=os.begin(); o != os.end(); ++o) {
+        profilestore *st = getstore(*o);
+        if (std::find(todo.begin(), todo.end(), st) == todo.end())
+            todo.push_back(st);
+    }
+
+    std::lock_guard<std::mutex> lock(stores_mutex);
+    profilestore::init(todo, seqs, cachedir, nthreads);
+}
+
+/*! @brief keep the profile of fr until the matching forget()
+ *
+ * Several workers can have the same sequence (e.g., duplicate queries)
+ * at once; each holds it, and the profile goes when the last forgets it,
+ * not while another still has a view of it.
+ */
+void
+kmermeasure::hold(const FastaRecord& fr)
+{
+    kmerprofile p;
+    if (store->is_built() && store->find(fr, p))
+        return;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(extras_mutex);
+        auto& kept = extras[kopts];
+        auto it = kept.find(fr);
+        if (it != kept.end()) {
+            ++it->second.holds;
+            return;
+        }
+    }
+
+    ownedprofile* op = new ownedprofile;
+    store->calculate(fr.get_seq(), *op);
+
+    std::unique_lock<std::shared_mutex> lock(extras_mutex);
+    auto result = extras[kopts].emplace(fr, extra_t{op, 0});
+    if (!result.second)
+        delete op; // another worker kept it first
+    ++result.first->second.holds;
+}
+
+//! @brief drop the profile for a sequence that will not be compared again, once nobody holds it
+void
+kmermeasure::forget(const FastaRecord& fr)
+{
+    std::unique_lock<std::shared_mutex> lock(extras_mutex);
+    auto& kept = extras[kopts];
+    auto it = kept.find(fr);
+    if (it == kept.end())
+        return;
+    if (it->second.holds > 1) {
+        --it->second.holds;
+        return;
+    }
+    delete it->second.profile;
+    kept.erase(it);
+}
+
+// The overlap of two profiles, whatever kind of cursor reads each.
+template <class acc_t, class A, class B>
+static overlap_t<acc_t>
+overlapcursors(A& a, B& b)
+{
+    overlap_t<acc_t> o;
+    while (!a.done() && !b.done()) {
+        if (a.key() < b.key())
+            a.advance();
+        else if (b.key() < a.key())
+            b.advance();
+        else {
+            o.dot += (acc_t)a.count() * b.count();
+            ++o.shared;
+            a.advance();
+            b.advance();
+        }
+    }
+    return o;
+}
+
+template <class acc_t>
+static kmermeasure::mergestats_t
+mergeas(const kmerprofile& pa, const kmerprofile& pb)
+{
+    overlap_t<acc_t> o;
+    if (pa.packed == nullptr && pb.packed == nullptr)
+        o = overlap<acc_t>(pa, pb);
+    else if (pa.packed == nullptr) {
+        rawcursor a(pa);
+        profilecursor b(pb);
+        o = overlapcursors<acc_t>(a, b);
+    } else if (pb.packed == nullptr) {
+        profilecursor a(pa);
+        rawcursor b(pb);
+        o = overlapcursors<acc_t>(a, b);
+    } else {
+        profilecursor a(pa), b(pb);
+        o = overlapcursors<acc_t>(a, b);
+    }
+
+    kmermeasure::mergestats_t s;
+    s.dot = o.dot;
+    s.shared = o.shared;
+    return s;
+}
+
+/*! @brief the dot product of two profiles, accumulated as precision p
+ * says
+ * Only the shared kmers are visited, by the intersection kernel that
+ * suits the sizes of the profiles.  Packed profiles are unpacked a block
+ * at a time as the merge reaches them.
+ */
+kmermeasure::mergestats_t
+kmermeasure::merge(const kmerprofile& pa, const kmerprofile& pb, const precision_t p)
+{
+    switch (p) {
+    case precision_double:
+        return mergeas<double>(pa, pb);
+    case precision_float:
+        return mergeas<float>(pa, pb);
+    case precision_longdouble:
+        return mergeas<long double>(pa, pb);
+    default:
+        return mergeas<uint64_t>(pa, pb);
+    }
+}
+
+//! @brief the precision called name; false if there is none
+bool
+kmermeasure::parseprecision(const std::string& name, precision_t& p)
+{
+    const char *names[] = { "exact", "double", "float", "longdouble" };
+    for (unsigned int i=0; i<sizeof(names)/sizeof(names[0]); ++i) {
+        if (name.compare(names[i]) == 0) {
+            p = (precision_t)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,6 +1,6 @@
 /*!
  * @brief Interface for dissimilarity (distance) between sequences using kmers as a fundamental part of the measure
- * This class provides kmer set storage for sequences.
+ * This class provides kmer profile storage for sequences.
  *
  * Copyright (C) 2018  Kenneth Ingham
  *
@@ -22,42 +22,176 @@
 #define KMERMEASURE_H
 
 #include <string>
+#include <vector>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 
 #include "measure.h"
-#include "kmerset.h"
+#include "profilestore.h"
 #include "FastaRecord.h"
 
+/*! @brief how kmer measures do their arithmetic
+ *
+ * exact: dot products accumulated in 64-bit integers (exact for counts),
+ *   the rest in double; the default.
+ * double, float: accumulated and finished in that type.
+ * longdouble: accumulated and finished in long double; the reference the
+ *   others are checked against.
+ */
+enum precision_t {
+    precision_exact,
+    precision_double,
+    precision_float,
+    precision_longdouble
+};
+
 class kmermeasure : public measure
 {
 protected:
-    static std::map<FastaRecord, kmerset*> kmers;
-    unsigned int k;
+    //! profile stores, one per value of k (and kmer options) since several
+    //! measures can be alive at once
+    static std::map<kmeroptions, profilestore*> stores;
+    static std::mutex stores_mutex;
+    //! a profile of a sequence that is not in a store (e.g., a server
+    //! query), and how many hold() calls it has not yet had a forget() for
+    struct extra_t {
+        ownedprofile* profile;
+        unsigned int holds;
+    };
+    static std::map<kmeroptions, std::map<FastaRecord, extra_t>> extras;
+    //! workers share the extras; lookups take a shared lock, additions an exclusive one
+    static std::shared_mutex extras_mutex;
+    //! where profile stores are cached between runs; empty for no cache
+    static std::string cachedir;
+    //! threads used to build the profile stores
+    static unsigned int nthreads;
+    //! whether new stores keep their profiles in packed blocks
+    static bool packprofiles;
+    static precision_t precision;
 
-    kmerset* get_counts(const FastaRecord& fr) {
-        kmerset* ks;
-        // if fr is new, calculate the kmerset and cache it.
-        if (kmers.count(fr) == 0) {
-            ks = new kmerset(k);
-            ks->calculate(fr);
-            kmers.emplace(fr, ks);
-        } else
-            ks = kmers.at(fr);
+    kmeroptions kopts;
+    profilestore* store;
 
-        return ks;
-    };
+    static profilestore* getstore(const kmeroptions& o);
 
 public:
+    /*! @brief what one merge of two profiles yields, for every kmer measure
+     * With the squared norms of the profiles this is all any of them
+     * needs; e.g., |a - b|^2 = |a|^2 + |b|^2 - 2 a.b.
+     */
+    struct mergestats_t {
+        long double dot;    //!< sum of products of counts (exact, but for
+                            //!< float and double precision)
+        uint64_t shared;    //!< number of kmers in both profiles
+    };
+
+    /*! @brief the kmer profile of fr
+     * The store is read-only once init() has been called, so it needs no lock.
+     */
+    kmerprofile get_profile(const FastaRecord& fr) {
+        kmerprofile p;
+        if (store->is_built() && store->find(fr, p))
+            return p;
+
+        {
+            std::shared_lock<std::shared_mutex> lock(extras_mutex);
+            auto ke = extras.find(kopts);
+            if (ke != extras.end()) {
+                auto it = ke->second.find(fr);
+                if (it != ke->second.end())
+                    return it->second.profile->view();
+            }
+        }
+
+        // fr is new; calculate the profile outside the lock and keep it.
+        ownedprofile* op = new ownedprofile;
+        store->calculate(fr.get_seq(), *op);
+
+        std::unique_lock<std::shared_mutex> lock(extras_mutex);
+        auto result = extras[kopts].emplace(fr, extra_t{op, 0});
+        if (!result.second)
+            delete op; // another worker kept it first
+        return result.first->second.profile->view();
+    };
+    static mergestats_t merge(const kmerprofile& pa, const kmerprofile& pb,
+                              const precision_t p = precision);
+    //! @brief the distance given the profiles and their merge in precision p
+    virtual long double fromstats(const kmerprofile& pa, const kmerprofile& pb,
+                                  const mergestats_t& s, const precision_t p) = 0;
+    /*! @brief out[j] = the distance between pa and pbs[j], given their
+     * merges ss[j], for a row of n comparisons.  Measures with a costly
+     * last step can do it for the whole row at once.
+     */
+    virtual void fromstatsrow(const kmerprofile& pa, const kmerprofile *pbs,
+                              const mergestats_t *ss, const size_t n, long double *out) {
+        for (size_t j=0; j<n; ++j)
+            out[j] = fromstats(pa, pbs[j], ss[j], precision);
+    };
+    long double compare(const FastaRecord& a, const FastaRecord& b) {
+        kmerprofile pa = get_profile(a);
+        kmerprofile pb = get_profile(b);
+        return fromstats(pa, pb, merge(pa, pb, precision), precision);
+    };
+    //! measures with the same store can share one merge per pair
+    profilestore* get_store() const {
+        return store;
+    };
+
     kmermeasure(const unsigned int k_p) {
-        /*! @todo need validation of k? */ k = k_p;
+        /*! @todo need validation of k? */ kopts = kmeroptions(k_p);
+        store = getstore(kopts);
     };
+    //! @brief kstr is k with optional flags, e.g. "7" or "7,canonical"
     kmermeasure(const std::string kstr) {
-        k = std::stoi(kstr);
+        kopts = kmeroptions::parse(kstr);
+        store = getstore(kopts);
     }
     ~kmermeasure() {};
-//     virtual void init(const fastavec_t& seqs) {};
+    void init(const fastavec_t& seqs);
+    void hold(const FastaRecord& fr);
+    void forget(const FastaRecord& fr);
+    static void prepare(const std::vector<kmeroptions>& os, const fastavec_t& seqs);
+    //! subclasses start from these, which name the store
+    measurecaps_t capabilities() const {
+        measurecaps_t caps;
+        caps.profileopts = kopts.str();
+        return caps;
+    };
+    static void set_cachedir(const std::string& dir) {
+        cachedir = dir;
+    };
+    static void set_nthreads(const unsigned int n) {
+        nthreads = n;
+    };
+    static void set_packprofiles(const bool p) {
+        packprofiles = p;
+    };
+    static void set_precision(const precision_t p) {
+        precision = p;
+    };
+    static precision_t get_precision() {
+        return precision;
+    };
+    //! @brief the machine epsilon of the type precision p finishes in
+    static long double epsilon(const precision_t p) {
+        switch (p) {
+        case precision_float:
+            return std::numeric_limits<float>::epsilon();
+        case precision_longdouble:
+            return std::numeric_limits<long double>::epsilon();
+        default:
+            return std::numeric_limits<double>::epsilon();
+        }
+    };
+    static bool parseprecision(const std::string& name, precision_t& p);
     void printdetails() {
-        std::cout << "kmer measure, k = " << k << std::endl;
+        std::cout << "kmer measure, k = " << kopts.k << std::endl;
+        for (auto seed=kopts.seeds.begin(); seed != kopts.seeds.end(); ++seed)
+            std::cout << "  Spaced seed " << *seed << std::endl;
+        if (kopts.canonical)
+            std::cout << "  Canonical kmers (a kmer and its reverse complement are the same)." << std::endl;
     };
     void test() {}; //!< @todo implement this
 };
@@ -27,13 +27,13 @@ kmerset::calculate(const FastaRecord& seq)
 void
 kmerset::calculate(const std::string seq)
 {
-    for (unsigned int i=0; i<seq.length()-k; ++i) {
-        std::string kmer_s = seq.substr(i, k);
-        kmer_t km(k, kmer_s);
-        if (kmers.count(km) > 0)
+    // Roll each base into the kmer; once k bases are in, every position
+    // ends a kmer.
+    kmer_t km(k);
+    for (unsigned int i=0; i<seq.length(); ++i) {
+        km += base_t(1, seq[i]);
+        if (i+1 >= k)
             kmers[km]++;
-        else
-            kmers.emplace(km, 1);
     }
 }
 
@@ -22,7 +22,6 @@
 
 #include "FastaRecord.h"
 #include "kmer.h"
-#include "kmerstring.h"
 #include "kmerint.h"
 
 // Underlying structure is chosen at compile time.  Pick exactly one.
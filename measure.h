@@ -3,29 +3,121 @@
 #ifndef MEASURE_H
 #define MEASURE_H
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "FastaRecord.h"
 
+/*! @brief what a measure can do, so that callers can choose faster ways
+ * of using it without knowing which measure it is
+ */
+struct measurecaps_t {
+    bool symmetric = true;      //!< d(a,b) == d(b,a)
+    bool metric = false;        //!< also obeys the triangle inequality, so it can prune searches
+    bool rowbatch = false;      //!< finishes a whole row of distances at once faster than one at a time
+    unsigned int tilesize = 0;  //!< preferred number of distances per batch; 0 for no preference
+    long double roundoff = 0;   //!< most that rounding can move one distance, for pruning a metric
+    //! the kmer options of the profiles compared, e.g. "8" for the edges of
+    //! debruijn::7, so that stores can be built together; empty for none
+    std::string profileopts;
+};
+
+class measure;
+//! makes a measure from its measureopt; may throw std::exception for a bad option
+typedef measure* (*measuremaker_t)(const std::string& measureopt);
+
 /*! @class measure
  * @brief Interface for all measure functions
  *
+ * Measures register themselves (see measureregistrar) under a name and,
+ * for families such as kmer, a submeasure; create() makes them by name.
  * known subclasses: editmeasure, cosinemeasure, euclideanmeasure
  */
 
 class measure {
+    //! "name" or "name:submeasure" -> maker
+    static std::map<std::string, measuremaker_t>& registry()
+    {
+        static std::map<std::string, measuremaker_t> makers;
+        return makers;
+    };
+
 protected:
     //! print debugging statements
     bool verbose = false;
 public:
+    virtual ~measure() {};
     //! @brief optional measure initialization
     virtual void init(const fastavec_t& seqs) {};
+    //! @brief optionally keep anything cached for a sequence until a matching forget()
+    virtual void hold(const FastaRecord& fr) {};
+    //! @brief optionally release anything cached for a sequence that will not be compared again
+    virtual void forget(const FastaRecord& fr) {};
     //! @brief print the details about the measure function, any parameters, etc
     virtual void printdetails(void) = 0;
+    //! @brief what this measure can do; by default only that it is symmetric
+    virtual measurecaps_t capabilities() const
+    {
+        return measurecaps_t();
+    };
+
+    static void registermeasure(const std::string& name, const std::string& subname,
+                                measuremaker_t maker)
+    {
+        registry()[subname.length() > 0 ? name + ":" + subname : name] = maker;
+    };
+    //! @brief a new measure, not yet initialized; nullptr if there is no such measure
+    static measure* create(const std::string& name, const std::string& subname,
+                           const std::string& measureopt)
+    {
+        auto it = registry().find(subname.length() > 0 ? name + ":" + subname : name);
+        if (it == registry().end())
+            return nullptr;
+        return it->second(measureopt);
+    };
+    //! @brief the registered measures, e.g. "edit, kmer:cosine, kmer:euclidean"
+    static std::string knownmeasures()
+    {
+        std::string known;
+        for (auto it=registry().begin(); it != registry().end(); ++it)
+            known += (known.length() > 0 ? ", " : "") + it->first;
+        return known;
+    };
     static std::string validatemeasure(std::string name)
     {
-        if (name.compare("edit") == 0) return "";
-        if (name.compare("kmer") == 0) return "";
+        for (auto it=registry().begin(); it != registry().end(); ++it)
+            if (it->first.compare(0, it->first.find(':'), name) == 0)
+                return "";
         return std::string("Unknown measure '") + name + std::string("'.\n") +
-               std::string("Known measures are: edit, kmer.");
+               std::string("Known measures are: ") + knownmeasures() + ".";
+    };
+    /*! @brief split a measure spec, measure[:submeasure[:measureopt]],
+     * e.g. "kmer:cosine:7" or "edit"; missing parts are empty
+     */
+    static void parsespec(const std::string& spec, std::string& name,
+                          std::string& subname, std::string& measureopt)
+    {
+        std::string::size_type c1 = spec.find(':');
+        std::string::size_type c2 = c1 == std::string::npos ? c1 : spec.find(':', c1+1);
+        name = spec.substr(0, c1);
+        subname = c1 == std::string::npos ? "" : spec.substr(c1+1, c2 == std::string::npos ? c2 : c2-c1-1);
+        measureopt = c2 == std::string::npos ? "" : spec.substr(c2+1);
+    };
+    //! @brief the specs in a list such as kmer:cosine:7+kmer:euclidean:7+edit
+    static std::vector<std::string> splitspecs(const std::string& specs)
+    {
+        std::vector<std::string> result;
+        std::string::size_type start = 0;
+        while (start < specs.length()) {
+            std::string::size_type end = specs.find('+', start);
+            if (end == std::string::npos)
+                end = specs.length();
+            if (end > start)
+                result.push_back(specs.substr(start, end - start));
+            start = end + 1;
+        }
+        return result;
     };
 
     /*
@@ -42,4 +134,14 @@ public:
     virtual void test(void) = 0;
 };
 
+/*! @brief registers a measure when its file's statics are initialized,
+ * e.g. static measureregistrar reg("kmer", "cosine", maker);
+ */
+struct measureregistrar {
+    measureregistrar(const std::string& name, const std::string& subname, measuremaker_t maker)
+    {
+        measure::registermeasure(name, subname, maker);
+    };
+};
+
 #endif // MEASURE_H
@@ -0,0 +1,225 @@
+/*!
+ * @brief Several measures evaluated together, one pair of sequences at a time
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "measuresweep.h"
+
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+measuresweep::~measuresweep()
+{
+    for (auto m=measures.begin(); m != measures.end(); ++m)
+        delete *m;
+}
+
+void
+measuresweep::add(measure *m, const std::string& label)
+{
+    unsigned int i = measures.size();
+    measures.push_back(m);
+    labels.push_back(label);
+    caps.push_back(m->capabilities());
+    maxdeviation.push_back(0);
+
+    kmermeasure *km = dynamic_cast<kmermeasure*>(m);
+    if (km == nullptr) {
+        others.push_back(i);
+        return;
+    }
+    for (auto g=kmergroups.begin(); g != kmergroups.end(); ++g) {
+        if (g->lead->get_store() == km->get_store()) {
+            g->members.push_back(i);
+            return;
+        }
+    }
+    kmergroups.push_back(kmergroup_t{km, std::vector<unsigned int>(1, i)});
+}
+
+/*! @brief results[i][j] = measure i's distance between a and bs[j], for
+ * j < n
+ *
+ * A row at a time lets the kmer measures finish their distances for the
+ * whole row together.  With verify, each kmer distance is also
+ * calculated in long double and the largest difference is kept.
+ */
+void
+measuresweep::comparerow(const FastaRecord& a, const FastaRecord *bs, const size_t n,
+                         std::vector<std::vector<long double>>& results)
+{
+    results.resize(measures.size());
+    for (auto r=results.begin(); r != results.end(); ++r)
+        r->resize(n);
+
+    std::vector<kmerprofile> pbs(n);
+    std::vector<kmermeasure::mergestats_t> ss(n);
+    for (auto g=kmergroups.begin(); g != kmergroups.end(); ++g) {
+        kmerprofile pa = g->lead->get_profile(a);
+        for (size_t j=0; j<n; ++j) {
+            pbs[j] = g->lead->get_profile(bs[j]);
+            ss[j] = kmermeasure::merge(pa, pbs[j]);
+        }
+        for (auto i=g->members.begin(); i != g->members.end(); ++i) {
+            kmermeasure *km = static_cast<kmermeasure*>(measures[*i]);
+            if (caps[*i].rowbatch)
+                km->fromstatsrow(pa, pbs.data(), ss.data(), n, results[*i].data());
+            else
+                for (size_t j=0; j<n; ++j)
+                    results[*i][j] = km->fromstats(pa, pbs[j], ss[j], kmermeasure::get_precision());
+        }
+        if (!verify)
+            continue;
+
+        for (auto i=g->members.begin(); i != g->members.end(); ++i) {
+            kmermeasure *km = static_cast<kmermeasure*>(measures[*i]);
+            long double worst = 0;
+            for (size_t j=0; j<n; ++j) {
+                kmermeasure::mergestats_t ref = kmermeasure::merge(pa, pbs[j], precision_longdouble);
+                long double d = fabsl(results[*i][j] - km->fromstats(pa, pbs[j], ref,
+                                                                     precision_longdouble));
+                worst = std::max(worst, d);
+            }
+            std::lock_guard<std::mutex> lock(deviation_mutex);
+            maxdeviation[*i] = std::max(maxdeviation[*i], worst);
+        }
+    }
+    for (auto i=others.begin(); i != others.end(); ++i)
+        for (size_t j=0; j<n; ++j)
+            results[*i][j] = measures[*i]->compare(a, bs[j]);
+}
+
+void
+measuresweep::hold(const FastaRecord& fr)
+{
+    for (auto m=measures.begin(); m != measures.end(); ++m)
+        (*m)->hold(fr);
+}
+
+void
+measuresweep::forget(const FastaRecord& fr)
+{
+    for (auto m=measures.begin(); m != measures.end(); ++m)
+        (*m)->forget(fr);
+}
+
+void
+measuresweep::printdetails()
+{
+    for (unsigned int i=0; i<measures.size(); ++i) {
+        measures[i]->printdetails();
+        if (verify && dynamic_cast<kmermeasure*>(measures[i]) != nullptr)
+            std::cout << "  Largest difference from long double arithmetic: "
+                      << maxdeviation[i] << std::endl;
+    }
+}
+
+//! @brief a file name suffix for a spec, e.g. kmer-cosine-7 for kmer:cosine:7
+std::string
+measuresweep::speclabel(const std::string& spec)
+{
+    std::string name, subname, measureopt;
+    measure::parsespec(spec, name, subname, measureopt);
+    std::string label = name;
+    if (subname.length() > 0)
+        label += "-" + subname;
+    if (measureopt.length() > 0) {
+        // measureopt may be a path
+        std::string opt = measureopt.substr(measureopt.find_last_of('/') + 1);
+        for (auto c=opt.begin(); c != opt.end(); ++c)
+            if (!isalnum(*c) && *c != '.' && *c != '_')
+                *c = '_';
+        label += "-" + opt;
+    }
+    return label;
+}
+
+/*! @brief the capabilities of the measure a spec names, without
+ * initializing it; false if the spec makes no measure
+ */
+static bool
+capabilitiesof(const std::string& name, const std::string& subname, const std::string& measureopt,
+               measurecaps_t& caps)
+{
+    measure *m = nullptr;
+    try {
+        m = measure::create(name, subname, measureopt);
+    } catch (std::exception& e) {
+        return false;
+    }
+    if (m == nullptr)
+        return false;
+    caps = m->capabilities();
+    delete m;
+    return true;
+}
+
+/*! @brief specs with kmer ranges written out: kmer:cosine:5-7 is
+ * kmer:cosine:5, kmer:cosine:6 and kmer:cosine:7 (any kmer flags after
+ * the range go with each), and likewise for any measure of kmer profiles
+ * (debruijn::5-7, say)
+ */
+std::vector<std::string>
+measuresweep::expandspecs(const std::vector<std::string>& specs)
+{
+    std::vector<std::string> result;
+    for (auto spec=specs.begin(); spec != specs.end(); ++spec) {
+        std::string name, subname, measureopt;
+        measure::parsespec(*spec, name, subname, measureopt);
+        std::string range = measureopt.substr(0, measureopt.find(','));
+        std::string flags = measureopt.substr(range.length());
+        std::string::size_type dash = range.find('-');
+        measurecaps_t caps;
+        if (dash == std::string::npos || dash == 0 || dash + 1 == range.length() ||
+            range.find_first_not_of("0123456789-") != std::string::npos ||
+            range.find('-', dash+1) != std::string::npos ||
+            !capabilitiesof(name, subname, range.substr(0, dash) + flags, caps) ||
+            caps.profileopts.empty()) {
+            result.push_back(*spec);
+            continue;
+        }
+        unsigned int kfirst = std::stoi(range.substr(0, dash));
+        unsigned int klast = std::stoi(range.substr(dash+1));
+        for (unsigned int k=kfirst; k<=klast; ++k)
+            result.push_back(name + ":" + subname + ":" + std::to_string(k) + flags);
+    }
+    return result;
+}
+
+/*! @brief anything the measures in specs can set up for seqs together
+ * rather than one measure at a time: the kmer profiles that each measure
+ * says it compares (measurecaps_t::profileopts), e.g. the (k+1)-mer
+ * profiles that are the edges of the de Bruijn graphs.  Bad specs are
+ * left for creating the measure to report.
+ */
+void
+measuresweep::prepare(const std::vector<std::string>& specs, const fastavec_t& seqs)
+{
+    std::vector<kmeroptions> os;
+    for (auto spec=specs.begin(); spec != specs.end(); ++spec) {
+        std::string name, subname, measureopt;
+        measure::parsespec(*spec, name, subname, measureopt);
+        measurecaps_t caps;
+        if (!capabilitiesof(name, subname, measureopt, caps))
+            return;
+        if (!caps.profileopts.empty())
+            os.push_back(kmeroptions::parse(caps.profileopts));
+    }
+    if (os.size() > 1)
+        kmermeasure::prepare(os, seqs);
+}
@@ -0,0 +1,98 @@
+/*!
+ * @brief Several measures evaluated together, one pair of sequences at a time
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEASURESWEEP_H
+#define MEASURESWEEP_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "FastaRecord.h"
+#include "measure.h"
+#include "kmermeasure.h"
+
+/*! @class measuresweep
+ * @brief compare each pair of sequences with every measure in the sweep
+ *
+ * Kmer measures that use the same profile store (e.g., cosine and
+ * Euclidean with the same k) share one merge of the two profiles per pair;
+ * every other measure does its own compare.
+ */
+class measuresweep {
+    std::vector<measure*> measures;
+    std::vector<std::string> labels;
+    std::vector<measurecaps_t> caps;
+
+    //! kmer measures sharing a profile store, by index into measures
+    struct kmergroup_t {
+        kmermeasure *lead;
+        std::vector<unsigned int> members;
+    };
+    std::vector<kmergroup_t> kmergroups;
+    std::vector<unsigned int> others;
+
+    //! check the kmer measures against long double arithmetic
+    bool verify = false;
+    //! largest difference from long double seen, by measure
+    std::vector<long double> maxdeviation;
+    std::mutex deviation_mutex;
+
+public:
+    measuresweep() {};
+    ~measuresweep();
+
+    void add(measure *m, const std::string& label);
+    void comparerow(const FastaRecord& a, const FastaRecord *bs, const size_t n,
+                    std::vector<std::vector<long double>>& results);
+    void hold(const FastaRecord& fr);
+    void forget(const FastaRecord& fr);
+    void printdetails();
+
+    void set_verify(const bool v) {
+        verify = v;
+    };
+    //! whether every measure is symmetric, so that half a matrix will do
+    bool symmetric() const {
+        for (auto c=caps.begin(); c != caps.end(); ++c)
+            if (!c->symmetric)
+                return false;
+        return true;
+    };
+    //! the smallest tile any measure prefers; 0 for whole rows
+    unsigned int tilesize() const {
+        unsigned int size = 0;
+        for (auto c=caps.begin(); c != caps.end(); ++c)
+            if (c->tilesize > 0 && (size == 0 || c->tilesize < size))
+                size = c->tilesize;
+        return size;
+    };
+    unsigned int size() const {
+        return measures.size();
+    };
+    const std::string& get_label(const unsigned int i) const {
+        return labels[i];
+    };
+
+    static std::string speclabel(const std::string& spec);
+    static std::vector<std::string> expandspecs(const std::vector<std::string>& specs);
+    static void prepare(const std::vector<std::string>& specs, const fastavec_t& seqs);
+};
+
+#endif // MEASURESWEEP_H
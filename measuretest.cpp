@@ -1,88 +1,241 @@
 // Metric function comparison program
 
 #include <iostream>
+#include <chrono>
 #include <thread>
 #include <vector>
 #include <string>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <err.h>
 #include <exception>
+#include <fstream>
+#include <algorithm>
 
 #include "FastaRecord.h"
 #include "measure.h"
-#include "editmeasure.h"
 #include "kmermeasure.h"
-#include "cosinemeasure.h"
-#include "euclideanmeasure.h"
 #include "Options.h"
 #include "distancematrix.h"
+#include "crossmatrix.h"
 #include "utils.h"
 #include "checkpoint.h"
+#include "queryserver.h"
+#include "measuresweep.h"
+#include "trace.h"
+#include "progress.h"
 
 //#define SINGLETHREAD // single threaded for performance analysis
 
+// Returns nullptr if the measure (or submeasure) is unknown.
 measure *
-createmeasure(const Options opts, const fastavec_t& seqs)
-//createmeasure(const std::string& name, const std::string& subname, const std::string& opts, const fastavec_t& seqs)
+createmeasure(const std::string& name, const std::string& subname,
+              const std::string& measureopt, const fastavec_t& seqs)
 {
-    if (opts.get("measure").compare("edit") == 0) {
-        return new editmeasure(opts.get("measureopt"));
-    }
-    if (opts.get("measure").compare("kmer") == 0) {
-        measure *m = nullptr;
-        if (opts.get("submeasure").length() > 0) {
-            if (opts.get("submeasure").compare("cosine") == 0)
-                m = new cosinemeasure(opts.get("measureopt"));
-            else if (opts.get("submeasure").compare("cosine") == 0)
-                m = new cosinemeasure(opts.get("measureopt"));
-        }
-// commented out because kmermeasure is a partially abstract class that needs to be subclassed to be used.
-//         } else
-//             m = new kmermeasure(opts.get("measureopt"));
-        if (m != nullptr) {
-            m->init(seqs);
-            return m;
-        }
+    measure *m = measure::create(name, subname, measureopt);
+    if (m != nullptr)
+        m->init(seqs);
+    return m;
+}
+
+measure *
+createmeasure(const std::string& spec, const fastavec_t& seqs)
+{
+    std::string name, subname, measureopt;
+    measure::parsespec(spec, name, subname, measureopt);
+    measure *m = nullptr;
+    try {
+        m = createmeasure(name, subname, measureopt, seqs);
+    } catch (std::exception& e) {
+        errx(1, "measure '%s': %s", spec.c_str(), e.what());
     }
+    if (m != nullptr)
+        return m;
 
     // If still here, then the measure is unknown
-    std::cerr << "Unknown measure '" << opts.get("measurename") << "'" << std::endl;
-    std::cerr << "known measures are: " << "edit, kmer" << std::endl;
+    std::cerr << "Unknown measure '" << spec << "'" << std::endl;
+    std::cerr << "known measures are: " << measure::knownmeasures() << std::endl;
     exit(1);
 }
 
+// The ids file next to a distance matrix records which sequences it holds,
+// so that a later run can extend it with sequences appended to the input.
+void
+writeids(const std::string distmatfname, const fastavec_t& sequences)
+{
+    std::string fname = distmatfname + ".ids";
+    std::ofstream idf;
+    idf.open(fname);
+    if (idf.fail())
+        err(1, "opening '%s' for writing failed", fname.c_str());
+    idf << "nsequences" << std::endl << sequences.size() << std::endl;
+    idf << "idhash" << std::endl << std::hex << hashids(sequences, sequences.size()) << std::endl;
+    idf.close();
+}
+
+// Verify that the first rows of the matrix being extended were calculated
+// from the same sequences that lead the current input.  Returns the number
+// of sequences already in that matrix.
+unsigned int
+checkids(const std::string oldfname, const fastavec_t& sequences)
+{
+    std::string fname = oldfname + ".ids";
+    std::ifstream idf;
+    idf.open(fname);
+    if (idf.fail())
+        err(1, "opening '%s' for reading failed", fname.c_str());
+    unsigned int nold = std::stoul(restoreoption("nsequences", idf));
+    uint64_t idhash = std::stoull(restoreoption("idhash", idf), nullptr, 16);
+    idf.close();
+
+    if (nold > sequences.size())
+        errx(1, "'%s' has %u sequences, more than the %lu in the input",
+             oldfname.c_str(), nold, sequences.size());
+    if (hashids(sequences, nold) != idhash)
+        errx(1, "The first %u sequence ids do not match those used for '%s'",
+             nold, oldfname.c_str());
+    return nold;
+}
+
+// firstnew is the first row that is not in a matrix being extended (0 if
+// not extending); rows before it only need the new columns.  Every measure
+// in the sweep is calculated for a pair before moving on, while the pair's
+// data is at hand; distances[k] is measure k's matrix.  Each tile is
+// counted in prog.
 void
-worker(measure *m, distancematrix *distance, const fastavec_t &sequences,
-       unsigned int nthreads, unsigned int workernum, std::string checkpointdir,
-       bool restart)
+worker(measuresweep *sweep, std::vector<distancematrix*> *distances,
+       const fastavec_t &sequences, unsigned int nthreads, unsigned int workernum,
+       std::string checkpointdir, bool restart, unsigned int firstnew, progress *prog)
 {
     unsigned int startrow;
+    std::vector<std::vector<long double>> results;
 
     if (restart) {
         startrow = workerrestore(workernum, checkpointdir) + nthreads;
+        for (unsigned int i=workernum; i<startrow && i<sequences.size(); i = i + nthreads)
+            prog->skipped(workernum, sequences.size() - std::max(i, firstnew));
     } else {
         startrow = workernum;
     }
 
     // each worker does rows where row % nthreads == workernum
     // no barrier needed because each worker writes to different locations.
+    // rows are done a tile at a time if any measure wants that
+    unsigned int tile = sweep->tilesize();
+    if (tile == 0)
+        tile = sequences.size();
+
     for (unsigned int i=startrow; i<sequences.size(); i = i + nthreads) {
-        for (unsigned int j=i; j<sequences.size(); ++j) {
-            distance->set(i, j, m->compare(sequences[i], sequences[j]));
+        for (unsigned int first=std::max(i, firstnew); first<sequences.size(); first += tile) {
+            unsigned int n = std::min(tile, (unsigned int)sequences.size() - first);
+            auto start = std::chrono::steady_clock::now();
+            sweep->comparerow(sequences[i], sequences.data() + first, n, results);
+            for (unsigned int k=0; k<results.size(); ++k)
+                for (unsigned int j=0; j<n; ++j)
+                    (*distances)[k]->set(i, first + j, results[k][j]);
+            prog->tiledone(workernum, n, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start).count());
+            TRACE_DEBUG("worker.tile", i, first);
         }
+        TRACE_INFO("worker.row", i, workernum);
         workercheckpoint(i, workernum, checkpointdir);
     }
 }
 
+// Rectangular version of worker: each query (row) is compared with every
+// reference (column).  The references were initialized once in the
+// measures; anything cached for a query is held for its row and dropped
+// when no other worker's row (a duplicate query) still needs it.
+void
+crossworker(measuresweep *sweep, std::vector<crossmatrix*> *distances,
+            const fastavec_t &queries, const fastavec_t &references,
+            unsigned int nthreads, unsigned int workernum,
+            std::string checkpointdir, bool restart, progress *prog)
+{
+    unsigned int startrow;
+    std::vector<std::vector<long double>> results;
+
+    if (restart) {
+        startrow = workerrestore(workernum, checkpointdir) + nthreads;
+        for (unsigned int i=workernum; i<startrow && i<queries.size(); i = i + nthreads)
+            prog->skipped(workernum, references.size());
+    } else {
+        startrow = workernum;
+    }
+
+    unsigned int tile = sweep->tilesize();
+    if (tile == 0)
+        tile = references.size();
+
+    for (unsigned int i=startrow; i<queries.size(); i = i + nthreads) {
+        sweep->hold(queries[i]);
+        for (unsigned int first=0; first<references.size(); first += tile) {
+            unsigned int n = std::min(tile, (unsigned int)references.size() - first);
+            auto start = std::chrono::steady_clock::now();
+            sweep->comparerow(queries[i], references.data() + first, n, results);
+            for (unsigned int k=0; k<results.size(); ++k)
+                for (unsigned int j=0; j<n; ++j)
+                    (*distances)[k]->set(i, first + j, results[k][j]);
+            prog->tiledone(workernum, n, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start).count());
+            TRACE_DEBUG("crossworker.tile", i, first);
+        }
+        TRACE_INFO("crossworker.row", i, workernum);
+        sweep->forget(queries[i]);
+        workercheckpoint(i, workernum, checkpointdir);
+    }
+}
+
+void
+reportusage(const struct rusage& startusage, const unsigned int nthreads)
+{
+    struct rusage endusage;
+
+    if (getrusage(RUSAGE_SELF, &endusage) < 0)
+        err(1, "getrusage end failed");
+
+    long usec = endusage.ru_utime.tv_sec - startusage.ru_utime.tv_sec;
+    long uusec = endusage.ru_utime.tv_usec - startusage.ru_utime.tv_usec;
+    long ssec = endusage.ru_stime.tv_sec - startusage.ru_stime.tv_sec;
+    long susec = endusage.ru_stime.tv_usec - startusage.ru_stime.tv_usec;
+    std::cerr << "nthreads: " << nthreads << std::endl;
+    std::cerr << (double) usec + uusec / 1000000.0 << " + "
+              << (double) ssec + susec / 1000000.0 << " u+s secs" << std::endl;
+    std::cerr << endusage.ru_maxrss - startusage.ru_maxrss << " Kib" << std::endl;
+}
+
 int
 main (int argc, char **argv)
 {
-    struct rusage startusage, endusage;
+    struct rusage startusage;
     unsigned int nthreads;
 
+#if TRACE_LEVEL > 0
+    // before any thread starts, so that they all leave the signal to this
+    trace::dumponsignal(SIGUSR1, "measuretest.trace." + std::to_string(getpid()));
+#endif
+
     Options opts(argc, argv);
     bool restart = opts.get("restart").compare("true") == 0;
+    kmermeasure::set_cachedir(opts.get("profilecache"));
+    kmermeasure::set_nthreads(opts.get_ncores());
+    kmermeasure::set_packprofiles(opts.get("packprofiles").compare("true") == 0);
+    precision_t precision;
+    kmermeasure::parseprecision(opts.get("precision"), precision);
+    kmermeasure::set_precision(precision);
+
+    // A server has no matrix and nothing to checkpoint; stdout may be the
+    // reply channel, so everything it says goes to stderr.
+    if (opts.get("serve").length() > 0) {
+        fastavec_t references = readfastafile(opts.get("fasta"));
+        queryserver server(references, createmeasure, opts.get_ncores());
+        if (opts.get("serve").compare("stdio") == 0)
+            server.serve(0, 1);
+        else
+            server.servesocket(opts.get("serve"));
+        return 0;
+    }
 
     if (!restart) {
         opts.cleancheckpointdir();
@@ -97,8 +250,49 @@ main (int argc, char **argv)
     //!@todo Would it add anything to checkpoint the fasta data structure?
     fastavec_t sequences = readfastafile(opts.get("fasta"));
 
+    // In cross mode, the fasta2 sequences are the references that every
+    // sequence in fasta is compared with; only they are set up in advance.
+    bool cross = opts.get("fasta2").length() > 0;
+    fastavec_t references;
+    if (cross)
+        references = readfastafile(opts.get("fasta2"));
+
+    // Either the one measure from --measure/--submeasure/--measureopt,
+    // writing distmatfname, or every measure in --measures, each writing
+    // distmatfname.<label> (and extending extendmatrix.<label>).
+    std::vector<std::string> specs, distmatfnames, oldfnames;
+    if (opts.get("measures").length() > 0) {
+        specs = measuresweep::expandspecs(measure::splitspecs(opts.get("measures")));
+        for (auto spec=specs.begin(); spec != specs.end(); ++spec) {
+            std::string label = measuresweep::speclabel(*spec);
+            if (std::find(distmatfnames.begin(), distmatfnames.end(),
+                          opts.get("distmatfname") + "." + label) != distmatfnames.end())
+                errx(1, "measure '%s' is in --measures more than once", spec->c_str());
+            distmatfnames.push_back(opts.get("distmatfname") + "." + label);
+            oldfnames.push_back(opts.get("extendmatrix").length() > 0 ?
+                                opts.get("extendmatrix") + "." + label : "");
+        }
+    } else {
+        specs.push_back(opts.get("measure") + ":" + opts.get("submeasure") + ":" +
+                        opts.get("measureopt"));
+        distmatfnames.push_back(opts.get("distmatfname"));
+        oldfnames.push_back(opts.get("extendmatrix"));
+    }
+
     //!@todo Would it add anything to checkpoint the metric data structure?
-    measure *m = createmeasure(opts, sequences);
+    try {
+        measuresweep::prepare(specs, cross ? references : sequences);
+    } catch (std::exception& e) {
+        errx(1, "%s", e.what());
+    }
+    measuresweep sweep;
+    sweep.set_verify(opts.get("verifyprecision").compare("true") == 0);
+    for (unsigned int k=0; k<specs.size(); ++k)
+        sweep.add(createmeasure(specs[k], cross ? references : sequences),
+                  measuresweep::speclabel(specs[k]));
+    // a distancematrix keeps only one triangle
+    if (!cross && !sweep.symmetric())
+        errx(1, "an asymmetric measure needs --fasta2; a square matrix keeps only d(i,j) for i<j");
 
     //!@todo assumption: if we are restarting, the checkpoint fasta, metric,
     // are correct for the matrix
@@ -106,42 +300,98 @@ main (int argc, char **argv)
     if (getrusage(RUSAGE_SELF, &startusage) < 0)
         err(1, "getrusage start failed");
 
-    distancematrix distance;
-    if (opts.get("restart").compare("true") == 0)
-        distance.init(opts.get("distmatfname"));
-    else
-        distance.init(sequences.size(), opts.get("distmatfname"));
+    if (cross) {
+        std::vector<crossmatrix*> distances;
+        for (unsigned int k=0; k<specs.size(); ++k)
+            distances.push_back(new crossmatrix(sequences.size(), references.size(),
+                                                distmatfnames[k], restart));
+
+        progress prog(nthreads, (uint64_t)sequences.size() * references.size(),
+                      std::stoi(opts.get("progress")), opts.get("progressfile"));
+        prog.run();
+#ifdef SINGLETHREAD
+        crossworker(&sweep, &distances, sequences, references, nthreads, 0,
+                    opts.get("checkpointdir"), restart, &prog);
+#else
+        for (unsigned int i=0; i < nthreads; ++i) {
+            threads[i] = std::thread(crossworker, &sweep, &distances,
+                                     std::cref(sequences), std::cref(references),
+                                     nthreads, i, opts.get("checkpointdir"), restart, &prog);
+        }
+        for (unsigned int i=0; i < nthreads; ++i) {
+            threads[i].join();
+        }
+#endif
+        prog.stop();
+
+        reportusage(startusage, nthreads);
+
+        sweep.printdetails();
+        for (unsigned int k=0; k<specs.size(); ++k) {
+            distances[k]->checksanity();
+            if (opts.get("printresult").compare("true") == 0)
+                distances[k]->print();
+            delete distances[k];
+        }
+
+        return 0;
+    }
 
+    unsigned int firstnew = 0;
+    if (opts.get("extendmatrix").length() > 0) {
+        firstnew = checkids(oldfnames[0], sequences);
+        for (unsigned int k=1; k<specs.size(); ++k)
+            if (checkids(oldfnames[k], sequences) != firstnew)
+                errx(1, "'%s' and '%s' do not have the same sequences",
+                     oldfnames[0].c_str(), oldfnames[k].c_str());
+        std::cerr << "Extending " << opts.get("extendmatrix") << ": "
+                  << firstnew << " existing, "
+                  << sequences.size() - firstnew << " new sequences" << std::endl;
+    }
+
+    std::vector<distancematrix*> distances;
+    for (unsigned int k=0; k<specs.size(); ++k) {
+        distancematrix *distance = new distancematrix;
+        if (opts.get("restart").compare("true") == 0)
+            distance->init(distmatfnames[k]);
+        else if (firstnew > 0)
+            distance->init(sequences.size(), distmatfnames[k], oldfnames[k], firstnew);
+        else
+            distance->init(sequences.size(), distmatfnames[k]);
+        distances.push_back(distance);
+    }
+
+    // row i is the columns from max(i, firstnew) on
+    uint64_t totalpairs = 0;
+    for (unsigned int i=0; i<sequences.size(); ++i)
+        totalpairs += sequences.size() - std::max(i, firstnew);
+    progress prog(nthreads, totalpairs, std::stoi(opts.get("progress")), opts.get("progressfile"));
+    prog.run();
 #ifdef SINGLETHREAD
-    worker(m, &distance, sequences, nthreads, 0, opts.get("checkpointdir"), restart);
+    worker(&sweep, &distances, sequences, nthreads, 0, opts.get("checkpointdir"), restart, firstnew, &prog);
 #else
     for (unsigned int i=0; i < nthreads; ++i) {
-        threads[i] = std::thread(worker, m, &distance, sequences, nthreads, i,
-                                 opts.get("checkpointdir"), restart);
+        threads[i] = std::thread(worker, &sweep, &distances, std::cref(sequences), nthreads, i,
+                                 opts.get("checkpointdir"), restart, firstnew, &prog);
     }
     for (unsigned int i=0; i < nthreads; ++i) {
         threads[i].join();
     }
 #endif
+    prog.stop();
 
-    if (getrusage(RUSAGE_SELF, &endusage) < 0)
-        err(1, "getrusage end failed");
+    reportusage(startusage, nthreads);
 
-    long usec = endusage.ru_utime.tv_sec - startusage.ru_utime.tv_sec;
-    long uusec = endusage.ru_utime.tv_usec - startusage.ru_utime.tv_usec;
-    long ssec = endusage.ru_stime.tv_sec - startusage.ru_stime.tv_sec;
-    long susec = endusage.ru_stime.tv_usec - startusage.ru_stime.tv_usec;
-    std::cerr << "nthreads: " << nthreads << std::endl;
-    std::cerr << (double) usec + uusec / 1000000.0 << " + "
-              << (double) ssec + susec / 1000000.0 << " u+s secs" << std::endl;
-    std::cerr << endusage.ru_maxrss - startusage.ru_maxrss << " Kib" << std::endl;
+    sweep.printdetails();
 
-    m->printdetails();
+    for (unsigned int k=0; k<specs.size(); ++k) {
+        distances[k]->checksanity();
+        writeids(distmatfnames[k], sequences);
 
-    distance.checksanity();
-
-    if (opts.get("printresult").compare("true") == 0)
-        distance.print();
+        if (opts.get("printresult").compare("true") == 0)
+            distances[k]->print();
+        delete distances[k];
+    }
 
     return 0;
 }
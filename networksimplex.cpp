@@ -0,0 +1,249 @@
+/*!
+ * @brief primal network simplex for uncapacitated minimum cost flow
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "networksimplex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <err.h>
+
+void
+networksimplex::reset(const uint32_t n)
+{
+    nnodes = n;
+    narcs = 0;
+    source.clear();
+    target.clear();
+    cost.clear();
+    supply.assign(n, 0);
+}
+
+void
+networksimplex::treeadd(const uint32_t a)
+{
+    treepos[2*a] = treearcs[source[a]].size();
+    treearcs[source[a]].push_back(a);
+    treepos[2*a + 1] = treearcs[target[a]].size();
+    treearcs[target[a]].push_back(a);
+    intree[a] = true;
+}
+
+// take a out of node's list, which is its source's (side 0) or target's (side 1)
+void
+networksimplex::treeremove(const uint32_t a, const uint32_t node, const uint32_t side)
+{
+    std::vector<uint32_t>& list = treearcs[node];
+    const uint32_t p = treepos[2*a + side];
+    const uint32_t last = list.back();
+    list[p] = last;
+    list.pop_back();
+    if (last != a)
+        treepos[2*last + (source[last] == node ? 0 : 1)] = p;
+}
+
+void
+networksimplex::treeremove(const uint32_t a)
+{
+    treeremove(a, source[a], 0);
+    treeremove(a, target[a], 1);
+    intree[a] = false;
+}
+
+/*! @brief the real arc with the most negative reduced cost in the first
+ * block, starting at next, that has one; false if there is none (the flow
+ * is optimal)
+ */
+bool
+networksimplex::findentering(uint32_t& next, const uint32_t blocksize, uint32_t& in)
+{
+    int64_t best = 0;
+    uint32_t count = blocksize;
+    for (uint32_t scanned=0; scanned<narcs; ++scanned) {
+        const uint32_t a = next;
+        next = next + 1 == narcs ? 0 : next + 1;
+        if (!intree[a]) {
+            const int64_t rc = cost[a] + pi[source[a]] - pi[target[a]];
+            if (rc < best) {
+                best = rc;
+                in = a;
+            }
+        }
+        if (--count == 0) {
+            if (best < 0)
+                return true;
+            count = blocksize;
+        }
+    }
+    return best < 0;
+}
+
+/*! @brief push flow around the cycle that arc in makes with the tree, and
+ * swap in for the arc that blocks it
+ *
+ * The cycle runs in -> second -> ... -> join -> ... -> first.  Of the
+ * arcs whose flow would go down, the last one met going around from the
+ * join leaves the tree, which keeps the tree strongly feasible.
+ */
+void
+networksimplex::pivot(const uint32_t in)
+{
+    const uint32_t first = source[in], second = target[in];
+
+    uint32_t join1 = first, join2 = second;
+    while (join1 != join2) {
+        if (depth[join1] > depth[join2])
+            join1 = parent[join1];
+        else if (depth[join2] > depth[join1])
+            join2 = parent[join2];
+        else {
+            join1 = parent[join1];
+            join2 = parent[join2];
+        }
+    }
+    const uint32_t join = join1;
+
+    int64_t delta = std::numeric_limits<int64_t>::max();
+    uint32_t out = 0;
+    int side = 0;
+    for (uint32_t x=first; x != join; x = parent[x]) {
+        const uint32_t a = pred[x];
+        if (source[a] == x && flow[a] < delta) {
+            delta = flow[a];
+            out = x;
+            side = 1;
+        }
+    }
+    for (uint32_t x=second; x != join; x = parent[x]) {
+        const uint32_t a = pred[x];
+        if (target[a] == x && flow[a] <= delta) {
+            delta = flow[a];
+            out = x;
+            side = 2;
+        }
+    }
+    if (side == 0)
+        errx(1, "networksimplex: negative cost cycle; arc costs must not be negative");
+
+    if (delta > 0) {
+        flow[in] += delta;
+        for (uint32_t x=first; x != join; x = parent[x])
+            flow[pred[x]] += source[pred[x]] == x ? -delta : delta;
+        for (uint32_t x=second; x != join; x = parent[x])
+            flow[pred[x]] += source[pred[x]] == x ? delta : -delta;
+    }
+
+    // The leaving arc cuts off the subtree under out, which holds first
+    // (side 1) or second (side 2); hang it from the other end of in.
+    treeremove(pred[out]);
+    treeadd(in);
+    const uint32_t uin = side == 1 ? first : second;
+    const uint32_t vin = side == 1 ? second : first;
+    parent[uin] = vin;
+    pred[uin] = in;
+    depth[uin] = depth[vin] + 1;
+    pi[uin] = source[in] == vin ? pi[vin] + cost[in] : pi[vin] - cost[in];
+
+    stack.assign(1, uin);
+    while (!stack.empty()) {
+        const uint32_t x = stack.back();
+        stack.pop_back();
+        for (auto a : treearcs[x]) {
+            if (a == pred[x])
+                continue;
+            const uint32_t y = source[a] == x ? target[a] : source[a];
+            parent[y] = x;
+            pred[y] = a;
+            depth[y] = depth[x] + 1;
+            pi[y] = source[a] == x ? pi[x] + cost[a] : pi[x] - cost[a];
+            stack.push_back(y);
+        }
+    }
+}
+
+int64_t
+networksimplex::solve()
+{
+    const uint32_t root = nnodes;
+    const uint32_t total = narcs + nnodes;
+
+    int64_t sum = 0, maxcost = 0;
+    for (uint32_t u=0; u<nnodes; ++u)
+        sum += supply[u];
+    if (sum != 0)
+        errx(1, "networksimplex: supplies and demands differ by %lld", (long long)sum);
+    for (uint32_t a=0; a<narcs; ++a)
+        maxcost = std::max(maxcost, cost[a]);
+    // more than any path of real arcs costs
+    const int64_t artcost = (maxcost + 1) * (nnodes + 1);
+
+    source.resize(narcs);
+    target.resize(narcs);
+    cost.resize(narcs);
+    flow.assign(total, 0);
+    intree.assign(total, false);
+    pi.assign(nnodes + 1, 0);
+    parent.assign(nnodes + 1, root);
+    pred.assign(nnodes + 1, 0);
+    depth.assign(nnodes + 1, 1);
+    depth[root] = 0;
+    if (treearcs.size() < nnodes + 1)
+        treearcs.resize(nnodes + 1);
+    for (uint32_t u=0; u<=nnodes; ++u)
+        treearcs[u].clear();
+    treepos.resize(2 * total);
+
+    // Supplies go up to the root for free and demands come down from it
+    // at a price no real route can reach.
+    for (uint32_t u=0; u<nnodes; ++u) {
+        const uint32_t e = narcs + u;
+        if (supply[u] >= 0) {
+            source.push_back(u);
+            target.push_back(root);
+            cost.push_back(0);
+            flow[e] = supply[u];
+        } else {
+            source.push_back(root);
+            target.push_back(u);
+            cost.push_back(artcost);
+            flow[e] = -supply[u];
+            pi[u] = artcost;
+        }
+        pred[u] = e;
+        treeadd(e);
+    }
+
+    npivots = 0;
+    if (narcs > 0) {
+        const uint32_t blocksize = std::max(10u, (uint32_t)std::ceil(std::sqrt((double)narcs)));
+        uint32_t next = 0, in = 0;
+        while (findentering(next, blocksize, in)) {
+            pivot(in);
+            ++npivots;
+        }
+    }
+
+    for (uint32_t u=0; u<nnodes; ++u)
+        if (flow[narcs + u] != 0)
+            errx(1, "networksimplex: the demands cannot be met from the supplies");
+    int64_t result = 0;
+    for (uint32_t a=0; a<narcs; ++a)
+        result += cost[a] * flow[a];
+    return result;
+}
@@ -0,0 +1,107 @@
+/*!
+ * @brief primal network simplex for uncapacitated minimum cost flow
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETWORKSIMPLEX_H
+#define NETWORKSIMPLEX_H
+
+#include <cstdint>
+#include <vector>
+
+/*! @class networksimplex
+ * @brief minimum cost flow on a network whose arcs have non-negative
+ * integer costs and no capacity limit, which is what a transport problem
+ * needs
+ *
+ * The spanning tree starts as an artificial arc between each node and an
+ * extra root, and is kept strongly feasible (Cunningham's leaving arc
+ * rule), so degenerate pivots cannot cycle.  Entering arcs are chosen by
+ * block search: the most negative reduced cost in the next block of about
+ * sqrt(arcs) arcs.  A pivot re-hangs the subtree it cuts off and updates
+ * only that subtree's potentials.
+ *
+ * Use: reset(), set_supply() and addarc(), then solve().  The vectors keep
+ * their storage across reset(), so one object can solve many problems
+ * without allocating.
+ */
+class networksimplex {
+    // arcs: the real ones, then one artificial arc per node
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> target;
+    std::vector<int64_t> cost;
+    std::vector<int64_t> flow;
+    std::vector<bool> intree;
+
+    // nodes, plus the root
+    std::vector<int64_t> supply;
+    std::vector<int64_t> pi;            //!< potentials
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> pred;         //!< the tree arc to the parent
+    std::vector<uint32_t> depth;
+    //! tree arcs at each node; treepos[2a] and treepos[2a+1] are arc a's
+    //! places in its source's and target's lists
+    std::vector<std::vector<uint32_t>> treearcs;
+    std::vector<uint32_t> treepos;
+    std::vector<uint32_t> stack;
+
+    uint32_t nnodes = 0;
+    uint32_t narcs = 0;
+    uint64_t npivots = 0;
+
+    void treeadd(const uint32_t a);
+    void treeremove(const uint32_t a);
+    void treeremove(const uint32_t a, const uint32_t node, const uint32_t side);
+    bool findentering(uint32_t& next, const uint32_t blocksize, uint32_t& in);
+    void pivot(const uint32_t in);
+
+public:
+    //! @brief start a new problem with n nodes, no arcs and no supplies
+    void reset(const uint32_t n);
+    //! @brief one more node, with no supply; returns its number
+    uint32_t addnode() {
+        supply.push_back(0);
+        return nnodes++;
+    };
+    //! @brief supply (positive) or demand (negative) at a node; they must sum to 0
+    void set_supply(const uint32_t node, const int64_t s) {
+        supply[node] = s;
+    };
+    //! @brief an arc from -> to with the given cost per unit of flow; returns its number
+    uint32_t addarc(const uint32_t from, const uint32_t to, const int64_t c) {
+        source.push_back(from);
+        target.push_back(to);
+        cost.push_back(c);
+        return narcs++;
+    };
+    /*! @brief the minimum total cost of meeting the demands from the
+     * supplies; errx() if they cannot be met
+     */
+    int64_t solve();
+    int64_t get_flow(const uint32_t arc) const {
+        return flow[arc];
+    };
+    uint32_t get_narcs() const {
+        return narcs;
+    };
+    //! pivots done by the last solve()
+    uint64_t get_npivots() const {
+        return npivots;
+    };
+};
+
+#endif // NETWORKSIMPLEX_H
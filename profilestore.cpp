@@ -0,0 +1,484 @@
+/*!
+ * @brief flat kmer profile storage and its binary cache file
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profilestore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+profilestore::profilestore(const kmeroptions& opts_p, const bool packed_p)
+{
+    opts = opts_p;
+    packed = packed_p;
+}
+
+profilestore::~profilestore()
+{
+    if (mapped != nullptr && munmap(mapped, mappedsize) < 0)
+        err(1, "munmap of profile cache failed");
+}
+
+//! @brief turn the kmers of one sequence into its profile; sorts all
+void
+profilestore::countkmers(std::vector<profilekey_t>& all, ownedprofile& p)
+{
+    std::sort(all.begin(), all.end());
+
+    p.keys.clear();
+    p.counts.clear();
+    p.sqnorm = 0;
+    for (size_t i=0; i<all.size(); ) {
+        size_t j = i;
+        while (j < all.size() && all[j] == all[i])
+            ++j;
+        p.keys.push_back(all[i]);
+        p.counts.push_back(j - i);
+        p.sqnorm += (uint64_t)(j - i) * (j - i);
+        i = j;
+    }
+}
+
+//! @brief the sorted kmer profile of one sequence
+void
+profilestore::calculate(const std::string& seq, ownedprofile& p) const
+{
+    std::vector<profilekey_t> all;
+    all.reserve(seq.length());
+    encoder.kmers(seq, opts, all);
+    countkmers(all, p);
+}
+
+void
+profilestore::makeindex(const fastavec_t& seqs)
+{
+    firstseq = seqs.data();
+}
+
+/*! @brief append p to out in packed blocks
+ * Each block's widths are those of its largest key difference and count,
+ * so that the small differences of a full profile pack into a few bits.
+ */
+void
+profilestore::pack(const ownedprofile& p, std::vector<uint8_t>& out)
+{
+    profilekey_t last = 0;
+    for (size_t start=0; start<p.keys.size(); start += profilecursor::blocklen) {
+        size_t n = std::min((size_t)profilecursor::blocklen, p.keys.size() - start);
+        uint64_t maxdelta = 0, maxcount = 0;
+        for (size_t j=start; j<start+n; ++j) {
+            maxdelta |= p.keys[j] - (j == 0 ? 0 : p.keys[j-1]);
+            maxcount |= p.counts[j] - 1;
+        }
+        const unsigned int kw = maxdelta == 0 ? 0 : 64 - __builtin_clzll(maxdelta);
+        const unsigned int cw = maxcount == 0 ? 0 : 64 - __builtin_clzll(maxcount);
+        out.push_back(kw);
+        out.push_back(cw);
+
+        unsigned __int128 acc = 0;
+        unsigned int nacc = 0;
+        auto put = [&](const uint64_t v, const unsigned int w) {
+            acc |= (unsigned __int128)v << nacc;
+            nacc += w;
+            while (nacc >= 8) {
+                out.push_back((uint8_t)acc);
+                acc >>= 8;
+                nacc -= 8;
+            }
+        };
+        auto flush = [&]() {
+            if (nacc > 0)
+                out.push_back((uint8_t)acc);
+            acc = 0;
+            nacc = 0;
+        };
+        for (size_t j=start; j<start+n; ++j) {
+            put(p.keys[j] - last, kw);
+            last = p.keys[j];
+        }
+        flush();
+        for (size_t j=start; j<start+n; ++j)
+            put(p.counts[j] - 1, cw);
+        flush();
+    }
+}
+
+//! @brief the sum of two profiles, into out
+void
+profilestore::addprofiles(const ownedprofile& a, const ownedprofile& b, ownedprofile& out)
+{
+    out.keys.clear();
+    out.counts.clear();
+    out.keys.reserve(a.keys.size() + b.keys.size());
+    out.counts.reserve(a.keys.size() + b.keys.size());
+    out.sqnorm = 0;
+    size_t i = 0, j = 0;
+    while (i < a.keys.size() || j < b.keys.size()) {
+        profilecount_t c;
+        if (j == b.keys.size() || (i < a.keys.size() && a.keys[i] < b.keys[j])) {
+            out.keys.push_back(a.keys[i]);
+            c = a.counts[i++];
+        } else if (i == a.keys.size() || b.keys[j] < a.keys[i]) {
+            out.keys.push_back(b.keys[j]);
+            c = b.counts[j++];
+        } else {
+            out.keys.push_back(a.keys[i]);
+            c = a.counts[i++] + b.counts[j++];
+        }
+        out.counts.push_back(c);
+        out.sqnorm += (uint64_t)c * c;
+    }
+}
+
+/*! @brief the profiles of one long sequence, counted in nthreads chunks
+ *
+ * Each chunk is extended by kmax-1 bases so that the kmers spanning a
+ * chunk boundary are seen, but only the kmers starting inside the chunk
+ * are counted there (see kmerencoder::pieces; the bases of a trace are
+ * words, so the cuts are found by scanning it).  The chunk profiles are
+ * then added in pairs, the pairs of a level in parallel, until one is
+ * left.
+ */
+void
+profilestore::countchunked(const kmerencoder& encoder, const std::vector<kmeroptions>& os,
+                           const std::string& seq, const unsigned int nthreads,
+                           std::vector<ownedprofile>& result)
+{
+    unsigned int kmax = 0;
+    for (auto o=os.begin(); o != os.end(); ++o)
+        kmax = std::max(kmax, o->k);
+    const size_t chunklen = std::max((size_t)1, (encoder.symbols(seq) + nthreads - 1) / nthreads);
+    const std::vector<std::pair<size_t, size_t>> chunks = encoder.pieces(seq, chunklen, kmax);
+
+    std::vector<std::vector<ownedprofile>> parts(nthreads, std::vector<ownedprofile>(os.size()));
+    std::vector<std::thread> threads;
+    for (unsigned int t=0; t<nthreads && t<chunks.size(); ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<std::vector<profilekey_t>> all;
+            encoder.kmers(seq.substr(chunks[t].first, chunks[t].second), os, all, chunklen);
+            for (unsigned int i=0; i<os.size(); ++i)
+                countkmers(all[i], parts[t][i]);
+        });
+    }
+    for (auto th=threads.begin(); th != threads.end(); ++th)
+        th->join();
+
+    for (unsigned int step=1; step<nthreads; step *= 2) {
+        threads.clear();
+        for (unsigned int t=0; t+step<nthreads; t += 2*step) {
+            threads.emplace_back([&, t, step]() {
+                ownedprofile sum;
+                for (unsigned int i=0; i<os.size(); ++i) {
+                    addprofiles(parts[t][i], parts[t+step][i], sum);
+                    std::swap(parts[t][i], sum);
+                    parts[t+step][i] = ownedprofile();
+                }
+            });
+        }
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+    }
+    result = std::move(parts[0]);
+}
+
+/*! @brief calculate the profiles of seqs in memory for every store, with
+ * one pass over each sequence for all of the values of k
+ *
+ * Sequences are shared out among nthreads threads; a sequence longer than
+ * chunkedlength is instead split among all of them, so that one long
+ * sequence does not leave the other threads idle.
+ */
+void
+profilestore::build(const std::vector<profilestore*>& stores, const fastavec_t& seqs,
+                    const unsigned int nthreads)
+{
+    if (stores.empty())
+        return;
+
+    std::vector<kmeroptions> os;
+    for (auto st=stores.begin(); st != stores.end(); ++st)
+        os.push_back((*st)->opts);
+    const kmerencoder& encoder = stores[0]->encoder;
+
+    // profiles[s][i] is sequence s for store i
+    std::vector<std::vector<ownedprofile>> profiles(seqs.size());
+    std::atomic<size_t> next(0);
+    auto countshort = [&]() {
+        std::vector<std::vector<profilekey_t>> all;
+        for (size_t s=next++; s<seqs.size(); s=next++) {
+            if (nthreads > 1 && seqs[s].get_seq().length() >= chunkedlength)
+                continue;
+            for (auto a=all.begin(); a != all.end(); ++a)
+                a->clear();
+            encoder.kmers(seqs[s].get_seq(), os, all);
+            profiles[s].resize(os.size());
+            for (unsigned int i=0; i<os.size(); ++i)
+                countkmers(all[i], profiles[s][i]);
+        }
+    };
+    if (nthreads > 1) {
+        std::vector<std::thread> threads;
+        for (unsigned int t=0; t<nthreads; ++t)
+            threads.emplace_back(countshort);
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+        for (size_t s=0; s<seqs.size(); ++s)
+            if (seqs[s].get_seq().length() >= chunkedlength)
+                countchunked(encoder, os, seqs[s].get_seq(), nthreads, profiles[s]);
+    } else
+        countshort();
+
+    for (unsigned int i=0; i<stores.size(); ++i) {
+        profilestore *st = stores[i];
+        size_t nkeys = 0;
+        for (size_t s=0; s<seqs.size(); ++s)
+            nkeys += profiles[s][i].keys.size();
+        st->offsetvec.assign(1, 0);
+        st->sqnormvec.clear();
+        st->keyvec.clear();
+        st->countvec.clear();
+        st->byteoffsetvec.assign(1, 0);
+        st->packvec.clear();
+        if (!st->packed) {
+            st->keyvec.reserve(nkeys);
+            st->countvec.reserve(nkeys);
+        }
+        for (size_t s=0; s<seqs.size(); ++s) {
+            ownedprofile& p = profiles[s][i];
+            if (st->packed) {
+                pack(p, st->packvec);
+                st->byteoffsetvec.push_back(st->packvec.size());
+            } else {
+                st->keyvec.insert(st->keyvec.end(), p.keys.begin(), p.keys.end());
+                st->countvec.insert(st->countvec.end(), p.counts.begin(), p.counts.end());
+            }
+            st->offsetvec.push_back(st->offsetvec.back() + p.keys.size());
+            st->sqnormvec.push_back(p.sqnorm);
+            p = ownedprofile();
+        }
+        if (st->packed) {
+            st->packvec.resize(st->packvec.size() + profilecursor::padding, 0);
+            st->packvec.shrink_to_fit();
+        }
+        st->offsets = st->offsetvec.data();
+        st->sqnorms = st->sqnormvec.data();
+        st->keys = st->keyvec.data();
+        st->counts = st->countvec.data();
+        st->byteoffsets = st->byteoffsetvec.data();
+        st->packedbytes = st->packvec.data();
+        st->nbytes = st->packvec.size();
+        st->nprofiles = seqs.size();
+        st->makeindex(seqs);
+        st->built = true;
+    }
+}
+
+//! @brief calculate the profiles of seqs in memory
+void
+profilestore::build(const fastavec_t& seqs, const unsigned int nthreads)
+{
+    build(std::vector<profilestore*>(1, this), seqs, nthreads);
+}
+
+//! @brief FNV-1a of the seed patterns, so that their cache files differ
+uint64_t
+profilestore::seedhash() const
+{
+    if (opts.seeds.empty())
+        return 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    std::string s = opts.str();
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+//! @brief the cache file for this sequence set, alphabet, k and options
+std::string
+profilestore::cachefname(const std::string& cachedir, const uint64_t inputhash) const
+{
+    std::stringstream fname;
+    fname << cachedir << "/profiles-" << std::hex << std::setw(16) << std::setfill('0')
+          << inputhash << std::dec << "-a" << encoder.get_alphabetsize()
+          << "-k" << opts.k << (opts.canonical ? "c" : "") << (opts.hashed ? "h" : "")
+          << (packed ? "p" : "");
+    if (!opts.seeds.empty())
+        fname << "-s" << std::hex << std::setw(16) << std::setfill('0') << seedhash() << std::dec;
+    fname << ".bin";
+    return fname.str();
+}
+
+/*! @brief set up the profiles for seqs in every store that is not set up yet
+ *
+ * With a cache directory, map the profiles from an earlier run if there
+ * are any; otherwise calculate them and leave them there for the next run.
+ * Those that need calculating are calculated together.
+ */
+void
+profilestore::init(const std::vector<profilestore*>& stores, const fastavec_t& seqs,
+                   const std::string& cachedir, const unsigned int nthreads)
+{
+    uint64_t inputhash = cachedir.length() > 0 ? hashsequences(seqs) : 0;
+    std::vector<profilestore*> tobuild;
+    for (auto st=stores.begin(); st != stores.end(); ++st) {
+        if ((*st)->built)
+            continue;
+        if (cachedir.length() > 0) {
+            std::string fname = (*st)->cachefname(cachedir, inputhash);
+            if ((*st)->load(fname, seqs, inputhash)) {
+                std::cerr << "Mapped " << (*st)->nprofiles << " k = " << (*st)->opts.str()
+                          << " profiles from " << fname << std::endl;
+                continue;
+            }
+        }
+        tobuild.push_back(*st);
+    }
+
+    build(tobuild, seqs, nthreads);
+    if (cachedir.length() == 0)
+        return;
+    for (auto st=tobuild.begin(); st != tobuild.end(); ++st) {
+        std::string fname = (*st)->cachefname(cachedir, inputhash);
+        (*st)->save(fname, inputhash);
+        std::cerr << "Saved " << (*st)->nprofiles << " k = " << (*st)->opts.str()
+                  << " profiles to " << fname << std::endl;
+    }
+}
+
+void
+profilestore::init(const fastavec_t& seqs, const std::string& cachedir,
+                   const unsigned int nthreads)
+{
+    init(std::vector<profilestore*>(1, this), seqs, cachedir, nthreads);
+}
+
+// Returns false if there is no usable cache file; a file that exists but
+// does not describe this sequence set is ignored (and will be replaced).
+bool
+profilestore::load(const std::string& fname, const fastavec_t& seqs, const uint64_t inputhash)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            warn("Cannot open profile cache %s", fname.c_str());
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) err(1, "Cannot stat %s", fname.c_str());
+
+    header_t h;
+    if ((size_t)sb.st_size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        warnx("Profile cache %s is truncated; ignoring it", fname.c_str());
+        close(fd);
+        return false;
+    }
+    size_t expected = sizeof(h) + (2*h.nprofiles + 1) * sizeof(uint64_t);
+    if (packed)
+        expected += (h.nprofiles + 1) * sizeof(uint64_t) + h.nbytes;
+    else
+        expected += h.nkeys * (sizeof(profilekey_t) + sizeof(profilecount_t));
+    if (h.magic != magic || h.version != version || h.inputhash != inputhash ||
+        h.alphabet_size != encoder.get_alphabetsize() || h.nbits != encoder.get_nbits() ||
+        h.k != opts.k || h.flags != flags() || h.seedhash != seedhash() ||
+        h.nprofiles != seqs.size() || (size_t)sb.st_size != expected) {
+        warnx("Profile cache %s does not match this input; ignoring it", fname.c_str());
+        close(fd);
+        return false;
+    }
+
+    mappedsize = sb.st_size;
+    mapped = mmap(nullptr, mappedsize, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) err(1, "Cannot map %s", fname.c_str());
+    if (close(fd) < 0) err(1, "close fd for %s failed", fname.c_str());
+
+    const char *p = (const char *)mapped + sizeof(h);
+    offsets = (const uint64_t *)p;
+    p += (h.nprofiles + 1) * sizeof(uint64_t);
+    sqnorms = (const uint64_t *)p;
+    p += h.nprofiles * sizeof(uint64_t);
+    if (packed) {
+        byteoffsets = (const uint64_t *)p;
+        p += (h.nprofiles + 1) * sizeof(uint64_t);
+        packedbytes = (const uint8_t *)p;
+        nbytes = h.nbytes;
+    } else {
+        keys = (const profilekey_t *)p;
+        p += h.nkeys * sizeof(profilekey_t);
+        counts = (const profilecount_t *)p;
+    }
+    nprofiles = h.nprofiles;
+    makeindex(seqs);
+    built = true;
+
+    return true;
+}
+
+// Written to a temporary file and renamed into place, so that other
+// processes never map a partly-written cache.
+void
+profilestore::save(const std::string& fname, const uint64_t inputhash) const
+{
+    header_t h = {};
+    h.magic = magic;
+    h.version = version;
+    h.inputhash = inputhash;
+    h.alphabet_size = encoder.get_alphabetsize();
+    h.nbits = encoder.get_nbits();
+    h.k = opts.k;
+    h.flags = flags();
+    h.seedhash = seedhash();
+    h.nprofiles = nprofiles;
+    h.nkeys = offsets[nprofiles];
+    h.nbytes = packed ? nbytes : 0;
+
+    std::string tmpfname = fname + ".tmp" + std::to_string(getpid());
+    FILE *f = fopen(tmpfname.c_str(), "w");
+    if (f == nullptr) {
+        warn("Cannot create profile cache %s", tmpfname.c_str());
+        return;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(offsets, sizeof(uint64_t), nprofiles + 1, f) == nprofiles + 1 &&
+              fwrite(sqnorms, sizeof(uint64_t), nprofiles, f) == nprofiles;
+    if (packed)
+        ok = ok && fwrite(byteoffsets, sizeof(uint64_t), nprofiles + 1, f) == nprofiles + 1 &&
+             fwrite(packedbytes, 1, nbytes, f) == nbytes;
+    else
+        ok = ok && fwrite(keys, sizeof(profilekey_t), h.nkeys, f) == h.nkeys &&
+             fwrite(counts, sizeof(profilecount_t), h.nkeys, f) == h.nkeys;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmpfname.c_str(), fname.c_str()) < 0) {
+        warn("Writing profile cache %s failed", fname.c_str());
+        unlink(tmpfname.c_str());
+    }
+}
@@ -0,0 +1,324 @@
+/*!
+ * @brief flat storage for the kmer profiles of a set of sequences, with an
+ * optional binary cache file that later runs map instead of recalculating
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILESTORE_H
+#define PROFILESTORE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "FastaRecord.h"
+#include "kmerencoder.h"
+
+typedef uint32_t profilecount_t;
+
+/*! @brief one sequence's kmer profile: kmer keys in increasing order with
+ * their counts.  This is a view; the storage belongs to someone else.
+ * A packed profile has no keys and counts, only the packed blocks; read
+ * either kind with a profilecursor.
+ */
+struct kmerprofile {
+    const profilekey_t *keys = nullptr;
+    const profilecount_t *counts = nullptr;
+    const uint8_t *packed = nullptr;
+    size_t n = 0;           //!< number of distinct kmers
+    uint64_t sqnorm = 0;    //!< sum of squared counts
+};
+
+/*! @brief steps through an unpacked profile in key order; the same
+ * interface as profilecursor without the block handling
+ */
+class rawcursor {
+    const profilekey_t *keys;
+    const profilecount_t *counts;
+    const profilekey_t *end;
+
+public:
+    rawcursor(const kmerprofile& p) : keys(p.keys), counts(p.counts), end(p.keys + p.n) {};
+    bool done() const {
+        return keys == end;
+    };
+    profilekey_t key() const {
+        return *keys;
+    };
+    profilecount_t count() const {
+        return *counts;
+    };
+    void advance() {
+        ++keys;
+        ++counts;
+    };
+};
+
+/*! @class profilecursor
+ * @brief steps through a profile in key order, unpacking a packed profile
+ * one block at a time
+ *
+ * Packed block format: up to blocklen kmers as a byte holding the key
+ * width w and a byte holding the count width c, then each key's
+ * difference from the one before (the previous block's last key, or 0) in
+ * w bits, then each count less one in c bits.  Bits are packed from the
+ * least significant end, so unpacking assumes a little-endian host, and
+ * reads up to 9 bytes past the last block (the store pads for this).
+ */
+class profilecursor {
+public:
+    static const unsigned int blocklen = 128;
+    static const unsigned int padding = 16;
+
+private:
+    const profilekey_t *keys;
+    const profilecount_t *counts;
+    size_t i = 0;
+    size_t n = 0;
+    // packed profiles only
+    const uint8_t *packed = nullptr;
+    size_t left = 0;            //!< kmers not yet unpacked
+    profilekey_t last = 0;
+    profilekey_t keybuf[blocklen];
+    profilecount_t countbuf[blocklen];
+
+    static uint64_t getbits(const uint8_t *p, const size_t pos, const unsigned int w) {
+        if (w == 0)
+            return 0;
+        uint64_t v;
+        std::memcpy(&v, p + pos/8, sizeof(v));
+        const unsigned int shift = pos % 8;
+        v >>= shift;
+        if (shift + w > 64)
+            v |= (uint64_t)p[pos/8 + 8] << (64 - shift);
+        return w == 64 ? v : v & ((1ULL << w) - 1);
+    };
+    void unpack() {
+        n = left < blocklen ? left : blocklen;
+        left -= n;
+        i = 0;
+        const unsigned int kw = packed[0], cw = packed[1];
+        packed += 2;
+        for (size_t j=0; j<n; ++j) {
+            last += getbits(packed, j*kw, kw);
+            keybuf[j] = last;
+        }
+        packed += (n*kw + 7) / 8;
+        for (size_t j=0; j<n; ++j)
+            countbuf[j] = getbits(packed, j*cw, cw) + 1;
+        packed += (n*cw + 7) / 8;
+    };
+
+public:
+    profilecursor(const kmerprofile& p) {
+        if (p.packed == nullptr) {
+            keys = p.keys;
+            counts = p.counts;
+            n = p.n;
+            return;
+        }
+        keys = keybuf;
+        counts = countbuf;
+        packed = p.packed;
+        left = p.n;
+        if (left > 0)
+            unpack();
+    };
+    //! the cursor points into its own buffers, so it cannot be copied
+    profilecursor(const profilecursor&) = delete;
+    profilecursor& operator=(const profilecursor&) = delete;
+    bool done() const {
+        return i == n;
+    };
+    profilekey_t key() const {
+        return keys[i];
+    };
+    profilecount_t count() const {
+        return counts[i];
+    };
+    void advance() {
+        if (++i == n && left > 0)
+            unpack();
+    };
+};
+
+/*! @brief a profile that owns its storage, for sequences outside a store */
+struct ownedprofile {
+    std::vector<profilekey_t> keys;
+    std::vector<profilecount_t> counts;
+    uint64_t sqnorm = 0;
+
+    kmerprofile view() const {
+        kmerprofile p;
+        p.keys = keys.data();
+        p.counts = counts.data();
+        p.n = keys.size();
+        p.sqnorm = sqnorm;
+        return p;
+    };
+};
+
+/*! @class profilestore
+ * @brief the profiles of a sequence set for one k (and set of kmer
+ * options), in a few flat arrays
+ *
+ * Profile i is keys[offsets[i]..offsets[i+1]) and the matching counts.
+ * The arrays are either built in memory or mapped read-only from a cache
+ * file written by an earlier run; mapped pages are shared by every process
+ * using the same file.
+ *
+ * Cache file layout (host byte order, every section naturally aligned):
+ *   header_t
+ *   uint64 offsets[nprofiles+1]
+ *   uint64 sqnorms[nprofiles]
+ *   uint64 keys[nkeys]
+ *   uint32 counts[nkeys]
+ * or, for a packed store, in place of keys and counts,
+ *   uint64 byteoffsets[nprofiles+1]
+ *   uint8  blocks[nbytes]      (profilecursor has the block format)
+ */
+class profilestore {
+    struct header_t {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t inputhash;     //!< hashsequences() of the sequence set
+        uint32_t alphabet_size;
+        uint32_t nbits;
+        uint32_t k;
+        uint32_t flags;         //!< flag bits below
+        uint64_t nprofiles;
+        uint64_t nkeys;
+        uint64_t seedhash;      //!< identifies the spaced seeds; 0 for none
+        uint64_t nbytes;        //!< size of the packed blocks, if packed; else 0
+    };
+    static const uint32_t magic = 0x504b4d42; // "BMKP"
+    static const uint32_t version = 2;
+    static const uint32_t flag_canonical = 1;
+    static const uint32_t flag_seeded = 2;
+    static const uint32_t flag_hashed = 4;    //!< every kmer, not just long ones
+    static const uint32_t flag_packed = 8;
+
+    kmeroptions opts;
+    kmerencoder encoder;
+    bool packed;        //!< keys and counts in packed blocks
+
+    // in-memory storage, when built here
+    std::vector<uint64_t> offsetvec;
+    std::vector<uint64_t> sqnormvec;
+    std::vector<profilekey_t> keyvec;
+    std::vector<profilecount_t> countvec;
+    std::vector<uint64_t> byteoffsetvec;
+    std::vector<uint8_t> packvec;
+
+    // what is actually used: either the vectors above or the mapped file
+    const uint64_t *offsets = nullptr;
+    const uint64_t *sqnorms = nullptr;
+    const profilekey_t *keys = nullptr;
+    const profilecount_t *counts = nullptr;
+    const uint64_t *byteoffsets = nullptr;
+    const uint8_t *packedbytes = nullptr;
+    uint64_t nbytes = 0;
+    uint64_t nprofiles = 0;
+    void *mapped = nullptr;
+    size_t mappedsize = 0;
+    bool built = false;
+
+    //! the stored sequences: profile i is of firstseq[i]
+    const FastaRecord *firstseq = nullptr;
+
+    static void pack(const ownedprofile& p, std::vector<uint8_t>& out);
+    static void countchunked(const kmerencoder& encoder, const std::vector<kmeroptions>& os,
+                             const std::string& seq, const unsigned int nthreads,
+                             std::vector<ownedprofile>& result);
+    void makeindex(const fastavec_t& seqs);
+    bool load(const std::string& fname, const fastavec_t& seqs, const uint64_t inputhash);
+    void save(const std::string& fname, const uint64_t inputhash) const;
+
+public:
+    profilestore(const kmeroptions& opts_p, const bool packed_p = false);
+    ~profilestore();
+
+    //! sequences at least this long are counted in chunks by all threads
+    static const size_t chunkedlength = 1 << 20;
+
+    //! @brief the profile of a list of keys; sorts the list
+    static void countkmers(std::vector<profilekey_t>& all, ownedprofile& p);
+    void calculate(const std::string& seq, ownedprofile& p) const;
+    void build(const fastavec_t& seqs, const unsigned int nthreads = 1);
+    void init(const fastavec_t& seqs, const std::string& cachedir,
+              const unsigned int nthreads = 1);
+    static void build(const std::vector<profilestore*>& stores, const fastavec_t& seqs,
+                      const unsigned int nthreads = 1);
+    static void init(const std::vector<profilestore*>& stores, const fastavec_t& seqs,
+                     const std::string& cachedir, const unsigned int nthreads = 1);
+    static void addprofiles(const ownedprofile& a, const ownedprofile& b, ownedprofile& out);
+
+    /*! @brief the profile for fr, if fr is one of the stored sequences
+     * A stored sequence is found by its place in the vector the store was
+     * built (or loaded) for, not by its text, so nothing is copied or
+     * hashed; that vector must outlive the lookups.  Any other record, a
+     * copy of a stored one included, is not found.
+     */
+    bool find(const FastaRecord& fr, kmerprofile& p) const {
+        const std::less<const FastaRecord*> before;
+        if (firstseq == nullptr || before(&fr, firstseq) || !before(&fr, firstseq + nprofiles))
+            return false;
+        p = get(&fr - firstseq);
+        return true;
+    };
+    kmerprofile get(const unsigned int i) const {
+        kmerprofile p;
+        if (packed)
+            p.packed = packedbytes + byteoffsets[i];
+        else {
+            p.keys = keys + offsets[i];
+            p.counts = counts + offsets[i];
+        }
+        p.n = offsets[i+1] - offsets[i];
+        p.sqnorm = sqnorms[i];
+        return p;
+    };
+    unsigned int size() const {
+        return nprofiles;
+    };
+    //! whether init() has been called
+    bool is_built() const {
+        return built;
+    };
+    bool is_mapped() const {
+        return mapped != nullptr;
+    };
+    bool is_packed() const {
+        return packed;
+    };
+    //! bytes used by the keys and counts
+    size_t profilebytes() const {
+        if (packed)
+            return nbytes;
+        return offsets[nprofiles] * (sizeof(profilekey_t) + sizeof(profilecount_t));
+    };
+    std::string cachefname(const std::string& cachedir, const uint64_t inputhash) const;
+    uint32_t flags() const {
+        return (opts.canonical ? flag_canonical : 0) | (opts.seeds.empty() ? 0 : flag_seeded) |
+               (opts.hashed ? flag_hashed : 0) | (packed ? flag_packed : 0);
+    };
+    uint64_t seedhash() const;
+};
+
+#endif // PROFILESTORE_H
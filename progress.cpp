@@ -0,0 +1,189 @@
+/*!
+ * @brief live progress, throughput and ETA of a distance matrix run
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "progress.h"
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <err.h>
+
+progress::progress(const unsigned int nthreads_p, const uint64_t total_p, const double interval_p,
+                   const std::string& statusfname_p)
+    : nthreads(nthreads_p), counters(new counter_t[nthreads_p]), total(total_p),
+      interval(interval_p), statusfname(statusfname_p)
+{
+    for (unsigned int t=0; t<nthreads; ++t) {
+        counters[t].pairs = 0;
+        counters[t].tiles = 0;
+        counters[t].busyns = 0;
+        counters[t].skipped = 0;
+    }
+    start = std::chrono::steady_clock::now();
+    last.when = start;
+    last.pairs = 0;
+    last.busyns.assign(nthreads, 0);
+}
+
+progress::~progress()
+{
+    stop();
+}
+
+void
+progress::run()
+{
+    start = std::chrono::steady_clock::now();
+    last.when = start;
+    if (interval <= 0 || reporter.joinable())
+        return;
+    reporter = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(stopmutex);
+        while (!stopcv.wait_for(lock, std::chrono::duration<double>(interval), [this]() { return stopping; }))
+            report(false);
+    });
+}
+
+void
+progress::stop()
+{
+    if (!reporter.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(stopmutex);
+        stopping = true;
+    }
+    stopcv.notify_all();
+    reporter.join();
+    report(true);
+}
+
+uint64_t
+progress::done() const
+{
+    uint64_t n = 0;
+    for (unsigned int t=0; t<nthreads; ++t)
+        n += counters[t].pairs.load(std::memory_order_relaxed) +
+             counters[t].skipped.load(std::memory_order_relaxed);
+    return n;
+}
+
+std::string
+progress::formatduration(double seconds)
+{
+    if (!std::isfinite(seconds) || seconds < 0)
+        return "unknown";
+    uint64_t s = (uint64_t)(seconds + 0.5);
+    std::ostringstream os;
+    if (s >= 86400)
+        os << s / 86400 << "d ";
+    s %= 86400;
+    os << std::setfill('0') << std::setw(2) << s / 3600 << ":" << std::setw(2) << (s / 60) % 60
+       << ":" << std::setw(2) << s % 60;
+    return os.str();
+}
+
+// One line to stderr and, if asked for, the status file.
+void
+progress::report(const bool finished)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - start).count();
+    const double since = std::chrono::duration<double>(now - last.when).count();
+
+    uint64_t pairs = 0, skipped = 0;
+    std::vector<uint64_t> threadpairs(nthreads), tiles(nthreads), busyns(nthreads);
+    for (unsigned int t=0; t<nthreads; ++t) {
+        threadpairs[t] = counters[t].pairs.load(std::memory_order_relaxed);
+        tiles[t] = counters[t].tiles.load(std::memory_order_relaxed);
+        busyns[t] = counters[t].busyns.load(std::memory_order_relaxed);
+        pairs += threadpairs[t];
+        skipped += counters[t].skipped.load(std::memory_order_relaxed);
+    }
+    const uint64_t done = pairs + skipped;
+    const double percent = total > 0 ? 100.0 * done / total : 100;
+    const double rate = elapsed > 0 ? pairs / elapsed : 0;
+    const double recent = since > 0 ? (pairs - last.pairs) / since : 0;
+    const double eta = finished || done >= total ? 0 : rate > 0 ? (total - done) / rate : NAN;
+    std::vector<double> utilization(nthreads);
+    for (unsigned int t=0; t<nthreads; ++t)
+        utilization[t] = since > 0 ? std::min(1.0, (busyns[t] - last.busyns[t]) / (since * 1e9)) : 0;
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "progress: " << done << "/" << total << " pairs ("
+         << percent << "%), " << std::setprecision(0) << rate << " pairs/s (last "
+         << recent << "), ETA " << formatduration(eta) << ", busy";
+    for (unsigned int t=0; t<nthreads; ++t)
+        line << " " << 100 * utilization[t] << "%";
+    std::cerr << line.str() << std::endl;
+
+    if (statusfname.length() > 0) {
+        std::ostringstream json;
+        json << std::setprecision(6) << "{\n"
+             << "  \"time\": " << std::time(nullptr) << ",\n"
+             << "  \"finished\": " << (finished ? "true" : "false") << ",\n"
+             << "  \"elapsed\": " << elapsed << ",\n"
+             << "  \"pairs\": " << done << ",\n"
+             << "  \"total\": " << total << ",\n"
+             << "  \"percent\": " << percent << ",\n"
+             << "  \"pairspersec\": " << rate << ",\n"
+             << "  \"recentpairspersec\": " << recent << ",\n"
+             << "  \"eta\": ";
+        if (std::isfinite(eta))
+            json << eta;
+        else
+            json << "null";
+        json << ",\n  \"threads\": [";
+        for (unsigned int t=0; t<nthreads; ++t)
+            json << (t > 0 ? "," : "") << "\n    { \"pairs\": " << threadpairs[t] << ", \"tiles\": "
+                 << tiles[t] << ", \"utilization\": " << utilization[t] << " }";
+        json << "\n  ]\n}\n";
+        writestatus(json.str());
+    }
+
+    last.when = now;
+    last.pairs = pairs;
+    last.busyns = busyns;
+}
+
+// Written to a temporary file and renamed over the old one, so that a
+// reader gets either the last status or this one.
+void
+progress::writestatus(const std::string& json) const
+{
+    const std::string tmpfname = statusfname + ".tmp";
+    {
+        std::ofstream outf(tmpfname);
+        if (!outf) {
+            warn("Cannot create status file %s", tmpfname.c_str());
+            return;
+        }
+        outf << json;
+        if (!outf) {
+            warnx("Writing status file %s failed", tmpfname.c_str());
+            return;
+        }
+    }
+    if (rename(tmpfname.c_str(), statusfname.c_str()) < 0)
+        warn("Cannot rename %s to %s", tmpfname.c_str(), statusfname.c_str());
+}
@@ -0,0 +1,118 @@
+/*!
+ * @brief live progress, throughput and ETA of a distance matrix run
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*! @class progress
+ * @brief counts the pairs and tiles each worker has done, and every so
+ * often reports how far the run has got
+ *
+ * Each worker has counters of its own, on a cache line of their own, and
+ * only it writes them, so counting a tile is a few plain stores with no
+ * locked instruction and no sharing between cores; it happens once a
+ * tile, not once a pair.  A reporter thread reads the counters every
+ * interval seconds and prints the pairs done, the percent of the whole
+ * matrix, pairs a second (overall and over the last interval), how busy
+ * each worker was comparing, and when the run should finish, to stderr;
+ * it can also write the same as JSON to a status file, replaced whole
+ * each time so a reader never sees half of it.
+ *
+ * Pairs that an earlier run did (when restarting from a checkpoint) count
+ * towards the percent done but not the speed.
+ */
+class progress {
+    struct alignas(64) counter_t {
+        std::atomic<uint64_t> pairs;    //!< done by this run
+        std::atomic<uint64_t> tiles;
+        std::atomic<uint64_t> busyns;   //!< nanoseconds spent comparing
+        std::atomic<uint64_t> skipped;  //!< pairs done by an earlier run
+    };
+    //! what the reporter saw last time, for the rates over an interval
+    struct snapshot_t {
+        std::chrono::steady_clock::time_point when;
+        uint64_t pairs;
+        std::vector<uint64_t> busyns;
+    };
+
+    unsigned int nthreads;
+    std::unique_ptr<counter_t[]> counters;
+    uint64_t total;
+    double interval;
+    std::string statusfname;
+    std::chrono::steady_clock::time_point start;
+    snapshot_t last;
+
+    std::thread reporter;
+    std::mutex stopmutex;
+    std::condition_variable stopcv;
+    bool stopping = false;
+
+    void report(const bool finished);
+    void writestatus(const std::string& json) const;
+
+public:
+    /*! @brief counters for nthreads workers doing total pairs; reports
+     * every interval seconds (none if 0), and to statusfname too if it is
+     * not empty
+     */
+    progress(const unsigned int nthreads_p, const uint64_t total_p, const double interval_p,
+             const std::string& statusfname_p = "");
+    ~progress();
+    progress(const progress&) = delete;
+    progress& operator=(const progress&) = delete;
+
+    //! @brief start reporting
+    void run();
+    //! @brief stop reporting, after a last report
+    void stop();
+
+    //! @brief worker t has done a tile of n pairs in ns nanoseconds; only t may call this
+    void tiledone(const unsigned int t, const uint64_t n, const uint64_t ns) {
+        counter_t& c = counters[t];
+        c.pairs.store(c.pairs.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        c.tiles.store(c.tiles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        c.busyns.store(c.busyns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    };
+    //! @brief worker t is not doing n pairs because an earlier run did them
+    void skipped(const unsigned int t, const uint64_t n) {
+        counter_t& c = counters[t];
+        c.skipped.store(c.skipped.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    };
+
+    //! @brief pairs done, by this run and earlier ones
+    uint64_t done() const;
+    uint64_t get_total() const {
+        return total;
+    };
+    //! @brief e.g. "3d 04:05:06" or "00:00:07"
+    static std::string formatduration(double seconds);
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,379 @@
+/*!
+ * @brief Long-running query service; see queryserver.h for the protocol
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "queryserver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Most queries that are answered as one batch
+const unsigned int maxbatch = 64;
+// Least slack in the triangle inequality for rounding in the measures;
+// nearest() allows more for measures that say they round more
+const long double pruneslack = 1e-6;
+
+// Returns false on end of file or a failed read; a short read means the
+// client went away mid-query, which ends the conversation the same way.
+// Either way only this client is dropped.
+static bool
+readfull(int fd, void *buf, size_t n)
+{
+    char *p = (char *)buf;
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, p + got, n - got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            warn("queryserver read failed; dropping client");
+            return false;
+        }
+        if (r == 0) {
+            if (got != 0)
+                warnx("queryserver: end of file in the middle of a query");
+            return false;
+        }
+        got += r;
+    }
+    return true;
+}
+
+static bool
+writefull(int fd, const void *buf, size_t n)
+{
+    const char *p = (const char *)buf;
+    size_t put = 0;
+    while (put < n) {
+        ssize_t w = write(fd, p + put, n - put);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0) {
+            warn("queryserver write failed");
+            return false;
+        }
+        put += w;
+    }
+    return true;
+}
+
+template <typename T>
+static void
+append(std::string& buf, const T value)
+{
+    buf.append((const char *)&value, sizeof(value));
+}
+
+queryserver::queryserver(const fastavec_t& refs, measurefactory_t f,
+                         unsigned int nthreads_p) : references(refs)
+{
+    factory = f;
+    nthreads = nthreads_p;
+}
+
+queryserver::~queryserver()
+{
+    for (auto it=measures.begin(); it != measures.end(); ++it)
+        delete it->second;
+}
+
+bool
+queryserver::readquery(int fd, query_t& q)
+{
+    uint32_t header[4];
+    if (!readfull(fd, header, sizeof(header)))
+        return false;
+    if (header[0] != querymagic) {
+        warnx("queryserver: bad query magic 0x%08x; dropping client", header[0]);
+        return false;
+    }
+
+    q.nbest = header[1];
+    if (header[2] > maxspeclen || header[3] > maxseqlen) {
+        q.errmsg = "query too long: spec " + std::to_string(header[2]) + " (max " +
+                   std::to_string(maxspeclen) + "), sequence " + std::to_string(header[3]) +
+                   " (max " + std::to_string(maxseqlen) + ")";
+        warnx("queryserver: %s; dropping client", q.errmsg.c_str());
+        return true;
+    }
+    std::string spec(header[2], '\0');
+    std::string seq(header[3], '\0');
+    if (!readfull(fd, &spec[0], spec.length()) || !readfull(fd, &seq[0], seq.length())) {
+        warnx("queryserver: end of file in the middle of a query");
+        return false;
+    }
+    q.spec = spec;
+    q.seq = FastaRecord("query", seq);
+    return true;
+}
+
+// The first query for a spec pays for setting up the measure on the
+// references; everything after that reuses it.  pivot is the measure's
+// pivotdist, or nullptr if it has none.
+measure*
+queryserver::getmeasure(const std::string& spec, std::string& errmsg,
+                        const std::vector<long double>*& pivot)
+{
+    std::lock_guard<std::mutex> lock(measuresmutex);
+    pivot = nullptr;
+    auto it = measures.find(spec);
+    if (it != measures.end()) {
+        auto p = pivotdist.find(spec);
+        if (p != pivotdist.end())
+            pivot = &p->second;
+        return it->second;
+    }
+
+    std::string name, subname, measureopt;
+    measure::parsespec(spec, name, subname, measureopt);
+
+    errmsg = measure::validatemeasure(name);
+    if (errmsg.length() > 0)
+        return nullptr;
+
+    measure *m = nullptr;
+    try {
+        std::cerr << "queryserver: setting up " << spec << std::endl;
+        m = factory(name, subname, measureopt, references);
+    } catch (std::exception& e) {
+        errmsg = "measure spec '" + spec + "': " + e.what();
+        return nullptr;
+    }
+    if (m == nullptr) {
+        errmsg = "unknown measure spec '" + spec + "'";
+        return nullptr;
+    }
+
+    measures.emplace(spec, m);
+    if (m->capabilities().metric && references.size() > 1) {
+        std::vector<uint32_t> all(references.size());
+        std::iota(all.begin(), all.end(), 0);
+        compareall(m, references[0], all, pivotdist[spec]);
+        pivot = &pivotdist[spec];
+    }
+    return m;
+}
+
+//! @brief dist[i] = the distance from seq to references[refs[i]], shared out among the threads
+void
+queryserver::compareall(measure *m, const FastaRecord& seq, const std::vector<uint32_t>& refs,
+                        std::vector<long double>& dist)
+{
+    dist.resize(refs.size());
+    auto work = [&](unsigned int t) {
+        for (unsigned int j=t; j<refs.size(); j += nthreads)
+            dist[j] = m->compare(seq, references[refs[j]]);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t=1; t<nthreads; ++t)
+        threads.emplace_back(work, t);
+    work(0);
+    for (auto& t : threads)
+        t.join();
+}
+
+/*! @brief the q.nbest nearest references, comparing in order of the lower
+ * bound from the pivot and stopping once no bound can beat the current
+ * q.nbest-th nearest.  Only the compared references get a distance.
+ */
+void
+queryserver::nearest(const std::vector<long double>& pivot, measure *m, const query_t& q,
+                     std::vector<uint32_t>& order, std::vector<long double>& dist)
+{
+    // The bound and the distance it is held against come from three
+    // distances, each of which may be off by the measure's roundoff (about
+    // 1.4e-3 for the cosine measure at float precision).
+    const long double slack = std::max(pruneslack, 3 * m->capabilities().roundoff);
+    const long double dqp = m->compare(q.seq, references[0]);
+    std::vector<long double> bound(references.size());
+    for (unsigned int r=0; r<references.size(); ++r)
+        bound[r] = std::fabs(dqp - pivot[r]);
+    std::vector<uint32_t> candidates(references.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::sort(candidates.begin(), candidates.end(),
+        [&](uint32_t a, uint32_t b) { return bound[a] < bound[b] || (bound[a] == bound[b] && a < b); });
+
+    // compare a few candidates per thread at a time
+    const unsigned int batchsize = 4 * nthreads;
+    auto closer = [&](uint32_t a, uint32_t b) {
+        return dist[a] < dist[b] || (dist[a] == dist[b] && a < b);
+    };
+    order.clear();
+    dist.assign(references.size(), 0);
+    std::vector<long double> got;
+    for (size_t next=0; next<candidates.size(); ) {
+        if (order.size() >= q.nbest && bound[candidates[next]] > dist[order[q.nbest - 1]] + slack)
+            break;
+        size_t end = std::min(candidates.size(), next + batchsize);
+        std::vector<uint32_t> batch(candidates.begin() + next, candidates.begin() + end);
+        compareall(m, q.seq, batch, got);
+        for (size_t i=0; i<batch.size(); ++i) {
+            dist[batch[i]] = got[i];
+            order.push_back(batch[i]);
+        }
+        std::sort(order.begin(), order.end(), closer);
+        next = end;
+    }
+    order.resize(std::min((size_t)q.nbest, order.size()));
+}
+
+void
+queryserver::answer(const query_t& q, std::string& reply)
+{
+    std::string errmsg = q.errmsg;
+    const std::vector<long double> *pivot = nullptr;
+    measure *m = errmsg.length() > 0 ? nullptr : getmeasure(q.spec, errmsg, pivot);
+    append(reply, replymagic);
+    if (m == nullptr) {
+        append(reply, (uint32_t)1);
+        append(reply, (uint32_t)errmsg.length());
+        reply.append(errmsg);
+        return;
+    }
+
+    // Set up the query once, then the threads share the references.
+    m->hold(q.seq);
+    m->init(fastavec_t(1, q.seq));
+    unsigned int n = references.size();
+    if (q.nbest > 0 && q.nbest < n)
+        n = q.nbest;
+    std::vector<uint32_t> order;
+    std::vector<long double> dist;
+    if (pivot != nullptr && n < references.size()) {
+        nearest(*pivot, m, q, order, dist);
+    } else {
+        order.resize(references.size());
+        std::iota(order.begin(), order.end(), 0);
+        compareall(m, q.seq, order, dist);
+        std::partial_sort(order.begin(), order.begin() + n, order.end(),
+            [&](uint32_t a, uint32_t b) {
+                return dist[a] < dist[b] || (dist[a] == dist[b] && a < b);
+            });
+    }
+    m->forget(q.seq);
+
+    append(reply, (uint32_t)0);
+    append(reply, (uint32_t)n);
+    for (unsigned int i=0; i<n; ++i) {
+        append(reply, order[i]);
+        append(reply, (double)dist[order[i]]);
+    }
+}
+
+//! @brief answer queries from infd until end of file
+void
+queryserver::serve(int infd, int outfd)
+{
+    bool more = true;
+    while (more) {
+        std::vector<query_t> batch(1);
+        if (!readquery(infd, batch[0]))
+            break;
+        // the rest of a query that was too long is still to come
+        if (batch[0].errmsg.length() > 0)
+            more = false;
+
+        // Collect whatever else has already arrived.
+        struct pollfd pfd = { infd, POLLIN, 0 };
+        while (more && batch.size() < maxbatch && poll(&pfd, 1, 0) > 0) {
+            query_t q;
+            if (!readquery(infd, q)) {
+                more = false;
+                break;
+            }
+            batch.push_back(q);
+            if (q.errmsg.length() > 0)
+                more = false;
+        }
+
+        std::string reply;
+        for (auto q=batch.begin(); q != batch.end(); ++q)
+            answer(*q, reply);
+        if (!writefull(outfd, reply.data(), reply.length()))
+            break;
+    }
+}
+
+/*! @brief accept connections on a Unix domain socket, serving each on a
+ * thread of its own, at most maxconnections at once
+ * A client that keeps its connection open without sending holds only its
+ * own thread.  This never returns, so the threads may use its locals.
+ */
+void
+queryserver::servesocket(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if (path.length() >= sizeof(addr.sun_path))
+        errx(1, "socket path '%s' is too long", path.c_str());
+
+    // A client that disconnects early must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        err(1, "socket failed");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        err(1, "bind to '%s' failed", path.c_str());
+    if (listen(sock, 16) < 0)
+        err(1, "listen on '%s' failed", path.c_str());
+
+    std::cerr << "queryserver: listening on " << path << std::endl;
+    std::mutex activemutex;
+    std::condition_variable finished;
+    unsigned int active = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(activemutex);
+            finished.wait(lock, [&]() { return active < maxconnections; });
+        }
+        int fd = accept(sock, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            err(1, "accept on '%s' failed", path.c_str());
+        }
+        {
+            std::lock_guard<std::mutex> lock(activemutex);
+            ++active;
+        }
+        std::thread([&, fd]() {
+            serve(fd, fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(activemutex);
+            --active;
+            finished.notify_one();
+        }).detach();
+    }
+}
@@ -0,0 +1,120 @@
+/*!
+ * @brief Long-running query service: compare query sequences against a
+ * reference set that is loaded, and whose measure data is calculated, once.
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include "FastaRecord.h"
+#include "measure.h"
+
+/*! @class queryserver
+ * @brief answer "which references are nearest to this sequence" queries
+ *
+ * The protocol is binary, with all integers in host byte order (the client
+ * and server are expected to be on the same machine).
+ *
+ * Query:
+ *   uint32 magic       querymagic
+ *   uint32 nbest       number of nearest references wanted; 0 means all
+ *   uint32 speclen     length of the measure spec
+ *   uint32 seqlen      length of the sequence
+ *   char spec[speclen] measure[:submeasure[:measureopt]], e.g. "kmer:cosine:7" or "edit"
+ *   char seq[seqlen]   the query sequence
+ *
+ * Reply:
+ *   uint32 magic       replymagic
+ *   uint32 status      0 for success; otherwise n is the length of an error message
+ *   uint32 n           number of results
+ *   n times:
+ *     uint32 index     reference number (order in the reference fasta file)
+ *     double distance
+ *   or, on error, char message[n]
+ *
+ * Results are nearest first.  Queries that arrive together are answered
+ * together, with one write for the whole batch of replies.  On a socket
+ * each connection is served by a thread of its own, up to maxconnections
+ * at once; later clients wait in the listen queue until one closes.
+ *
+ * A query whose spec is longer than maxspeclen, or whose sequence is
+ * longer than maxseqlen, gets an error reply and the connection is then
+ * closed, since the server does not read the rest of it.  A client that
+ * errs in any other way loses only its own connection.
+ *
+ * For a measure that is a true metric, a query for the nbest nearest
+ * skips references that the triangle inequality rules out: with p the
+ * first reference, |d(q,p) - d(p,r)| <= d(q,r).  The answer is the same
+ * as comparing against every reference.
+ */
+
+class queryserver {
+public:
+    //! creates a measure from its name, submeasure and option, initialized
+    //! for the given sequences; nullptr if the measure is unknown
+    typedef measure* (*measurefactory_t)(const std::string&, const std::string&,
+                                         const std::string&, const fastavec_t&);
+
+    static const uint32_t querymagic = 0x31514d42; // "BMQ1"
+    static const uint32_t replymagic = 0x31524d42; // "BMR1"
+    static const uint32_t maxspeclen = 4096;
+    static const uint32_t maxseqlen = 1u << 28;
+    static const unsigned int maxconnections = 16;
+
+private:
+    const fastavec_t& references;
+    measurefactory_t factory;
+    unsigned int nthreads;
+    //! measures created so far, keyed by spec; each keeps its reference data
+    std::map<std::string, measure*> measures;
+    //! for metric measures, the distance from the first reference to each
+    std::map<std::string, std::vector<long double>> pivotdist;
+    //! connections share the measures; a new one is set up under the lock
+    std::mutex measuresmutex;
+
+    struct query_t {
+        uint32_t nbest;
+        std::string spec;
+        FastaRecord seq;
+        std::string errmsg;     //!< if not empty, the query could not be read
+    };
+
+    bool readquery(int fd, query_t& q);
+    measure* getmeasure(const std::string& spec, std::string& errmsg,
+                        const std::vector<long double>*& pivot);
+    void compareall(measure *m, const FastaRecord& seq, const std::vector<uint32_t>& refs,
+                    std::vector<long double>& dist);
+    void nearest(const std::vector<long double>& pivot, measure *m, const query_t& q,
+                 std::vector<uint32_t>& order, std::vector<long double>& dist);
+    void answer(const query_t& q, std::string& reply);
+
+public:
+    queryserver(const fastavec_t& refs, measurefactory_t f, unsigned int nthreads_p);
+    ~queryserver();
+
+    void serve(int infd, int outfd);
+    void servesocket(const std::string& path);
+};
+
+#endif // QUERYSERVER_H
@@ -0,0 +1,303 @@
+/*!
+ * @brief de Bruijn graph of the kmers seen in a sequence set, in flat arrays
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sparsedebruijn.h"
+#include "kmerhashtable.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+sparsedebruijn::sparsedebruijn(const unsigned int k_p)
+{
+    k = k_p;
+    nbits = encoder.get_nbits();
+    maskwords = (encoder.get_alphabetsize() + 63) / 64;
+    if (k == 0 || !encoder.exact(k + 1))
+        errx(1, "sparsedebruijn: k = %u is too big; k+1 bases must fit in 64 bits", k);
+    usevectors();
+}
+
+sparsedebruijn::~sparsedebruijn()
+{
+    if (mapped != nullptr && munmap(mapped, mappedsize) < 0)
+        err(1, "munmap of de Bruijn graph failed");
+}
+
+void
+sparsedebruijn::usevectors()
+{
+    outstartvec.resize(nnodes + 1, 0);
+    instartvec.resize(nnodes + 1, 0);
+    keys = keyvec.data();
+    outmasks = outmaskvec.data();
+    inmasks = inmaskvec.data();
+    counts = countvec.data();
+    outstart = outstartvec.data();
+    outtarget = outtargetvec.data();
+    edgecounts = edgecountvec.data();
+    instart = instartvec.data();
+    insource = insourcevec.data();
+}
+
+/*! @brief count the kmers and (k+1)-mers of seqs in nthreads threads
+ * into two shared hash tables, then build from their sorted profiles
+ */
+void
+sparsedebruijn::build(const fastavec_t& seqs, const unsigned int nthreads)
+{
+    uint64_t total = 0;
+    for (auto s=seqs.begin(); s != seqs.end(); ++s)
+        total += s->get_seq().length();
+    // the tables grow if this is too few; there are rarely as many as total
+    const uint64_t expected = std::min(total, (uint64_t)1 << 24);
+    kmerhashtable nodetable(expected), edgetable(expected);
+    kmerhashtable::count({ &nodetable, &edgetable }, { kmeroptions(k), kmeroptions(k + 1) }, seqs, nthreads);
+    ownedprofile nodes, edges;
+    nodetable.profile(nodes);
+    edgetable.profile(edges);
+    build(nodes, edges);
+}
+
+void
+sparsedebruijn::build(const std::string& seq)
+{
+    std::vector<profilekey_t> nodekeys, edgekeys;
+    encoder.kmers(seq, kmeroptions(k), nodekeys);
+    encoder.kmers(seq, kmeroptions(k + 1), edgekeys);
+    ownedprofile nodes, edges;
+    profilestore::countkmers(nodekeys, nodes);
+    profilestore::countkmers(edgekeys, edges);
+    build(nodes, edges);
+}
+
+/* An edge (k+1)-mer z runs from its first k bases, z >> nbits, to its last
+ * k, z & lowk.  The edges come sorted by z, which is by source node and
+ * then by the base shifted in, which is the order the out edges are kept
+ * in; the in edges are sorted again by target and the base shifted out.
+ */
+void
+sparsedebruijn::build(const ownedprofile& nodes, const ownedprofile& edges)
+{
+    if (mapped != nullptr && munmap(mapped, mappedsize) < 0)
+        err(1, "munmap of de Bruijn graph failed");
+    mapped = nullptr;
+    if (nodes.keys.size() >= npos || edges.keys.size() >= npos)
+        errx(1, "sparsedebruijn: more than %u nodes or edges", npos - 1);
+
+    nnodes = nodes.keys.size();
+    nedges = edges.keys.size();
+    sqnorm = nodes.sqnorm;
+    keyvec = nodes.keys;
+    countvec = nodes.counts;
+    outmaskvec.assign(nnodes * maskwords, 0);
+    inmaskvec.assign(nnodes * maskwords, 0);
+    outstartvec.assign(nnodes + 1, 0);
+    instartvec.assign(nnodes + 1, 0);
+    outtargetvec.resize(nedges);
+    edgecountvec.resize(nedges);
+    insourcevec.resize(nedges);
+    usevectors();
+
+    const uint64_t lowk = (1ULL << (k*nbits)) - 1;  // k*nbits < 64
+    const uint64_t basemask = (1ULL << nbits) - 1;
+    std::vector<std::pair<uint64_t, index_t>> in(nedges);   // (target, first base) -> source
+    for (size_t e=0; e<nedges; ++e) {
+        const profilekey_t z = edges.keys[e];
+        const index_t from = find(z >> nbits), to = find(z & lowk);
+        if (from == npos || to == npos)
+            errx(1, "sparsedebruijn: an edge joins kmers that are not nodes");
+        const unsigned int last = z & basemask, first = z >> (k*nbits);
+        outmaskvec[(size_t)from * maskwords + last/64] |= 1ULL << (last % 64);
+        inmaskvec[(size_t)to * maskwords + first/64] |= 1ULL << (first % 64);
+        ++outstartvec[from + 1];
+        ++instartvec[to + 1];
+        outtargetvec[e] = to;
+        edgecountvec[e] = edges.counts[e];
+        in[e] = std::make_pair(((uint64_t)to << nbits) | first, from);
+    }
+    for (size_t i=0; i<nnodes; ++i) {
+        outstartvec[i+1] += outstartvec[i];
+        instartvec[i+1] += instartvec[i];
+    }
+    std::sort(in.begin(), in.end());
+    for (size_t e=0; e<nedges; ++e)
+        insourcevec[e] = in[e].second;
+}
+
+sparsedebruijn::index_t
+sparsedebruijn::find(const profilekey_t key) const
+{
+    const profilekey_t *p = std::lower_bound(keys, keys + nnodes, key);
+    return p != keys + nnodes && *p == key ? p - keys : npos;
+}
+
+std::string
+sparsedebruijn::kmer(const index_t i) const
+{
+    intbase_t ib;
+    std::string s;
+    for (unsigned int pos=0; pos<k; ++pos)
+        s += (pos > 0 ? encoder.separator() : "") + ib.int_to_base(base(i, pos));
+    return s;
+}
+
+// Written to a temporary file and renamed into place, so that other
+// processes never map a partly-written graph.
+void
+sparsedebruijn::save(const std::string& fname) const
+{
+    header_t h = {};
+    h.magic = magic;
+    h.version = version;
+    h.alphabet_size = encoder.get_alphabetsize();
+    h.nbits = nbits;
+    h.k = k;
+    h.maskwords = maskwords;
+    h.nnodes = nnodes;
+    h.nedges = nedges;
+    h.sqnorm = sqnorm;
+
+    std::string tmpfname = fname + ".tmp" + std::to_string(getpid());
+    FILE *f = fopen(tmpfname.c_str(), "w");
+    if (f == nullptr)
+        err(1, "Cannot create de Bruijn graph file %s", tmpfname.c_str());
+    const size_t nmasks = nnodes * maskwords;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(keys, sizeof(profilekey_t), nnodes, f) == nnodes &&
+              fwrite(outmasks, sizeof(uint64_t), nmasks, f) == nmasks &&
+              fwrite(inmasks, sizeof(uint64_t), nmasks, f) == nmasks &&
+              fwrite(counts, sizeof(profilecount_t), nnodes, f) == nnodes &&
+              fwrite(outstart, sizeof(index_t), nnodes + 1, f) == nnodes + 1 &&
+              fwrite(outtarget, sizeof(index_t), nedges, f) == nedges &&
+              fwrite(edgecounts, sizeof(profilecount_t), nedges, f) == nedges &&
+              fwrite(instart, sizeof(index_t), nnodes + 1, f) == nnodes + 1 &&
+              fwrite(insource, sizeof(index_t), nedges, f) == nedges;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmpfname.c_str(), fname.c_str()) < 0) {
+        unlink(tmpfname.c_str());
+        err(1, "Writing de Bruijn graph %s failed", fname.c_str());
+    }
+}
+
+bool
+sparsedebruijn::load(const std::string& fname, const bool preload)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        warn("Cannot open de Bruijn graph %s", fname.c_str());
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) err(1, "Cannot stat %s", fname.c_str());
+
+    header_t h;
+    if ((size_t)sb.st_size < sizeof(h) || pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        warnx("De Bruijn graph %s is truncated", fname.c_str());
+        close(fd);
+        return false;
+    }
+    const size_t expected = sizeof(h) +
+        h.nnodes * (sizeof(profilekey_t) + 2 * h.maskwords * sizeof(uint64_t) + sizeof(profilecount_t)) +
+        2 * (h.nnodes + 1) * sizeof(index_t) + 3 * h.nedges * sizeof(index_t);
+    if (h.magic != magic || h.version != version ||
+        h.alphabet_size != encoder.get_alphabetsize() || h.nbits != nbits ||
+        h.k != k || h.maskwords != maskwords || (size_t)sb.st_size != expected) {
+        warnx("De Bruijn graph %s is not a graph for k = %u and this alphabet", fname.c_str(), k);
+        close(fd);
+        return false;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (preload)
+        flags |= MAP_POPULATE;
+#endif
+    void *m = mmap(nullptr, sb.st_size, PROT_READ, flags, fd, 0);
+    if (m == MAP_FAILED) err(1, "Cannot map %s", fname.c_str());
+    // only a hint, so a failure does not matter
+    if (preload)
+        (void)madvise(m, sb.st_size, MADV_WILLNEED);
+    if (close(fd) < 0) err(1, "close fd for %s failed", fname.c_str());
+    if (mapped != nullptr && munmap(mapped, mappedsize) < 0)
+        err(1, "munmap of de Bruijn graph failed");
+    mapped = m;
+    mappedsize = sb.st_size;
+
+    nnodes = h.nnodes;
+    nedges = h.nedges;
+    sqnorm = h.sqnorm;
+    const char *p = (const char *)mapped + sizeof(h);
+    keys = (const profilekey_t *)p;
+    p += nnodes * sizeof(profilekey_t);
+    outmasks = (const uint64_t *)p;
+    p += nnodes * maskwords * sizeof(uint64_t);
+    inmasks = (const uint64_t *)p;
+    p += nnodes * maskwords * sizeof(uint64_t);
+    counts = (const profilecount_t *)p;
+    p += nnodes * sizeof(profilecount_t);
+    outstart = (const index_t *)p;
+    p += (nnodes + 1) * sizeof(index_t);
+    outtarget = (const index_t *)p;
+    p += nedges * sizeof(index_t);
+    edgecounts = (const profilecount_t *)p;
+    p += nedges * sizeof(profilecount_t);
+    instart = (const index_t *)p;
+    p += (nnodes + 1) * sizeof(index_t);
+    insource = (const index_t *)p;
+
+    // the vectors are not needed any more
+    std::vector<profilekey_t>().swap(keyvec);
+    std::vector<uint64_t>().swap(outmaskvec);
+    std::vector<uint64_t>().swap(inmaskvec);
+    std::vector<profilecount_t>().swap(countvec);
+    std::vector<index_t>().swap(outstartvec);
+    std::vector<index_t>().swap(outtargetvec);
+    std::vector<profilecount_t>().swap(edgecountvec);
+    std::vector<index_t>().swap(instartvec);
+    std::vector<index_t>().swap(insourcevec);
+    return true;
+}
+
+void
+sparsedebruijn::graphviz(const std::string fname, const std::string comment) const
+{
+    std::ofstream outf;
+    outf.open(fname);
+    outf << "digraph G {" << std::endl;
+    outf << "graph [fontname = \"helvetica\"];" << std::endl;
+    outf << "graph [label = \"" << comment << "\"];" << std::endl;
+    for (index_t i=0; i<nnodes; ++i)
+        outf << "  " << i << " [label=\"" << kmer(i) << " " << counts[i] << "\"];" << std::endl;
+    for (index_t i=0; i<nnodes; ++i)
+        out_edges(i, [&](const index_t j, const profilecount_t c) {
+            outf << "  " << i << " -> " << j << " [label=\"" << c << "\"];" << std::endl;
+        });
+    outf << "}"  << std::endl;
+    outf.close();
+}
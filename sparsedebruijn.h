@@ -0,0 +1,228 @@
+/*!
+ * @brief de Bruijn graph of the kmers seen in a sequence set, in flat arrays
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPARSEDEBRUIJN_H
+#define SPARSEDEBRUIJN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FastaRecord.h"
+#include "kmerencoder.h"
+#include "profilestore.h"
+
+/*! @class sparsedebruijn
+ * @brief the de Bruijn graph of a sequence set: a node for each kmer that
+ * occurs, and an edge for each (k+1)-mer that occurs, with their counts
+ *
+ * Node i is the i-th smallest kmerencoder key.  Each node has a bit mask
+ * over the alphabet of its out edges (the base shifted in at the right)
+ * and one of its in edges (the base shifted out at the left), and the
+ * targets of its edges in base order, as in a compressed sparse row
+ * matrix.  The edge for base b is at the node's first edge plus the
+ * number of mask bits below b, so successor() and predecessor() take a
+ * popcount or two, never a search.  find() is a binary search.
+ *
+ * DNA takes about 8 (key) + 4 (count) + 16 (masks) + 8 (edge starts)
+ * bytes a node, and 12 bytes an edge each way; larger alphabets need a
+ * mask word per 64 bases.  The kmers and their counts are a kmerprofile,
+ * so a graph can be handed to the kmer measures (emdmeasure in
+ * particular) as the profile of everything it was built from.
+ *
+ * The arrays are either built in memory or mapped read-only from a file
+ * written by save(); mapped pages are shared by every process using the
+ * same file.  Mapping takes the same time whatever the size of the graph,
+ * as pages are only read when first touched; a run that will visit the
+ * whole graph can ask load() to read it all in at once instead.
+ *
+ * File layout (host byte order, every section naturally aligned):
+ *   header_t
+ *   uint64 keys[nnodes]
+ *   uint64 outmasks[nnodes * maskwords]
+ *   uint64 inmasks[nnodes * maskwords]
+ *   uint32 counts[nnodes]
+ *   uint32 outstart[nnodes+1]
+ *   uint32 outtarget[nedges]
+ *   uint32 edgecounts[nedges]      (in out edge order)
+ *   uint32 instart[nnodes+1]
+ *   uint32 insource[nedges]
+ */
+class sparsedebruijn {
+public:
+    typedef uint32_t index_t;
+    static const index_t npos = UINT32_MAX;
+
+private:
+    struct header_t {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t alphabet_size;
+        uint32_t nbits;
+        uint32_t k;
+        uint32_t maskwords;
+        uint64_t nnodes;
+        uint64_t nedges;
+        uint64_t sqnorm;        //!< sum of the squared node counts
+    };
+    static const uint32_t magic = 0x47424442; // "BDBG"
+    static const uint32_t version = 1;
+
+    unsigned int k;
+    kmerencoder encoder;
+    unsigned int nbits;
+    unsigned int maskwords;     //!< 64-bit words in one node's edge mask
+
+    // in-memory storage, when built here
+    std::vector<profilekey_t> keyvec;
+    std::vector<uint64_t> outmaskvec, inmaskvec;
+    std::vector<profilecount_t> countvec;
+    std::vector<index_t> outstartvec, outtargetvec;
+    std::vector<profilecount_t> edgecountvec;
+    std::vector<index_t> instartvec, insourcevec;
+
+    // what is actually used: either the vectors above or the mapped file
+    const profilekey_t *keys = nullptr;
+    const uint64_t *outmasks = nullptr;
+    const uint64_t *inmasks = nullptr;
+    const profilecount_t *counts = nullptr;
+    const index_t *outstart = nullptr;
+    const index_t *outtarget = nullptr;
+    const profilecount_t *edgecounts = nullptr;
+    const index_t *instart = nullptr;
+    const index_t *insource = nullptr;
+    uint64_t nnodes = 0;
+    uint64_t nedges = 0;
+    uint64_t sqnorm = 0;
+    void *mapped = nullptr;
+    size_t mappedsize = 0;
+
+    void usevectors();
+    //! the number of bits set in mask row m below bit b
+    index_t rank(const uint64_t *m, const unsigned int b) const {
+        index_t r = 0;
+        for (unsigned int w=0; w<b/64; ++w)
+            r += __builtin_popcountll(m[w]);
+        if (b % 64 != 0)
+            r += __builtin_popcountll(m[b/64] & ((1ULL << (b % 64)) - 1));
+        return r;
+    };
+    bool bit(const uint64_t *m, const unsigned int b) const {
+        return (m[b/64] >> (b % 64)) & 1;
+    };
+
+public:
+    sparsedebruijn(const unsigned int k_p);
+    ~sparsedebruijn();
+    sparsedebruijn(const sparsedebruijn&) = delete;
+    sparsedebruijn& operator=(const sparsedebruijn&) = delete;
+
+    /*! @brief the graph of the kmers of seqs, counted by nthreads threads
+     * in a kmerhashtable; windows start over after characters that are not bases, as they do
+     * for the kmer measures
+     */
+    void build(const fastavec_t& seqs, const unsigned int nthreads = 1);
+    //! @brief the graph of one sequence
+    void build(const std::string& seq);
+    //! @brief the graph from sorted, distinct kmers and (k+1)-mers with their counts
+    void build(const ownedprofile& nodes, const ownedprofile& edges);
+    void save(const std::string& fname) const;
+    /*! @brief map a file written by save(); false (with a warning) if it
+     * is missing or was written for another k or alphabet.  With preload,
+     * every page is read in now rather than when it is first used.
+     */
+    bool load(const std::string& fname, const bool preload = false);
+
+    unsigned int get_k() const {
+        return k;
+    };
+    uint64_t size() const {
+        return nnodes;
+    };
+    uint64_t get_nedges() const {
+        return nedges;
+    };
+    //! @brief bytes in the arrays
+    size_t get_memory() const {
+        return nnodes * (sizeof(profilekey_t) + 2*maskwords*sizeof(uint64_t) + sizeof(profilecount_t)) +
+               2 * (nnodes + 1) * sizeof(index_t) + 3 * nedges * sizeof(index_t);
+    };
+
+    //! @brief the node for a key, or npos if the kmer does not occur
+    index_t find(const profilekey_t key) const;
+    profilekey_t key(const index_t i) const {
+        return keys[i];
+    };
+    profilecount_t count(const index_t i) const {
+        return counts[i];
+    };
+    //! @brief the base value at the left (pos 0) ... right (pos k-1) of node i
+    unsigned int base(const index_t i, const unsigned int pos) const {
+        return (keys[i] >> ((k-1-pos)*nbits)) & ((1ULL << nbits) - 1);
+    };
+    std::string kmer(const index_t i) const;
+
+    unsigned int outdegree(const index_t i) const {
+        return outstart[i+1] - outstart[i];
+    };
+    unsigned int indegree(const index_t i) const {
+        return instart[i+1] - instart[i];
+    };
+    //! @brief the node reached by shifting b in at the right, or npos if there is no such edge
+    index_t successor(const index_t i, const unsigned int b) const {
+        const uint64_t *m = outmasks + (size_t)i * maskwords;
+        return bit(m, b) ? outtarget[outstart[i] + rank(m, b)] : npos;
+    };
+    //! @brief the node that reaches i by shifting b out at the left, or npos
+    index_t predecessor(const index_t i, const unsigned int b) const {
+        const uint64_t *m = inmasks + (size_t)i * maskwords;
+        return bit(m, b) ? insource[instart[i] + rank(m, b)] : npos;
+    };
+    //! @brief how often the edge for base b out of i occurs; 0 if it does not
+    profilecount_t edgecount(const index_t i, const unsigned int b) const {
+        const uint64_t *m = outmasks + (size_t)i * maskwords;
+        return bit(m, b) ? edgecounts[outstart[i] + rank(m, b)] : 0;
+    };
+    //! @brief f(j, count) for each edge i -> j, in order of the base shifted in
+    template <typename F>
+    void out_edges(const index_t i, F f) const {
+        for (index_t e=outstart[i]; e<outstart[i+1]; ++e)
+            f(outtarget[e], edgecounts[e]);
+    };
+    //! @brief f(j) for each edge j -> i, in order of the base shifted out
+    template <typename F>
+    void in_edges(const index_t i, F f) const {
+        for (index_t e=instart[i]; e<instart[i+1]; ++e)
+            f(insource[e]);
+    };
+
+    //! @brief the kmers and their counts, valid as long as the graph is
+    kmerprofile profile() const {
+        kmerprofile p;
+        p.keys = keys;
+        p.counts = counts;
+        p.n = nnodes;
+        p.sqnorm = sqnorm;
+        return p;
+    };
+
+    void graphviz(const std::string fname, const std::string comment = "") const;
+};
+
+#endif // SPARSEDEBRUIJN_H
@@ -1,13 +1,57 @@
+// Build the complete graph for each k up to 10 and check its pointers.
+// Then give its nodes and edges frequencies, save it, and check that the
+// file maps back with every kmer and edge and their frequencies.
+
 #include "deBruijnGraph.h"
+#include "deBruijnNode.h"
+#include "sparsedebruijn.h"
+#include "testutils.h"
 #include <iostream>
+#include <unistd.h>
 
 int main()
 {
-    for (unsigned int k=2; k<14; ++k) {
+    const std::string fname = "testdebruijn.graph." + std::to_string(getpid());
+    const unsigned int alphabet_size = intbase_t().get_alphabetsize();
+    const unsigned int nbits = intbase_t().get_nbits();
+    for (unsigned int k=2; k<=10; ++k) {
         std::cout << "Making a graph of size " << k << std::endl;
         deBruijnGraph* db = new deBruijnGraph(k);
         db->make_complete_graph();
         db->consistency_check();
+
+        // frequencies that differ from node to node and edge to edge
+        kmerint ki(k);
+        for (ki.set_kmerhash(ki.begin()); ki<ki.end(); ++ki) {
+            deBruijnNode *node = db->find_node(ki, false);
+            check(node != nullptr, "a kmer of the complete graph has no node");
+            const uint64_t h = (uint64_t)ki.get_kmerhash();
+            node->set_freq(1 + h % 7);
+            for (unsigned int b=0; b<alphabet_size; ++b)
+                node->set_edgefreq(b, 1 + (h + b) % 5);
+        }
+
+        db->save(fname);
+        sparsedebruijn mapped(k);
+        check(mapped.load(fname), "cannot load the saved graph");
+        uint64_t nodes = 1;
+        for (unsigned int i=0; i<k; ++i)
+            nodes *= alphabet_size;
+        check(mapped.size() == nodes, "the saved graph does not have every kmer");
+        check(mapped.get_nedges() == nodes * alphabet_size, "the saved graph does not have every edge");
+        const uint64_t kmask = (1ULL << (k*nbits)) - 1;
+        for (ki.set_kmerhash(ki.begin()); ki<ki.end(); ++ki) {
+            const uint64_t h = (uint64_t)ki.get_kmerhash();
+            const sparsedebruijn::index_t i = mapped.find(h);
+            check(i != sparsedebruijn::npos && mapped.count(i) == 1 + h % 7,
+                  "a kmer's frequency did not survive saving");
+            for (unsigned int b=0; b<alphabet_size; ++b)
+                check(mapped.edgecount(i, b) == 1 + (h + b) % 5 &&
+                      mapped.successor(i, b) == mapped.find(((h << nbits) | b) & kmask),
+                      "an edge or its frequency did not survive saving");
+        }
+        unlink(fname.c_str());
         delete db;
     }
+    std::cout << "Complete graphs save and map back with their frequencies." << std::endl;
 }
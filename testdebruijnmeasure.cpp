@@ -0,0 +1,147 @@
+// Check the de Bruijn edge measures against the edge sets of the graphs
+// built by sparsedebruijn and against counting the (k+1)-mer text, that
+// the Jaccard distance obeys the triangle inequality, and that a row
+// gives what the pairs do.  Then time them on a sample data file.
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <random>
+#include <unistd.h>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "debruijnmeasure.h"
+#include "sparsedebruijn.h"
+#include "testutils.h"
+
+typedef std::map<std::string, unsigned int> edges_t;
+
+edges_t
+edgesof(const std::string& seq, const unsigned int k)
+{
+    edges_t edges;
+    for (size_t p=0; p+k+1<=seq.length(); ++p)
+        ++edges[seq.substr(p, k+1)];
+    return edges;
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(47);
+
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+
+    kmerencoder encoder;
+    for (unsigned int k=1; k<=8 && encoder.exact(k+1); ++k) {
+        debruijnmeasure jaccard(std::to_string(k)), weighted(std::to_string(k) + ",weighted");
+        profilestore store((kmeroptions(k+1)));
+        std::vector<std::string> seqs;
+        std::vector<ownedprofile> profiles(30);
+        for (unsigned int s=0; s<profiles.size(); ++s) {
+            // often a mutated copy of the one before
+            std::string seq;
+            if (s > 0 && rng() % 2 == 0) {
+                seq = seqs.back().substr(rng() % (seqs.back().length() + 1));
+                for (unsigned int i=rng() % 4; i>0 && seq.length()>0; --i)
+                    seq[rng() % seq.length()] = alphabet[rng() % alphabet.length()];
+            } else
+                for (unsigned int i=rng() % 60; i>0; --i)
+                    seq += alphabet[rng() % alphabet.length()];
+            seqs.push_back(seq);
+            store.calculate(seq, profiles[s]);
+
+            sparsedebruijn g(k);
+            g.build(seq);
+            check(g.get_nedges() == profiles[s].view().n, "the graph of " + seq + " has other edges");
+        }
+
+        for (unsigned int a=0; a<seqs.size(); ++a) {
+            const edges_t ea = edgesof(seqs[a], k);
+            std::vector<kmerprofile> pbs(seqs.size());
+            std::vector<kmermeasure::mergestats_t> ss(seqs.size());
+            for (unsigned int b=0; b<seqs.size(); ++b) {
+                pbs[b] = profiles[b].view();
+                ss[b] = kmermeasure::merge(profiles[a].view(), pbs[b]);
+
+                // by the text: sizes and dot products of the edge sets
+                const edges_t eb = edgesof(seqs[b], k);
+                long double shared = 0, all = eb.size(), dot = 0, sqa = 0, sqb = 0;
+                for (auto e=ea.begin(); e != ea.end(); ++e) {
+                    auto f = eb.find(e->first);
+                    sqa += (long double)e->second * e->second;
+                    if (f == eb.end()) {
+                        ++all;
+                        continue;
+                    }
+                    ++shared;
+                    dot += (long double)e->second * f->second;
+                }
+                for (auto f=eb.begin(); f != eb.end(); ++f)
+                    sqb += (long double)f->second * f->second;
+                const long double dj = all == 0 ? 0 : 1 - shared / all;
+                const long double dw = sqa + sqb - dot == 0 ? 0 : 1 - dot / (sqa + sqb - dot);
+                const std::string pair = seqs[a] + " " + seqs[b] + ", k = " + std::to_string(k);
+                check(fabsl(jaccard.fromstats(profiles[a].view(), pbs[b], ss[b], precision_exact) - dj) < 1e-12,
+                      "Jaccard distance of " + pair);
+                check(fabsl(weighted.fromstats(profiles[a].view(), pbs[b], ss[b], precision_exact) - dw) < 1e-12,
+                      "Tanimoto distance of " + pair);
+                check(a != b || jaccard.fromstats(profiles[a].view(), pbs[b], ss[b], precision_float) == 0,
+                      "a graph is not the same as itself");
+            }
+            for (debruijnmeasure *m : { &jaccard, &weighted }) {
+                std::vector<long double> row(seqs.size());
+                m->fromstatsrow(profiles[a].view(), pbs.data(), ss.data(), seqs.size(), row.data());
+                for (unsigned int b=0; b<seqs.size(); ++b)
+                    check(fabsl(row[b] - m->fromstats(profiles[a].view(), pbs[b], ss[b], precision_exact)) < 1e-15,
+                          "row and pair differ");
+            }
+        }
+
+        // the triangle inequality, which is what metric promises
+        for (unsigned int trial=0; trial<200; ++trial) {
+            unsigned int x = rng() % seqs.size(), y = rng() % seqs.size(), z = rng() % seqs.size();
+            auto d = [&](const unsigned int i, const unsigned int j) {
+                return jaccard.fromstats(profiles[i].view(), profiles[j].view(),
+                                         kmermeasure::merge(profiles[i].view(), profiles[j].view()),
+                                         precision_exact);
+            };
+            check(d(x, z) <= d(x, y) + d(y, z) + 1e-12, "Jaccard distance breaks the triangle inequality");
+        }
+    }
+    std::cout << "The edge distances match the graphs' edge sets." << std::endl;
+
+    const char *sample = "data/AF091148.short.fasta";
+    if (access(sample, R_OK) != 0) {
+        std::cout << "No " << sample << " (run from the top directory); skipping the timing." << std::endl;
+        return 0;
+    }
+    fastavec_t seqs = readfastafile(sample);
+    for (unsigned int k : { 7, 15, 30 }) {
+        if (!encoder.exact(k+1))
+            break;
+        for (const char *mode : { "", ",weighted" }) {
+            debruijnmeasure m(std::to_string(k) + mode);
+            m.init(seqs);
+            auto start = std::chrono::steady_clock::now();
+            long double total = 0;
+            uint64_t pairs = 0;
+            for (unsigned int i=0; i<seqs.size(); ++i)
+                for (unsigned int j=i+1; j<seqs.size(); ++j, ++pairs)
+                    total += m.compare(seqs[i], seqs[j]);
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "k = " << k << (mode[0] ? mode : ",jaccard") << ": " << elapsed.count() / pairs
+                      << "us a pair, mean distance " << total / pairs << std::endl;
+        }
+    }
+
+    std::cout << "All de Bruijn measure tests completed successfully." << std::endl;
+}
@@ -9,10 +9,11 @@ int main()
     bool verbose = true;
     log4cxx::BasicConfigurator::configure();
 
-    for (unsigned int k=kmer::min_k; k<kmer::max_k; ++k) {
-        std::string kmer("");
+    intbase_t ib;
+    for (unsigned int k=kmer::min_k; k<kmerint::get_max_k(); ++k) {
+        sequence_t kmer;
         for (unsigned int i=0; i<k; ++i)
-            kmer += intbase::int_to_base(i % alphabet_size);
+            kmer.push_back(ib.int_to_base(i % ib.get_alphabetsize()));
         if (verbose) std::cout << "test kmer is '" << kmer << "'" << std::endl;
 
         std::cout << "Making a node with k = " << k << std::endl;
@@ -1,4 +1,32 @@
 #include "distancematrix.h"
+#include "testutils.h"
+
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// a distance for each pair that tells the cells apart
+long double
+pairdistance(const unsigned int i, const unsigned int j)
+{
+    return i * 1000.0L + j + 0.25L;
+}
+
+// whether f() exits with status 1 (errx), run in a child so that the
+// test carries on
+template <class F>
+bool
+fails(F f)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        f();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 1;
+}
 
 int
 main(int argc, char *argv[])
@@ -13,7 +41,7 @@ main(int argc, char *argv[])
         for (j=i; j<size; ++j) {
 	    d.set(i, j, (long double) k++);
 	}
-    
+
     d.print();
 
     // Other errors to test
@@ -22,4 +50,54 @@ main(int argc, char *argv[])
     //d.set(size, size, 0.0);
     //d.set(2, 1, 0.0);
     //d.set(2, 0-1, 0.0);
+
+    // Extending a matrix of the first oldsize sequences and filling in the
+    // new cells gives the matrix calculated from scratch.
+    const unsigned int oldsize = 6;
+    {
+        distancematrix old(oldsize, "DMtest.old");
+        for (i=0; i<oldsize; ++i)
+            for (j=i; j<oldsize; ++j)
+                old.set(i, j, pairdistance(i, j));
+    }
+    {
+        distancematrix extended(size, "DMtest.extended", "DMtest.old", oldsize);
+        distancematrix full(size, "DMtest.full");
+        for (i=0; i<size; ++i)
+            for (j=i; j<size; ++j) {
+                if (j >= oldsize)
+                    extended.set(i, j, pairdistance(i, j));
+                full.set(i, j, pairdistance(i, j));
+            }
+        for (i=0; i<size; ++i)
+            for (j=i; j<size; ++j)
+                check(extended.get(i, j) == full.get(i, j),
+                      "cell " + std::to_string(i) + ", " + std::to_string(j) + " of the extended matrix");
+    }
+    std::cout << "An extended matrix is the matrix calculated from scratch." << std::endl;
+
+    // Extending into the old file (by any name) would truncate it before
+    // the copy; an old matrix of the wrong size has the wrong sequences.
+    check(fails([]() { distancematrix d(size, "DMtest.old", "DMtest.old", oldsize); }),
+          "extending a matrix into itself");
+    check(link("DMtest.old", "DMtest.link") == 0, "linking DMtest.old");
+    check(fails([]() { distancematrix d(size, "DMtest.link", "./DMtest.old", oldsize); }),
+          "extending a matrix into another name for it");
+    check(fails([]() { distancematrix d(size, "DMtest.short", "DMtest.old", oldsize - 1); }),
+          "extending a matrix with more rows than its ids say");
+    {
+        distancematrix old("DMtest.old");
+        check(old.get_size() == oldsize, "the refused extensions changed the old matrix's size");
+        for (i=0; i<oldsize; ++i)
+            for (j=i; j<oldsize; ++j)
+                check(old.get(i, j) == pairdistance(i, j), "the refused extensions changed the old matrix");
+    }
+    std::cout << "Extending a matrix into itself or with the wrong size is refused." << std::endl;
+
+    unlink("DMtest.old");
+    unlink("DMtest.link");
+    unlink("DMtest.extended");
+    unlink("DMtest.full");
+    unlink("DMtest.short");
+    std::cout << "All distance matrix tests completed successfully." << std::endl;
 }
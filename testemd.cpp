@@ -0,0 +1,237 @@
+// Check the network simplex against successive shortest paths, and the
+// de Bruijn earth mover's distance through hubs against the same problem
+// with every pair of kmers as an arc.  Then check that the Sinkhorn
+// approximation stays within its error bound of the exact distance on a
+// sample data file, and time the two.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <unistd.h>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "emdmeasure.h"
+#include "networksimplex.h"
+#include "testutils.h"
+
+struct arc_t {
+    unsigned int from, to;
+    int64_t cost;
+};
+
+// minimum cost flow by successive shortest paths (Bellman-Ford on the
+// residual network); slow, but nothing like the network simplex
+int64_t
+shortestpaths(const unsigned int n, const std::vector<arc_t>& arcs, std::vector<int64_t> supply)
+{
+    const int64_t inf = std::numeric_limits<int64_t>::max() / 4;
+    std::vector<int64_t> flow(arcs.size(), 0);
+    int64_t total = 0;
+    while (true) {
+        unsigned int s = 0;
+        while (s < n && supply[s] <= 0)
+            ++s;
+        if (s == n)
+            return total;
+        std::vector<int64_t> dist(n, inf);
+        std::vector<int> via(n, -1);     // arc number, negated less one for a reverse arc
+        dist[s] = 0;
+        for (unsigned int round=0; round<n; ++round)
+            for (unsigned int a=0; a<arcs.size(); ++a) {
+                if (dist[arcs[a].from] < inf && dist[arcs[a].from] + arcs[a].cost < dist[arcs[a].to]) {
+                    dist[arcs[a].to] = dist[arcs[a].from] + arcs[a].cost;
+                    via[arcs[a].to] = a;
+                }
+                if (flow[a] > 0 && dist[arcs[a].to] < inf &&
+                    dist[arcs[a].to] - arcs[a].cost < dist[arcs[a].from]) {
+                    dist[arcs[a].from] = dist[arcs[a].to] - arcs[a].cost;
+                    via[arcs[a].from] = -(int)a - 1;
+                }
+            }
+        unsigned int t = n;
+        for (unsigned int u=0; u<n; ++u)
+            if (supply[u] < 0 && dist[u] < inf && (t == n || dist[u] < dist[t]))
+                t = u;
+        check(t != n, "shortest paths found no demand to meet");
+        int64_t amount = std::min(supply[s], -supply[t]);
+        for (unsigned int u=t; u != s; ) {
+            int a = via[u];
+            if (a < 0)
+                amount = std::min(amount, flow[-a - 1]);
+            u = a >= 0 ? arcs[a].from : arcs[-a - 1].to;
+        }
+        for (unsigned int u=t; u != s; ) {
+            int a = via[u];
+            if (a >= 0)
+                flow[a] += amount;
+            else
+                flow[-a - 1] -= amount;
+            u = a >= 0 ? arcs[a].from : arcs[-a - 1].to;
+        }
+        total += amount * dist[t];
+        supply[s] -= amount;
+        supply[t] += amount;
+    }
+}
+
+// k less the longest suffix of u that is a prefix of v; bases most significant first
+unsigned int
+shift(const std::vector<unsigned int>& u, const std::vector<unsigned int>& v)
+{
+    const unsigned int k = u.size();
+    for (unsigned int l=k; l>0; --l)
+        if (std::equal(u.end() - l, u.end(), v.begin()))
+            return k - l;
+    return k;
+}
+
+std::vector<unsigned int>
+bases(profilekey_t key, const unsigned int k, const unsigned int nbits)
+{
+    std::vector<unsigned int> b(k);
+    for (unsigned int i=k; i>0; --i) {
+        b[i-1] = key & ((1ULL << nbits) - 1);
+        key >>= nbits;
+    }
+    return b;
+}
+
+// the earth mover's distance with an arc for every pair of kmers
+long double
+denseemd(const kmerprofile& pa, const kmerprofile& pb, const unsigned int k, const unsigned int nbits)
+{
+    uint64_t ta = 0, tb = 0;
+    for (size_t i=0; i<pa.n; ++i)
+        ta += pa.counts[i];
+    for (size_t j=0; j<pb.n; ++j)
+        tb += pb.counts[j];
+    if (ta == 0 || tb == 0)
+        return ta == tb ? 0 : 1;
+    networksimplex solver;
+    solver.reset(pa.n + pb.n);
+    for (size_t i=0; i<pa.n; ++i)
+        solver.set_supply(i, pa.counts[i] * tb);
+    for (size_t j=0; j<pb.n; ++j)
+        solver.set_supply(pa.n + j, -(int64_t)(pb.counts[j] * ta));
+    for (size_t i=0; i<pa.n; ++i)
+        for (size_t j=0; j<pb.n; ++j) {
+            std::vector<unsigned int> u = bases(pa.keys[i], k, nbits), v = bases(pb.keys[j], k, nbits);
+            solver.addarc(i, pa.n + j, std::min(shift(u, v), shift(v, u)));
+        }
+    return (long double)solver.solve() / ((long double)ta * tb) / k;
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(11);
+
+    // random networks, with some nodes passing flow through
+    for (unsigned int trial=0; trial<300; ++trial) {
+        unsigned int n = 2 + rng() % 9;
+        std::vector<int64_t> supply(n, 0);
+        for (unsigned int m=0; m<n/2; ++m) {
+            int64_t amount = rng() % 20;
+            supply[rng() % n] += amount;
+            supply[rng() % n] -= amount;
+        }
+        std::vector<arc_t> arcs;
+        networksimplex solver;
+        solver.reset(n);
+        for (unsigned int u=0; u<n; ++u) {
+            solver.set_supply(u, supply[u]);
+            // a path through every node so the demands can always be met
+            unsigned int v = (u + 1) % n;
+            arcs.push_back(arc_t{u, v, 50});
+            arcs.push_back(arc_t{v, u, 50});
+        }
+        for (unsigned int e=rng() % (3*n); e>0; --e) {
+            unsigned int u = rng() % n, v = rng() % n;
+            if (u != v)
+                arcs.push_back(arc_t{u, v, (int64_t)(rng() % 10)});
+        }
+        for (auto a=arcs.begin(); a != arcs.end(); ++a)
+            solver.addarc(a->from, a->to, a->cost);
+        check(solver.solve() == shortestpaths(n, arcs, supply),
+              "network simplex and shortest paths differ, trial " + std::to_string(trial));
+    }
+    std::cout << "The network simplex matches successive shortest paths." << std::endl;
+
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+    kmerencoder encoder;
+    for (unsigned int k=1; k<=6 && encoder.exact(k); ++k) {
+        emdmeasure emd(std::to_string(k));
+        profilestore store((kmeroptions(k)));
+        for (unsigned int trial=0; trial<40; ++trial) {
+            // the second sequence is often a mutated copy of the first
+            std::string sa, sb;
+            for (unsigned int i=rng() % 40; i>0; --i)
+                sa += alphabet[rng() % alphabet.length()];
+            sb = sa.substr(rng() % (sa.length() + 1));
+            for (unsigned int i=rng() % 4; i>0 && sb.length()>0; --i)
+                sb[rng() % sb.length()] = alphabet[rng() % alphabet.length()];
+            if (trial % 4 == 0)
+                for (unsigned int i=rng() % 30; i>0; --i)
+                    sb += alphabet[rng() % alphabet.length()];
+            ownedprofile a, b;
+            store.calculate(sa, a);
+            store.calculate(sb, b);
+            kmermeasure::mergestats_t s = kmermeasure::merge(a.view(), b.view());
+            long double hubs = emd.fromstats(a.view(), b.view(), s, precision_exact);
+            long double dense = denseemd(a.view(), b.view(), k, encoder.get_nbits());
+            check(fabsl(hubs - dense) < 1e-15, "hub and dense emd differ for k = " + std::to_string(k) +
+                  ": " + sa + " " + sb);
+            check(hubs == emd.fromstats(b.view(), a.view(), s, precision_exact),
+                  "emd is not symmetric for " + sa + " " + sb);
+            long double row;
+            kmerprofile pb = b.view();
+            emd.fromstatsrow(a.view(), &pb, &s, 1, &row);
+            check(row == hubs, "emd row and pair differ");
+        }
+    }
+    std::cout << "The earth mover's distance through hubs matches every pair of kmers." << std::endl;
+
+    const char *sample = "data/AF091148.short.fasta";
+    if (access(sample, R_OK) != 0) {
+        std::cout << "No " << sample << " (run from the top directory); skipping the approximation." << std::endl;
+        return 0;
+    }
+    fastavec_t seqs = readfastafile(sample);
+    for (unsigned int k : { 3, 5, 7 }) {
+        std::vector<long double> exact;
+        std::cout << "k = " << k << std::endl << "  mode           ms/pair   bound  largest error" << std::endl;
+        for (const char *mode : { "", ",sinkhorn=0.1", ",sinkhorn", ",sinkhorn=0.02" }) {
+            emdmeasure emd(std::to_string(k) + mode);
+            emd.init(seqs);
+            std::vector<long double> d;
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int i=0; i<seqs.size(); ++i)
+                for (unsigned int j=i+1; j<seqs.size(); ++j)
+                    d.push_back(emd.compare(seqs[i], seqs[j]));
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (exact.empty())
+                exact = d;
+            long double worst = 0;
+            for (size_t p=0; p<d.size(); ++p)
+                worst = std::max(worst, fabsl(d[p] - exact[p]));
+            std::cout << "  " << std::setw(14) << std::left << (mode[0] ? mode + 1 : "exact") << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(8) << elapsed.count() / d.size()
+                      << std::setprecision(4) << std::setw(8) << (double)emd.get_maxerror()
+                      << std::setw(15) << (double)worst << std::endl;
+            check(worst <= emd.get_maxerror() + 1e-12, std::string("sinkhorn outside its bound for ") + mode);
+        }
+    }
+    std::cout << "The Sinkhorn distances are within their bounds of the exact ones." << std::endl;
+
+    std::cout << "All emd tests completed successfully." << std::endl;
+}
@@ -0,0 +1,82 @@
+// Check the computed edges of the implicit de Bruijn graph against
+// shifting the kmer text, its counts against counting the kmers of the
+// text, and show what the graph costs as k grows.
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "implicitdebruijn.h"
+#include "testutils.h"
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(43);
+
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+
+    for (unsigned int k=1; k<=6; ++k) {
+        implicitdebruijn<> g(k);
+        if (g.get_nnodes() > 100000)
+            break;
+        g.consistency_check();
+        for (implicitdebruijn<>::node_t x=0; x<g.get_nnodes(); ++x) {
+            const std::string s = g.kmer(x);
+            check(s.length() == k, "kmer " + s + " is not k long");
+            g.out_edges(x, [&](const implicitdebruijn<>::node_t y, const unsigned int b) {
+                check(g.kmer(y) == s.substr(1) + alphabet[b], "successor of " + s);
+            });
+            g.in_edges(x, [&](const implicitdebruijn<>::node_t w, const unsigned int b) {
+                check(g.kmer(w) == alphabet[b] + s.substr(0, k-1), "predecessor of " + s);
+            });
+            check(g.node(g.key(x)) == x, "node and key do not match for " + s);
+        }
+
+        // counts against counting the text, with a break in the sequence
+        std::string seq;
+        for (unsigned int i=200; i>0; --i)
+            seq += alphabet[rng() % alphabet.length()];
+        seq[100] = 'N';
+        g.add(seq);
+        std::map<std::string, unsigned int> textcounts;
+        for (size_t p=0; p+k<=seq.length(); ++p)
+            if (seq.substr(p, k).find('N') == std::string::npos)
+                ++textcounts[seq.substr(p, k)];
+        for (implicitdebruijn<>::node_t x=0; x<g.get_nnodes(); ++x) {
+            auto t = textcounts.find(g.kmer(x));
+            check(g.count(x) == (t == textcounts.end() ? 0 : t->second), "count of " + g.kmer(x));
+        }
+        g.observed_edges([&](const implicitdebruijn<>::node_t x, const implicitdebruijn<>::node_t y) {
+            check(g.count(x) != 0 && g.count(y) != 0 && g.kmer(x).substr(1) == g.kmer(y).substr(0, k-1),
+                  "observed edge " + g.kmer(x) + " -> " + g.kmer(y));
+        });
+
+        g.set_flag(3);
+        check(g.flag(3) && !g.flag(2), "flags");
+        g.set_flag(3, false);
+        check(!g.flag(3), "flag cleared");
+    }
+    std::cout << "The computed edges and counts match the kmer text." << std::endl;
+
+    implicitdebruijn<uint8_t> small(1);
+    for (unsigned int i=0; i<300; ++i)
+        small.increment(0);
+    check(small.count(0) == 255, "counts do not saturate");
+
+    for (unsigned int k=8; k<=14; k += 2) {
+        implicitdebruijn<> g(k);
+        std::cout << "k = " << k << ": " << g.get_nnodes() << " nodes in "
+                  << g.get_memory() / (1024*1024) << "MB" << std::endl;
+    }
+
+    std::cout << "All implicit de Bruijn graph tests completed successfully." << std::endl;
+}
@@ -0,0 +1,137 @@
+// Check that the intersection kernels agree, then time them as one
+// profile grows against a read-sized one to show where galloping wins.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "intersect.h"
+
+// a profile of n distinct keys, about shared of them taken from other
+ownedprofile
+makeprofile(std::mt19937_64& rng, const size_t n, const ownedprofile* other, const double shared)
+{
+    std::vector<profilekey_t> keys;
+    std::uniform_real_distribution<double> coin(0, 1);
+    for (size_t i=0; i<n; ++i) {
+        if (other != nullptr && !other->keys.empty() && coin(rng) < shared)
+            keys.push_back(other->keys[rng() % other->keys.size()]);
+        else
+            keys.push_back(rng() >> 16);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    ownedprofile p;
+    p.keys = keys;
+    for (size_t i=0; i<keys.size(); ++i) {
+        p.counts.push_back(1 + rng() % 5);
+        p.sqnorm += (uint64_t)p.counts.back() * p.counts.back();
+    }
+    return p;
+}
+
+void
+check(const overlap_t<>& got, const overlap_t<>& expected, const std::string& what)
+{
+    if (got.dot != expected.dot || got.shared != expected.shared) {
+        std::cerr << "FAILED: " << what << " gave " << got.dot << "/" << got.shared
+                  << " instead of " << expected.dot << "/" << expected.shared << std::endl;
+        abort();
+    }
+}
+
+// sum of squared count differences, walking both profiles
+uint64_t
+sqdiffwalk(const kmerprofile& a, const kmerprofile& b)
+{
+    uint64_t sum = 0;
+    size_t i = 0, j = 0;
+    while (i < a.n || j < b.n) {
+        int64_t t;
+        if (j == b.n || (i < a.n && a.keys[i] < b.keys[j]))
+            t = a.counts[i++];
+        else if (i == a.n || b.keys[j] < a.keys[i])
+            t = b.counts[j++];
+        else
+            t = (int64_t)a.counts[i++] - b.counts[j++];
+        sum += t*t;
+    }
+    return sum;
+}
+
+// nanoseconds per call of kernel(a, b), over enough calls to measure
+template <class F>
+double
+timekernel(F kernel, const kmerprofile& a, const kmerprofile& b, uint64_t& sink)
+{
+    unsigned int reps = std::max((size_t)1, (size_t)2000000 / (a.n + b.n + 1));
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int r=0; r<reps; ++r)
+        sink += kernel(a, b).dot;
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / reps;
+}
+
+int main()
+{
+    std::mt19937_64 rng(7);
+
+    const size_t sizes[] = { 0, 1, 3, 4, 5, 17, 250, 1000, 30000 };
+    const double fractions[] = { 0, 0.1, 0.5, 1 };
+    for (size_t na : sizes) {
+        for (size_t nb : sizes) {
+            for (double f : fractions) {
+                ownedprofile a = makeprofile(rng, na, nullptr, 0);
+                ownedprofile b = makeprofile(rng, nb, &a, f);
+                kmerprofile va = a.view(), vb = b.view();
+                overlap_t<> expected = overlaplinear(va, vb);
+                std::string what = std::to_string(na) + " x " + std::to_string(nb);
+                check(overlapblock(va, vb), expected, "block " + what);
+                check(overlapblock(vb, va), expected, "block " + what);
+                check(overlapgallop(va, vb), expected, "gallop " + what);
+                check(overlapgallop(vb, va), expected, "gallop " + what);
+                check(overlap(va, vb), expected, "overlap " + what);
+                // Euclidean from the norms is the Euclidean of the counts
+                if (va.sqnorm + vb.sqnorm - 2*expected.dot != sqdiffwalk(va, vb)) {
+                    std::cerr << "FAILED: squared distance from the norms for " << what << std::endl;
+                    abort();
+                }
+            }
+        }
+    }
+    std::cout << "The intersection kernels agree, and give the exact squared distance." << std::endl;
+
+    // a 250 bp read against ever longer traces; half the read's kmers
+    // are in the trace
+    uint64_t sink = 0;
+    size_t crossover = 0;
+    std::cout << "  small    large  ratio   linear ns    block ns   gallop ns" << std::endl;
+    for (size_t nl=250; nl<=4000000; nl *= 2) {
+        ownedprofile large = makeprofile(rng, nl, nullptr, 0);
+        ownedprofile small = makeprofile(rng, 250, &large, 0.5);
+        kmerprofile vs = small.view(), vl = large.view();
+        double tl = timekernel([](const kmerprofile& x, const kmerprofile& y) {
+                                   return overlaplinear(x, y);
+                               }, vs, vl, sink);
+        double tb = timekernel([](const kmerprofile& x, const kmerprofile& y) {
+                                   return overlapblock(x, y);
+                               }, vs, vl, sink);
+        double tg = timekernel([](const kmerprofile& x, const kmerprofile& y) {
+                                   return overlapgallop(x, y);
+                               }, vs, vl, sink);
+        size_t ratio = vl.n / std::max((size_t)1, vs.n);
+        std::cout << std::setw(7) << vs.n << std::setw(9) << vl.n << std::setw(7) << ratio
+                  << std::fixed << std::setprecision(0) << std::setw(12) << tl
+                  << std::setw(12) << tb << std::setw(12) << tg << std::endl;
+        if (crossover == 0 && tg < std::min(tl, tb))
+            crossover = ratio;
+    }
+    std::cout << "Galloping is fastest from a size ratio of about " << crossover
+              << "; overlap() switches at " << gallopratio << "." << std::endl;
+    // keep the timed calls from being optimised away
+    if (sink == 42)
+        std::cout << std::endl;
+}
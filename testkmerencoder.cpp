@@ -0,0 +1,154 @@
+// Check that malformed kmer options are refused, that the multi-k, canonical
+// and spaced seed keys agree with single-k keys of the same bases, and that
+// keys counted in overlapping chunks are the keys of the whole sequence.
+
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "kmerencoder.h"
+#include "testutils.h"
+
+// a random sequence over the intbase_t alphabet, with the occasional N
+std::string
+randomseq(std::mt19937& rng, const unsigned int len)
+{
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+    std::string seq;
+    for (unsigned int i=0; i<len; ++i)
+        seq += rng() % 50 == 0 ? 'N' : alphabet[rng() % alphabet.length()];
+    return seq;
+}
+
+std::string
+revcomp(const std::string& seq)
+{
+    std::string rc(seq.rbegin(), seq.rend());
+    for (auto c=rc.begin(); c != rc.end(); ++c) {
+        switch (*c) {
+        case 'A': *c = 'T'; break;
+        case 'C': *c = 'G'; break;
+        case 'G': *c = 'C'; break;
+        case 'T': *c = 'A'; break;
+        }
+    }
+    return rc;
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+
+    // options are refused rather than misread
+    const char *bad[] = { "", "x", "0", "7,bogus", "seed=0110", "seed=1101,seed=11",
+                          "7,seed=101", "seed=101,hash" };
+    for (const char *opt : bad) {
+        bool threw = false;
+        try {
+            kmeroptions::parse(opt);
+        } catch (std::invalid_argument& e) {
+            threw = true;
+        }
+        check(threw, std::string("option '") + opt + "' was accepted");
+    }
+    check(kmeroptions::parse("7,canonical").str() == "7,canonical", "str of 7,canonical");
+    check(kmeroptions::parse("40,hash").str() == "40,hash", "str of 40,hash");
+    kmerencoder enc;
+    std::mt19937 rng(42);
+    std::string seq = randomseq(rng, 2000);
+    unsigned int kmax = 64 / enc.get_nbits();
+    bool dna = enc.get_alphabetsize() == 4;
+
+    // the one-pass multi-k keys are the single-k keys
+    std::vector<kmeroptions> os;
+    for (unsigned int k=1; k<=kmax+2; ++k) {
+        os.push_back(kmeroptions(k));
+        if (dna) {
+            os.push_back(kmeroptions(k));
+            os.back().canonical = true;
+        }
+    }
+    std::vector<std::vector<profilekey_t>> multi;
+    enc.kmers(seq, os, multi);
+    for (unsigned int i=0; i<os.size(); ++i) {
+        std::vector<profilekey_t> single;
+        enc.kmers(seq, os[i], single);
+        check(single == multi[i], "multi-k keys for " + os[i].str());
+    }
+    std::cout << "Multi-k keys match single-k keys." << std::endl;
+
+    // canonical kmers of a sequence and of its reverse complement are the same
+    if (dna) {
+        for (unsigned int k=1; k<=kmax+40; ++k) {
+            kmeroptions o(k);
+            o.canonical = true;
+            for (int hashed=0; hashed<2; ++hashed) {
+                o.hashed = hashed;
+                std::vector<profilekey_t> fwd, rev;
+                enc.kmers(seq, o, fwd);
+                enc.kmers(revcomp(seq), o, rev);
+                std::sort(fwd.begin(), fwd.end());
+                std::sort(rev.begin(), rev.end());
+                check(fwd == rev, "canonical keys for " + o.str());
+            }
+        }
+        std::cout << "Canonical keys are strand independent." << std::endl;
+    }
+
+    // a spaced seed key is the contiguous key of the bases the seed keeps
+    const char *seeds[] = { "1101101", "11011", "1000000001", "111" };
+    for (const char *seed : seeds) {
+        kmeroptions o = kmeroptions::parse(std::string("seed=") + seed);
+        unsigned int span = o.k, w = kmeroptions::weight(seed);
+        std::vector<profilekey_t> keys;
+        enc.kmers(seq, o, keys);
+
+        std::vector<profilekey_t> expected;
+        for (unsigned int i=0; i+span<=seq.length(); ++i) {
+            std::string window = seq.substr(i, span);
+            if (window.find('N') != std::string::npos)
+                continue;
+            std::string kept;
+            for (unsigned int j=0; j<span; ++j)
+                if (seed[j] == '1')
+                    kept += window[j];
+            enc.kmers(kept, kmeroptions(w), expected);
+        }
+        check(keys == expected, std::string("seed ") + seed);
+    }
+    std::cout << "Spaced seed keys match the kept bases." << std::endl;
+
+    // counting in chunks that overlap by k-1 sees each kmer exactly once
+    std::vector<kmeroptions> chunkos = { kmeroptions(3), kmeroptions(kmax), kmeroptions(kmax+5),
+                                         kmeroptions::parse("seed=1101101,seed=1011011") };
+    chunkos[0].hashed = true;
+    for (const kmeroptions& o : chunkos) {
+        std::vector<profilekey_t> whole, chunked;
+        enc.kmers(seq, o, whole);
+        for (size_t chunklen : { 1, 7, 333, 1999 }) {
+            chunked.clear();
+            for (size_t start=0; start<seq.length(); start += chunklen)
+                enc.kmers(seq.substr(start, chunklen + o.k - 1), o, chunked, chunklen);
+            check(chunked == whole, "chunked keys for " + o.str());
+        }
+    }
+    std::vector<std::vector<profilekey_t>> chunkedmulti(os.size());
+    for (size_t start=0; start<seq.length(); start += 100) {
+        std::vector<std::vector<profilekey_t>> part;
+        enc.kmers(seq.substr(start, 100 + kmax + 1), os, part, 100);
+        for (unsigned int i=0; i<os.size(); ++i)
+            chunkedmulti[i].insert(chunkedmulti[i].end(), part[i].begin(), part[i].end());
+    }
+    check(chunkedmulti == multi, "chunked multi-k keys");
+    std::cout << "Chunked keys match whole-sequence keys." << std::endl;
+
+    std::cout << "All kmerencoder tests completed successfully." << std::endl;
+}
@@ -0,0 +1,203 @@
+// Check that a sequence over an alphabet of words, such as the x86
+// operators, is read a word at a time: case and the amount of white space
+// do not matter, a word that is not a base starts the window over, exact
+// keys pack the base values, counting in pieces sees each kmer once, and a
+// FASTA file whose lines end mid-sequence reads the same.  Then measure
+// the collision rate of hashed kmers: the number of distinct kmers that
+// share a key with some other kmer.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "kmerencoder.h"
+#include "FastaRecord.h"
+#include "testutils.h"
+
+// Random sequences are the easy case; the repeats (copies of a short
+// unit with the occasional change) are closer to real traces.
+std::vector<unsigned int>
+makeseq(std::mt19937& rng, const unsigned int alphabet_size, const unsigned int len,
+        const bool repetitive)
+{
+    std::vector<unsigned int> seq;
+    if (!repetitive) {
+        for (unsigned int i=0; i<len; ++i)
+            seq.push_back(rng() % alphabet_size);
+        return seq;
+    }
+    std::vector<unsigned int> unit;
+    for (unsigned int i=0; i<37; ++i)
+        unit.push_back(rng() % alphabet_size);
+    while (seq.size() < len) {
+        seq.insert(seq.end(), unit.begin(), unit.end());
+        unit[rng() % unit.size()] = rng() % alphabet_size;
+    }
+    seq.resize(len);
+    return seq;
+}
+
+// the text of the bases, as the encoder reads it
+std::string
+text(const kmerencoder& enc, std::vector<unsigned int>::const_iterator first,
+     std::vector<unsigned int>::const_iterator last)
+{
+    intbase_t ib;
+    std::string s;
+    for (auto v=first; v != last; ++v)
+        s += (v != first ? enc.separator() : "") + ib.int_to_base(*v);
+    return s;
+}
+
+std::string
+text(const kmerencoder& enc, const std::vector<unsigned int>& seq)
+{
+    return text(enc, seq.begin(), seq.end());
+}
+
+// keys of o for the concatenated pieces of seq cut for nstarts starts
+std::vector<profilekey_t>
+piecekeys(const kmerencoder& enc, const std::string& seq, const kmeroptions& o, const size_t nstarts)
+{
+    std::vector<profilekey_t> keys;
+    const std::vector<std::pair<size_t, size_t>> pieces = enc.pieces(seq, nstarts, o.k);
+    for (auto p=pieces.begin(); p != pieces.end(); ++p)
+        enc.kmers(seq.substr(p->first, p->second), o, keys, nstarts);
+    return keys;
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+
+    intbase_t ib;
+    kmerencoder enc;
+    std::mt19937 rng(1);
+    const unsigned int alphabet_size = enc.get_alphabetsize();
+
+    if (!enc.separator().empty()) {
+        const std::vector<unsigned int> seq = makeseq(rng, alphabet_size, 2000, false);
+        const std::string plain = text(enc, seq);
+        check(enc.symbols(plain) == seq.size(), "the number of words in a sequence");
+
+        // lower case, tabs, runs of spaces and leading and trailing space
+        std::string messy = "  ";
+        for (unsigned int i=0; i<seq.size(); ++i) {
+            base_t b = ib.int_to_base(seq[i]);
+            if (i % 3 == 0)
+                std::transform(b.begin(), b.end(), b.begin(), ::tolower);
+            messy += b + (i % 5 == 0 ? "\t " : i % 7 == 0 ? "\n" : " ");
+        }
+        for (unsigned int k : { 2, 6, 7, 20 }) {
+            std::vector<profilekey_t> a, b;
+            enc.kmers(plain, kmeroptions(k), a);
+            enc.kmers(messy, kmeroptions(k), b);
+            check(a.size() == seq.size() - k + 1 && a == b,
+                  "case and white space change the keys for k = " + std::to_string(k));
+        }
+
+        // exact keys are the base values, first base highest
+        const unsigned int k = 3;
+        std::vector<profilekey_t> keys;
+        enc.kmers(plain, kmeroptions(k), keys);
+        for (unsigned int i=0; i+k<=seq.size(); ++i) {
+            profilekey_t key = 0;
+            for (unsigned int j=0; j<k; ++j)
+                key = (key << enc.get_nbits()) | seq[i+j];
+            check(keys[i] == key, "the exact key of kmer " + std::to_string(i));
+        }
+
+        // a word that is not a base breaks the sequence in two
+        for (unsigned int k : { 3, 16 }) {
+            std::vector<profilekey_t> whole, halves;
+            enc.kmers(text(enc, seq.begin(), seq.begin() + 1000) + " NOSUCHOP " +
+                      text(enc, seq.begin() + 1000, seq.end()), kmeroptions(k), whole);
+            enc.kmers(text(enc, seq.begin(), seq.begin() + 1000), kmeroptions(k), halves);
+            enc.kmers(text(enc, seq.begin() + 1000, seq.end()), kmeroptions(k), halves);
+            check(whole == halves, "a word that is not a base for k = " + std::to_string(k));
+        }
+
+        // counting in pieces, from a word each to more than all of them
+        for (unsigned int k : { 2, 3, 16, 64 }) {
+            std::vector<profilekey_t> whole;
+            enc.kmers(messy, kmeroptions(k), whole);
+            for (size_t nstarts : { 1, 2, 63, 64, 500, 5000 })
+                check(piecekeys(enc, messy, kmeroptions(k), nstarts) == whole,
+                      "counting in pieces of " + std::to_string(nstarts) + " for k = " + std::to_string(k));
+        }
+
+        // a FASTA record whose lines end mid-sequence
+        const std::string fname = "testkmerhash.fasta." + std::to_string(getpid());
+        {
+            std::ofstream f(fname);
+            f << ">trace" << std::endl;
+            for (unsigned int i=0; i<seq.size(); i += 16)
+                f << text(enc, seq.begin() + i, seq.begin() + std::min(i + 16, (unsigned int)seq.size()))
+                  << std::endl;
+            f << ">vector\nCVTDQ2PD  cvtdq2pd\tMOV" << std::endl;
+        }
+        fastavec_t records = readfastafile(fname);
+        unlink(fname.c_str());
+        check(records.size() == 2 && records[0].get_seq() == plain, "reading a trace from a FASTA file");
+        std::vector<profilekey_t> vkeys;
+        enc.kmers(records[1].get_seq(), kmeroptions(2), vkeys);
+        check(vkeys.size() == 2 && enc.symbols(records[1].get_seq()) == 3,
+              "reading operators with digits in them from a FASTA file");
+        std::cout << "Sequences of words are read a word at a time." << std::endl;
+    }
+
+    const unsigned int len = 1000000;
+    const unsigned int ks[] = { 8, 16, 24, 32, 48, 64, 100, 200 };
+    bool failed = false;
+
+    std::cout << "kind        k   distinct kmers  colliding  rate" << std::endl;
+    for (int repetitive=0; repetitive<2; ++repetitive) {
+        const std::vector<unsigned int> seq = makeseq(rng, alphabet_size, len, repetitive);
+        const std::string seqtext = text(enc, seq);
+        for (unsigned int k : ks) {
+            kmeroptions o(k);
+            o.hashed = true;
+            std::vector<profilekey_t> keys;
+            enc.kmers(seqtext, o, keys);
+            check(keys.size() == seq.size() - k + 1, "the number of kmers for k = " + std::to_string(k));
+
+            // the kmers in key order; of the distinct kmers with one key,
+            // all but the first collide
+            std::vector<unsigned int> order(keys.size());
+            for (unsigned int i=0; i<order.size(); ++i)
+                order[i] = i;
+            std::sort(order.begin(), order.end(),
+                      [&](const unsigned int a, const unsigned int b) { return keys[a] < keys[b]; });
+            unsigned long distinct = 0, collisions = 0;
+            for (unsigned int i=0; i<order.size(); ) {
+                unsigned int j = i;
+                std::vector<unsigned int> kinds;     // a start of each distinct kmer
+                for ( ; j<order.size() && keys[order[j]] == keys[order[i]]; ++j)
+                    if (std::none_of(kinds.begin(), kinds.end(), [&](const unsigned int s) {
+                                return std::equal(seq.begin() + s, seq.begin() + s + k,
+                                                  seq.begin() + order[j]); }))
+                        kinds.push_back(order[j]);
+                distinct += kinds.size();
+                collisions += kinds.size() - 1;
+                i = j;
+            }
+            double rate = (double)collisions / distinct;
+            std::cout << (repetitive ? "repeats " : "random  ") << std::setw(5) << k
+                      << std::setw(17) << distinct << std::setw(11) << collisions
+                      << "  " << rate << std::endl;
+            // With 2^61 possible hashes, a million kmers should not collide.
+            if (collisions > 0)
+                failed = true;
+        }
+    }
+
+    check(!failed, "hashed kmers collided");
+    std::cout << "No collisions among hashed kmers." << std::endl;
+}
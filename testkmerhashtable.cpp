@@ -0,0 +1,134 @@
+// Check the concurrent kmer hash table against sorting and counting, with
+// several threads adding at once to a table that starts small and has to
+// grow.  Then time counting the same keys both ways as the threads go up.
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "kmerhashtable.h"
+#include "testutils.h"
+
+// keys drawn from few enough values that many repeat
+std::vector<profilekey_t>
+randomkeys(std::mt19937_64& rng, const size_t n, const uint64_t range)
+{
+    std::vector<profilekey_t> keys(n);
+    for (size_t i=0; i<n; ++i)
+        keys[i] = rng() % range * 0x9e3779b97f4a7c15ULL;
+    return keys;
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937_64 rng(46);
+
+    for (unsigned int nthreads : { 1, 2, 4, 8 }) {
+        std::vector<profilekey_t> all = randomkeys(rng, 400000, 50000);
+        all.push_back(~0ULL);   // the one key that cannot go in a slot
+        all.push_back(~0ULL);
+        all.push_back(0);
+        kmerhashtable table(16);
+        std::vector<std::thread> threads;
+        for (unsigned int t=0; t<nthreads; ++t)
+            threads.emplace_back([&, t]() {
+                // batches of all sizes, and the odd single key
+                size_t start = all.size() * t / nthreads, end = all.size() * (t + 1) / nthreads;
+                for (size_t n=1; start<end; n = n * 3 % 1001 + 1) {
+                    if (n % 7 == 0)
+                        table.add(all[start++], 1);
+                    else {
+                        size_t len = std::min(n, end - start);
+                        table.add(all.data() + start, len);
+                        start += len;
+                    }
+                }
+            });
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+
+        ownedprofile expected, got;
+        std::vector<profilekey_t> copy(all);
+        profilestore::countkmers(copy, expected);
+        table.profile(got);
+        check(table.size() == expected.keys.size(), "wrong number of distinct keys");
+        check(got.keys == expected.keys && got.counts == expected.counts && got.sqnorm == expected.sqnorm,
+              "profile differs from sorting and counting with " + std::to_string(nthreads) + " threads");
+        for (size_t i=0; i<expected.keys.size(); i += 97)
+            check(table.find(expected.keys[i]) == expected.counts[i], "find gives the wrong count");
+        check(table.find(12345) == 0, "find of a key never added");
+
+        std::vector<uint64_t> spectrum = table.spectrum();
+        uint64_t nkeys = 0, nkmers = 0;
+        for (size_t c=0; c<spectrum.size(); ++c) {
+            nkeys += spectrum[c];
+            nkmers += c * spectrum[c];
+        }
+        check(nkeys == table.size() && nkmers == all.size() && spectrum[0] == 0, "spectrum does not add up");
+
+        table.assignids();
+        for (size_t i=0; i<expected.keys.size(); ++i)
+            check(table.id(expected.keys[i]) == i, "ids are not in key order");
+    }
+    std::cout << "The hash table counts match sorting and counting, for 1 to 8 threads." << std::endl;
+
+    // kmers of sequences, against the profile store
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+    if (alphabet.length() >= 2) {
+        fastavec_t seqs;
+        std::string joined;
+        for (unsigned int s=0; s<20; ++s) {
+            std::string seq;
+            for (unsigned int i=rng() % 5000; i>0; --i)
+                seq += alphabet[rng() % alphabet.length()];
+            seqs.push_back(FastaRecord("seq" + std::to_string(s), seq));
+            joined += seq + "N";
+        }
+        kmerhashtable t5, t9;
+        kmerhashtable::count({ &t5, &t9 }, { kmeroptions(5), kmeroptions(9) }, seqs, 3);
+        for (unsigned int k : { 5, 9 }) {
+            ownedprofile expected, got;
+            profilestore((kmeroptions(k))).calculate(joined, expected);
+            (k == 5 ? t5 : t9).profile(got);
+            check(got.keys == expected.keys && got.counts == expected.counts, "sequence kmer counts differ");
+        }
+        std::cout << "Counting the kmers of sequences matches the profile store." << std::endl;
+    }
+
+    const size_t nkeys = 1 << 24;
+    std::vector<profilekey_t> keys = randomkeys(rng, nkeys, 1 << 22);
+    std::vector<profilekey_t> copy(keys);
+    ownedprofile p;
+    auto start = std::chrono::steady_clock::now();
+    profilestore::countkmers(copy, p);
+    std::chrono::duration<double> sorted = std::chrono::steady_clock::now() - start;
+    std::cout << nkeys << " keys, " << p.keys.size() << " distinct: sort and count "
+              << sorted.count() << "s" << std::endl;
+    const unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int nthreads=1; nthreads<=hw; nthreads *= 2) {
+        kmerhashtable table;
+        start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned int t=0; t<nthreads; ++t)
+            threads.emplace_back([&, t]() {
+                table.add(keys.data() + nkeys * t / nthreads, nkeys / nthreads);
+            });
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+        std::chrono::duration<double> hashed = std::chrono::steady_clock::now() - start;
+        check(table.size() == p.keys.size(), "timed table lost keys");
+        std::cout << "  hash table, " << nthreads << " threads: " << hashed.count() << "s" << std::endl;
+    }
+
+    std::cout << "All kmer hash table tests completed successfully." << std::endl;
+}
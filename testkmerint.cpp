@@ -8,7 +8,7 @@ int main()
 {
     log4cxx::BasicConfigurator::configure();
 
-    for (unsigned int k=kmer::min_k; k<=kmer::max_k; ++k) {
+    for (unsigned int k=kmer::min_k; k<=kmerint::get_max_k(); ++k) {
         std::cout << "testing k = " << k << std::endl;
         kmerint kmer(k);
         test_kmerint(kmer, true);
@@ -0,0 +1,167 @@
+// Check the kmer measures against counting the kmer text, at every
+// precision, a pair at a time and a row at a time, including sequences
+// with no kmers at all and nearly equal ones whose squared Euclidean
+// distance rounds below 0.
+
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <random>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "cosinemeasure.h"
+#include "euclideanmeasure.h"
+#include "testutils.h"
+
+typedef std::map<std::string, long double> counts_t;
+
+counts_t
+countsof(const std::string& seq, const unsigned int k)
+{
+    counts_t counts;
+    for (size_t p=0; p+k<=seq.length(); ++p)
+        if (seq.find('N', p) >= p+k)
+            ++counts[seq.substr(p, k)];
+    return counts;
+}
+
+// dot product and squared norms of two kmer count vectors
+void
+products(const counts_t& a, const counts_t& b, long double& dot, long double& sqa, long double& sqb)
+{
+    dot = sqa = sqb = 0;
+    for (auto e=a.begin(); e != a.end(); ++e) {
+        sqa += e->second * e->second;
+        auto f = b.find(e->first);
+        if (f != b.end())
+            dot += e->second * f->second;
+    }
+    for (auto f=b.begin(); f != b.end(); ++f)
+        sqb += f->second * f->second;
+}
+
+const precision_t precisions[] = { precision_exact, precision_double, precision_float, precision_longdouble };
+const char *precisionnames[] = { "exact", "double", "float", "longdouble" };
+
+// how far a precision may be from long double; the arccosine near 0 turns
+// a rounding error e in the cosine into about sqrt(2e) in the angle
+long double
+tolerance(const precision_t p)
+{
+    if (p == precision_float)
+        return 4 * std::sqrt(std::numeric_limits<float>::epsilon());
+    return 4 * std::sqrt(std::numeric_limits<double>::epsilon());
+}
+
+// how far a squared Euclidean distance may be off when the norms add up to
+// size; exact is exact
+long double
+sqtolerance(const precision_t p, const long double size)
+{
+    switch (p) {
+    case precision_exact:
+        return 0;
+    case precision_float:
+        return 4 * size * std::numeric_limits<float>::epsilon();
+    default:
+        return 4 * size * std::numeric_limits<double>::epsilon();
+    }
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(38);
+    const std::string alphabet = "ACGT";
+
+    std::vector<std::string> seqs = { "", "NNNNNNNN", "AC" };
+    for (unsigned int s=0; s<30; ++s) {
+        // often a mutated copy of the one before
+        std::string seq;
+        if (rng() % 2 == 0) {
+            seq = seqs.back().substr(rng() % (seqs.back().length() + 1));
+            for (unsigned int i=rng() % 3; i>0 && seq.length()>0; --i)
+                seq[rng() % seq.length()] = alphabet[rng() % alphabet.length()];
+        }
+        for (unsigned int i=rng() % 80; i>0; --i)
+            seq += rng() % 40 == 0 ? 'N' : alphabet[rng() % alphabet.length()];
+        seqs.push_back(seq);
+    }
+
+    const long double halfpi = 2.0 * atanl(1.0);
+    for (unsigned int k : { 3, 5 }) {
+        cosinemeasure cosine(k);
+        euclideanmeasure euclidean(k);
+        profilestore store((kmeroptions(k)));
+        std::vector<ownedprofile> profiles(seqs.size());
+        std::vector<kmerprofile> views(seqs.size());
+        for (unsigned int s=0; s<seqs.size(); ++s) {
+            store.calculate(seqs[s], profiles[s]);
+            views[s] = profiles[s].view();
+        }
+
+        for (unsigned int pi=0; pi<4; ++pi) {
+            const precision_t p = precisions[pi];
+            kmermeasure::set_precision(p);
+            for (unsigned int a=0; a<seqs.size(); ++a) {
+                const counts_t ca = countsof(seqs[a], k);
+                std::vector<kmermeasure::mergestats_t> ss(seqs.size());
+                std::vector<long double> row(seqs.size()), eucrow(seqs.size());
+                for (unsigned int b=0; b<seqs.size(); ++b)
+                    ss[b] = kmermeasure::merge(views[a], views[b], p);
+                cosine.fromstatsrow(views[a], views.data(), ss.data(), seqs.size(), row.data());
+                euclidean.fromstatsrow(views[a], views.data(), ss.data(), seqs.size(), eucrow.data());
+
+                for (unsigned int b=0; b<seqs.size(); ++b) {
+                    const std::string pair = "'" + seqs[a] + "' and '" + seqs[b] + "', k = " +
+                                             std::to_string(k) + ", " + precisionnames[pi];
+                    const counts_t cb = countsof(seqs[b], k);
+                    long double dot, sqa, sqb;
+                    products(ca, cb, dot, sqa, sqb);
+
+                    const long double e = euclidean.fromstats(views[a], views[b], ss[b], p);
+                    check(e == eucrow[b], "Euclidean row and pair differ for " + pair);
+                    check(fabsl(e - (sqa + sqb - 2*dot)) <= sqtolerance(p, sqa + sqb),
+                          "Euclidean distance of " + pair);
+                    check(a != b || e == 0, "Euclidean distance of " + pair + " to itself");
+
+                    const long double d = cosine.fromstats(views[a], views[b], ss[b], p);
+                    check(d == row[b], "cosine row and pair differ for " + pair);
+                    if (sqa == 0 || sqb == 0) {
+                        check(d == 1, "cosine distance with no kmers is not 1 for " + pair);
+                        continue;
+                    }
+                    const long double expected = acosl(std::min(1.0L, dot / sqrtl(sqa * sqb))) / halfpi;
+                    check(fabsl(d - expected) <= tolerance(p), "cosine distance of " + pair);
+                    check(a != b || d == 0, "cosine distance of " + pair + " to itself");
+                }
+            }
+        }
+    }
+    std::cout << "Cosine and Euclidean distances match the kmer text at every precision." << std::endl;
+
+    // 8194 and 8195 AAAs: the squared distance is 1, and the sum of the
+    // rounded terms in float is -16
+    {
+        euclideanmeasure euclidean(3);
+        profilestore store((kmeroptions(3)));
+        ownedprofile pa, pb;
+        store.calculate(std::string(8196, 'A'), pa);
+        store.calculate(std::string(8197, 'A'), pb);
+        for (unsigned int pi=0; pi<4; ++pi) {
+            const precision_t p = precisions[pi];
+            kmermeasure::set_precision(p);
+            const long double e = euclidean.fromstats(pa.view(), pb.view(),
+                                                      kmermeasure::merge(pa.view(), pb.view(), p), p);
+            check(e >= 0, std::string("negative Euclidean distance, ") + precisionnames[pi]);
+            check(fabsl(e - 1) <= sqtolerance(p, 2 * 8195.0L * 8195.0L),
+                  std::string("Euclidean distance of long runs, ") + precisionnames[pi]);
+        }
+    }
+    kmermeasure::set_precision(precision_exact);
+    std::cout << "Euclidean distances of nearly equal profiles are never negative." << std::endl;
+
+    std::cout << "All kmer measure tests completed successfully." << std::endl;
+}
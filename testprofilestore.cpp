@@ -0,0 +1,201 @@
+// Check that a packed profile store unpacks to the same keys and counts as
+// a raw one, block by block, including blocks whose key differences need
+// all 64 bits, and that merging packed profiles gives the same dot product
+// and shared kmers as merging raw ones.  Then check that a sequence long
+// enough to be counted in chunks by several threads gets the profile one
+// thread counting it whole does.  The sequences are over the Makefile's
+// alphabet: x86 operator traces by default.
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "profilestore.h"
+#include "kmermeasure.h"
+#include "testutils.h"
+
+// the text of a sequence of bases (or N, which is none)
+std::string
+join(const std::vector<std::string>& bases)
+{
+    static const std::string separator = kmerencoder().separator();
+    std::string seq;
+    for (auto b=bases.begin(); b != bases.end(); ++b)
+        seq += (b != bases.begin() ? separator : "") + *b;
+    return seq;
+}
+
+std::vector<std::string>
+randombases(std::mt19937& rng, const size_t length)
+{
+    intbase_t ib;
+    std::vector<std::string> bases;
+    for (size_t i=0; i<length; ++i)
+        bases.push_back(ib.int_to_base(rng() % ib.get_alphabetsize()));
+    return bases;
+}
+
+std::string
+randomseq(std::mt19937& rng, const size_t length)
+{
+    return join(randombases(rng, length));
+}
+
+// the bases repeated n times
+std::string
+run(const std::string& bases, const size_t n)
+{
+    return join(std::vector<std::string>(n, bases));
+}
+
+// the key and count widths of each block of a packed profile, read with
+// the block format in profilestore.h
+void
+blockwidths(const kmerprofile& p, std::set<unsigned int>& keywidths, std::set<unsigned int>& countwidths)
+{
+    const uint8_t *b = p.packed;
+    for (size_t left=p.n; left>0; ) {
+        const size_t n = std::min(left, (size_t)profilecursor::blocklen);
+        const unsigned int kw = b[0], cw = b[1];
+        keywidths.insert(kw);
+        countwidths.insert(cw);
+        b += 2 + (n*kw + 7)/8 + (n*cw + 7)/8;
+        left -= n;
+    }
+}
+
+bool
+sameprofile(const ownedprofile& a, const ownedprofile& b)
+{
+    return a.keys == b.keys && a.counts == b.counts && a.sqnorm == b.sqnorm;
+}
+
+const precision_t precisions[] = { precision_exact, precision_double, precision_float, precision_longdouble };
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(36);
+    const kmerencoder encoder;
+    const std::string first = intbase_t().int_to_base(0);
+
+    // no kmers, one kmer, a block and either side of one, several blocks,
+    // and one kmer counted often enough to need a wide count
+    fastavec_t seqs;
+    for (size_t length : { 0, 3, 12, 12, 12, 12, 12, 12, 12, 12, 40, 138, 139, 140, 267, 1000, 5000 })
+        seqs.push_back(FastaRecord("seq" + std::to_string(seqs.size()), randomseq(rng, length)));
+    seqs.push_back(FastaRecord("onebase", run(first, 70000)));
+    seqs.push_back(FastaRecord("withN", join({ randomseq(rng, 300), run("N", 4), randomseq(rng, 300) })));
+
+    // spaced seeds short enough to pack for either alphabet; canonical
+    // kmers for DNA
+    std::vector<std::string> packopts = { "5", "12", "12,hash", "seed=1101" };
+    std::vector<std::string> chunkopts = { "3", "12", "12,hash", "seed=1101", "25", "64" };
+    if (encoder.has_complement()) {
+        packopts.push_back("7,canonical");
+        chunkopts.push_back("7,canonical");
+    }
+
+    std::set<unsigned int> keywidths, countwidths;
+    for (const std::string opt : packopts) {
+        const kmeroptions o = kmeroptions::parse(opt);
+        profilestore raw(o), packed(o, true);
+        raw.build(seqs);
+        packed.build(seqs);
+        check(packed.is_packed() && !raw.is_packed(), "the stores are not what was asked for");
+        check(packed.profilebytes() < raw.profilebytes(), "packing " + opt + " saves nothing");
+
+        for (unsigned int i=0; i<seqs.size(); ++i) {
+            const std::string what = seqs[i].get_id() + " for " + opt;
+            const kmerprofile pr = raw.get(i), pp = packed.get(i);
+            check(pp.packed != nullptr && pp.n == pr.n && pp.sqnorm == pr.sqnorm,
+                  "the packed profile of " + what + " has the wrong size");
+            blockwidths(pp, keywidths, countwidths);
+            rawcursor r(pr);
+            profilecursor c(pp);
+            size_t n = 0;
+            for ( ; !r.done() && !c.done(); r.advance(), c.advance(), ++n)
+                check(c.key() == r.key() && c.count() == r.count(),
+                      "kmer " + std::to_string(n) + " of " + what + " unpacks differently");
+            check(r.done() && c.done() && n == pr.n, "the packed profile of " + what + " has the wrong length");
+        }
+
+        for (const precision_t p : precisions)
+            for (unsigned int i=0; i<seqs.size(); ++i)
+                for (unsigned int j=0; j<seqs.size(); ++j) {
+                    const std::string what = seqs[i].get_id() + " and " + seqs[j].get_id() + " for " + opt;
+                    const kmermeasure::mergestats_t s = kmermeasure::merge(raw.get(i), raw.get(j), p);
+                    const kmermeasure::mergestats_t packedstats[] = {
+                        kmermeasure::merge(packed.get(i), packed.get(j), p),
+                        kmermeasure::merge(packed.get(i), raw.get(j), p),
+                        kmermeasure::merge(raw.get(i), packed.get(j), p)
+                    };
+                    for (const kmermeasure::mergestats_t& ps : packedstats)
+                        check(ps.dot == s.dot && ps.shared == s.shared,
+                              "merging packed " + what + " differs from merging raw");
+                }
+    }
+    check(keywidths.count(64) == 1, "no block needed 64 bit key differences");
+    check(*countwidths.rbegin() >= 16, "no block needed wide counts");
+    std::cout << "Packed profiles unpack to the raw ones, with key widths up to "
+              << *keywidths.rbegin() << " bits and count widths up to "
+              << *countwidths.rbegin() << " bits." << std::endl;
+    std::cout << "Merging packed profiles gives what merging raw ones does." << std::endl;
+
+    // Adding profiles is counting both sequences; an N between them keeps
+    // any kmer from spanning the two.
+    {
+        profilestore store((kmeroptions(5)));
+        const std::string x = randomseq(rng, 500), y = join({ randomseq(rng, 700), run(first, 50) });
+        ownedprofile px, py, pxy, empty, sum;
+        store.calculate(x, px);
+        store.calculate(y, py);
+        store.calculate(join({ x, "N", y }), pxy);
+        profilestore::addprofiles(px, py, sum);
+        check(sameprofile(sum, pxy), "adding two profiles is not counting both sequences");
+        profilestore::addprofiles(py, px, sum);
+        check(sameprofile(sum, pxy), "adding two profiles depends on their order");
+        profilestore::addprofiles(px, empty, sum);
+        check(sameprofile(sum, px), "adding an empty profile changes the other");
+    }
+
+    // One sequence long enough to be shared among the threads, with Ns and
+    // long runs of one base somewhere in it, and a short one, counted for
+    // several kinds of kmer at once so that the chunks overlap by the
+    // largest k.
+    std::vector<std::string> longbases = randombases(rng, profilestore::chunkedlength + 12345);
+    for (unsigned int i=0; i<300; ++i) {
+        const size_t at = rng() % (longbases.size() - 100);
+        const std::string b = rng() % 3 == 0 ? "N" : first;
+        std::fill(longbases.begin() + at, longbases.begin() + at + 1 + rng() % 30, b);
+    }
+    fastavec_t longseqs = { FastaRecord("long", join(longbases)), FastaRecord("short", randomseq(rng, 1000)) };
+    std::vector<kmeroptions> opts;
+    for (const std::string opt : chunkopts)
+        opts.push_back(kmeroptions::parse(opt));
+    for (unsigned int nthreads : { 1, 2, 3, 4, 7 }) {
+        std::vector<profilestore*> stores;
+        for (auto o=opts.begin(); o != opts.end(); ++o)
+            stores.push_back(new profilestore(*o));
+        profilestore::build(stores, longseqs, nthreads);
+        for (unsigned int i=0; i<stores.size(); ++i)
+            for (unsigned int s=0; s<longseqs.size(); ++s) {
+                ownedprofile whole;
+                stores[i]->calculate(longseqs[s].get_seq(), whole);
+                const kmerprofile p = stores[i]->get(s);
+                ownedprofile built;
+                built.keys.assign(p.keys, p.keys + p.n);
+                built.counts.assign(p.counts, p.counts + p.n);
+                built.sqnorm = p.sqnorm;
+                check(sameprofile(built, whole), "the " + longseqs[s].get_id() + " sequence for " +
+                      opts[i].str() + " with " + std::to_string(nthreads) + " threads");
+            }
+        for (auto st=stores.begin(); st != stores.end(); ++st)
+            delete *st;
+    }
+    std::cout << "Counting a long sequence in chunks on several threads matches counting it whole." << std::endl;
+
+    std::cout << "All profile store tests completed successfully." << std::endl;
+}
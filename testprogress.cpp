@@ -0,0 +1,96 @@
+// Check that the progress counters add up across threads and restarts,
+// that the status file is whole JSON with the final counts once the run
+// has stopped, and the ETA formatting.  Then time counting a tile.
+
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "progress.h"
+#include "testutils.h"
+
+// the text after "key": in a status file
+std::string
+field(const std::string& json, const std::string& key)
+{
+    size_t p = json.find("\"" + key + "\": ");
+    if (p == std::string::npos)
+        return "";
+    p += key.length() + 4;
+    return json.substr(p, json.find_first_of(",\n", p) - p);
+}
+
+int main()
+{
+    check(progress::formatduration(7) == "00:00:07", "7 seconds");
+    check(progress::formatduration(3 * 86400 + 4 * 3600 + 5 * 60 + 6) == "3d 04:05:06", "3 days and a bit");
+    check(progress::formatduration(-1) == "unknown", "a negative time");
+    std::cout << "Durations are formatted as expected." << std::endl;
+
+    // 4 workers, each of which an earlier run got part way through
+    const unsigned int nthreads = 4, ntiles = 200, tilepairs = 1000, skip = 5000;
+    const uint64_t total = nthreads * ((uint64_t)ntiles * tilepairs + skip);
+    const std::string statusfname = "testprogress.status." + std::to_string(getpid());
+    {
+        progress prog(nthreads, total, 0.05, statusfname);
+        prog.run();
+        std::vector<std::thread> threads;
+        for (unsigned int t=0; t<nthreads; ++t)
+            threads.emplace_back([&prog, t]() {
+                prog.skipped(t, skip);
+                for (unsigned int i=0; i<ntiles; ++i) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+                    prog.tiledone(t, tilepairs, 400000);
+                }
+            });
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+        check(prog.done() == total, "the counters do not add up");
+
+        // the reporter has written at least once by now
+        std::ifstream inf(statusfname);
+        check((bool)inf, "no status file while running");
+        prog.stop();
+    }
+    std::ifstream inf(statusfname);
+    std::stringstream ss;
+    ss << inf.rdbuf();
+    const std::string json = ss.str();
+    unlink(statusfname.c_str());
+    check(json.front() == '{' && json.find("}\n", json.length() - 2) != std::string::npos,
+          "the status file is not whole");
+    check(field(json, "finished") == "true", "the last status is not finished");
+    check(field(json, "pairs") == std::to_string(total) && field(json, "total") == std::to_string(total) &&
+          field(json, "percent") == "100", "the last status does not have every pair");
+    check(field(json, "eta") == "0", "a finished run still has time to go");
+    check(std::stod(field(json, "pairspersec")) > 0, "no speed");
+    size_t threads = 0;
+    for (size_t p=json.find("\"tiles\": "); p != std::string::npos; p=json.find("\"tiles\": ", p+1)) {
+        ++threads;
+        check(field(json.substr(p), "tiles") == std::to_string(ntiles), "a thread lost tiles");
+    }
+    check(threads == nthreads, "the status file does not have every thread");
+    std::cout << "The counters add up and the status file has the final counts." << std::endl;
+
+    // what a worker pays for counting, against an empty loop
+    const unsigned int n = 100000000;
+    progress prog(1, n, 0);
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<n; ++i)
+        prog.tiledone(0, 1, i);
+    std::chrono::duration<double, std::nano> counting = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<n; ++i)
+        sink = sink + i;
+    std::chrono::duration<double, std::nano> bare = std::chrono::steady_clock::now() - start;
+    check(prog.done() == n, "the single worker lost pairs");
+    std::cout << "Counting a tile takes " << counting.count() / n << "ns (a loop that does nothing "
+              << bare.count() / n << "ns)." << std::endl;
+
+    std::cout << "All progress tests completed successfully." << std::endl;
+}
@@ -0,0 +1,166 @@
+// Check the sparse de Bruijn graph's nodes, edges and counts against
+// counting the kmer text, and that a saved graph maps back the same.
+// Then build the graph of a sample data file and time the edge queries,
+// and mapping the saved graph against building it.
+
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <random>
+#include <unistd.h>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "sparsedebruijn.h"
+#include "kmerhashtable.h"
+#include "testutils.h"
+
+// the graphs must answer every question the same way
+void
+compare(sparsedebruijn& a, sparsedebruijn& b, const unsigned int alphabet_size)
+{
+    check(a.size() == b.size() && a.get_nedges() == b.get_nedges(), "graph sizes differ");
+    for (sparsedebruijn::index_t i=0; i<a.size(); ++i) {
+        check(a.key(i) == b.key(i) && a.count(i) == b.count(i), "node " + a.kmer(i) + " differs");
+        for (unsigned int c=0; c<alphabet_size; ++c)
+            check(a.successor(i, c) == b.successor(i, c) && a.predecessor(i, c) == b.predecessor(i, c) &&
+                  a.edgecount(i, c) == b.edgecount(i, c), "edges of " + a.kmer(i) + " differ");
+    }
+    check(a.profile().sqnorm == b.profile().sqnorm, "profile norms differ");
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(44);
+
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+
+    kmerencoder encoder;
+    const std::string fname = "testsparsedebruijn.graph." + std::to_string(getpid());
+    for (unsigned int k=1; k<=10 && encoder.exact(k+1); ++k) {
+        fastavec_t seqs;
+        std::map<std::string, unsigned int> nodes, edges;
+        for (unsigned int s=0; s<5; ++s) {
+            std::string seq;
+            for (unsigned int i=rng() % 300; i>0; --i)
+                seq += rng() % 40 == 0 ? 'N' : alphabet[rng() % alphabet.length()];
+            seqs.push_back(FastaRecord("seq" + std::to_string(s), seq));
+            for (size_t p=0; p+k<=seq.length(); ++p)
+                if (seq.substr(p, k).find('N') == std::string::npos)
+                    ++nodes[seq.substr(p, k)];
+            for (size_t p=0; p+k+1<=seq.length(); ++p)
+                if (seq.substr(p, k+1).find('N') == std::string::npos)
+                    ++edges[seq.substr(p, k+1)];
+        }
+
+        sparsedebruijn g(k);
+        g.build(seqs);
+        check(g.size() == nodes.size() && g.get_nedges() == edges.size(), "wrong number of nodes or edges");
+        sparsedebruijn::index_t i = 0;
+        uint64_t sqnorm = 0;
+        for (auto n=nodes.begin(); n != nodes.end(); ++n, ++i) {
+            const std::string s = g.kmer(i);
+            check(s == n->first && g.count(i) == n->second, "node " + s + " is not " + n->first);
+            check(g.find(g.key(i)) == i, "find does not find " + s);
+            sqnorm += (uint64_t)n->second * n->second;
+            unsigned int nout = 0, nin = 0;
+            for (unsigned int c=0; c<alphabet.length(); ++c) {
+                auto e = edges.find(s + alphabet[c]);
+                const sparsedebruijn::index_t j = g.successor(i, c);
+                if (e == edges.end())
+                    check(j == sparsedebruijn::npos && g.edgecount(i, c) == 0, "extra edge out of " + s);
+                else {
+                    check(j != sparsedebruijn::npos && g.kmer(j) == s.substr(1) + alphabet[c] &&
+                          g.edgecount(i, c) == e->second, "wrong edge out of " + s);
+                    ++nout;
+                }
+                e = edges.find(alphabet[c] + s);
+                const sparsedebruijn::index_t w = g.predecessor(i, c);
+                if (e == edges.end())
+                    check(w == sparsedebruijn::npos, "extra edge into " + s);
+                else {
+                    check(w != sparsedebruijn::npos && g.kmer(w) == alphabet[c] + s.substr(0, k-1),
+                          "wrong edge into " + s);
+                    ++nin;
+                }
+            }
+            check(g.outdegree(i) == nout && g.indegree(i) == nin, "wrong degree for " + s);
+        }
+        check(g.profile().sqnorm == sqnorm, "wrong profile norm");
+
+        g.save(fname);
+        sparsedebruijn mapped(k);
+        check(mapped.load(fname), "cannot load the saved graph");
+        compare(g, mapped, alphabet.length());
+        sparsedebruijn wrongk(k + 1);
+        check(!wrongk.load(fname), "loaded a graph for the wrong k");
+        unlink(fname.c_str());
+    }
+    std::cout << "The sparse graph's nodes and edges match the kmer text, and it maps back from a file." << std::endl;
+
+    // a sequence long enough to be cut into pieces, counted by several threads
+    std::string longseq;
+    for (size_t i=0; i<2*kmerhashtable::piecelength + 1000; ++i)
+        longseq += alphabet[rng() % alphabet.length()];
+    fastavec_t longseqs(1, FastaRecord("long", longseq));
+    longseqs.push_back(FastaRecord("short", longseq.substr(0, 500)));
+    sparsedebruijn serial(9), threaded(9);
+    serial.build(longseq + "N" + longseq.substr(0, 500));
+    threaded.build(longseqs, 3);
+    compare(serial, threaded, alphabet.length());
+    std::cout << "Counting in pieces and threads gives the same graph." << std::endl;
+
+    const char *sample = "data/AF091148.fasta";
+    if (access(sample, R_OK) != 0) {
+        std::cout << "No " << sample << " (run from the top directory); skipping the timing." << std::endl;
+        return 0;
+    }
+    fastavec_t seqs = readfastafile(sample);
+    for (unsigned int k : { 11, 21, 31 }) {
+        if (!encoder.exact(k+1))
+            break;
+        sparsedebruijn g(k);
+        auto start = std::chrono::steady_clock::now();
+        g.build(seqs);
+        std::chrono::duration<double> built = std::chrono::steady_clock::now() - start;
+
+        // follow every edge forward and back again, ten times over
+        start = std::chrono::steady_clock::now();
+        uint64_t steps = 0, checksum = 0;
+        for (unsigned int round=0; round<10; ++round)
+            for (sparsedebruijn::index_t i=0; i<g.size(); ++i)
+                for (unsigned int c=0; c<alphabet.length(); ++c) {
+                    const sparsedebruijn::index_t j = g.successor(i, c);
+                    if (j != sparsedebruijn::npos)
+                        checksum += g.predecessor(j, g.key(i) >> ((k-1)*encoder.get_nbits())) == i;
+                    ++steps;
+                }
+        std::chrono::duration<double, std::nano> walked = std::chrono::steady_clock::now() - start;
+        check(checksum == 10 * g.get_nedges(), "edges do not lead back");
+        std::cout << "k = " << k << ": " << g.size() << " nodes, " << g.get_nedges() << " edges, "
+                  << g.get_memory() / 1024 << "KB, built in " << built.count() << "s, "
+                  << walked.count() / steps << "ns a successor and predecessor" << std::endl;
+
+        // mapping the saved graph instead of building it again
+        g.save(fname);
+        for (bool preload : { false, true }) {
+            sparsedebruijn mapped(k);
+            start = std::chrono::steady_clock::now();
+            check(mapped.load(fname, preload), "cannot load the saved sample graph");
+            std::chrono::duration<double, std::micro> loaded = std::chrono::steady_clock::now() - start;
+            compare(g, mapped, alphabet.length());
+            std::cout << "  mapped" << (preload ? " with preload" : "") << " in "
+                      << loaded.count() << "us" << std::endl;
+        }
+        unlink(fname.c_str());
+    }
+
+    std::cout << "All sparse de Bruijn graph tests completed successfully." << std::endl;
+}
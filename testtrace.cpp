@@ -0,0 +1,97 @@
+// Check that trace points above TRACE_LEVEL are not there at all, that
+// several threads' events all come out of a dump, in order, and that a
+// thread that wraps its buffer keeps only its latest events.  Then time a
+// trace point.
+
+// whatever the Makefile asks for
+#undef TRACE_LEVEL
+#undef TRACE_EVENTS
+#define TRACE_LEVEL 3   // TRACE_DEBUG compiles to nothing
+#define TRACE_EVENTS 1024
+
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+#include "testutils.h"
+
+struct line_t {
+    uint64_t ns;
+    unsigned int thread;
+    std::string level, name;
+    uint64_t a, b;
+};
+
+std::vector<line_t>
+dumped()
+{
+    std::stringstream ss;
+    trace::dump(ss);
+    std::vector<line_t> lines;
+    line_t l;
+    while (ss >> l.ns >> l.thread >> l.level >> l.name >> l.a >> l.b)
+        lines.push_back(l);
+    return lines;
+}
+
+int main()
+{
+    int evaluated = 0;
+    TRACE_DEBUG("test.off", ++evaluated, 0);
+    check(evaluated == 0 && dumped().empty(), "a trace point above the level did something");
+    TRACE_INFO("test.on", ++evaluated, 7);
+    std::vector<line_t> lines = dumped();
+    check(evaluated == 1 && lines.size() == 1 && lines[0].level == "info" && lines[0].name == "test.on" &&
+          lines[0].a == 1 && lines[0].b == 7, "a trace point at the level was not recorded");
+
+    // each thread records fewer events than a buffer holds, so all are kept
+    const unsigned int nthreads = 4, nevents = 1000;
+    std::vector<std::thread> threads;
+    for (unsigned int t=0; t<nthreads; ++t)
+        threads.emplace_back([t]() {
+            for (unsigned int i=0; i<nevents; ++i)
+                TRACE_WARN("test.thread", t, i);
+        });
+    for (auto th=threads.begin(); th != threads.end(); ++th)
+        th->join();
+    lines = dumped();
+    check(lines.size() == 1 + nthreads * nevents, "events were lost");
+    std::map<uint64_t, uint64_t> next;      // per thread, the next i expected
+    for (size_t e=1; e<lines.size(); ++e) {
+        check(lines[e].ns >= lines[e-1].ns, "the dump is not in time order");
+        check(lines[e].b == next[lines[e].a]++, "a thread's events are out of order");
+    }
+    std::cout << "Trace points above the level vanish, and every thread's events are dumped in order." << std::endl;
+
+    // this thread wraps its buffer several times over
+    for (unsigned int i=0; i<5*TRACE_EVENTS; ++i)
+        TRACE_ERROR("test.wrap", i, 0);
+    lines = dumped();
+    uint64_t kept = 0, first = ~0ULL;
+    for (auto l=lines.begin(); l != lines.end(); ++l)
+        if (l->name == "test.wrap") {
+            ++kept;
+            first = std::min(first, l->a);
+        }
+    // the oldest is left out: its slot is the next one written
+    check(kept == TRACE_EVENTS - 1 && first == 4*TRACE_EVENTS + 1, "a full buffer did not dump its latest events");
+    std::cout << "A full buffer dumps the latest " << TRACE_EVENTS - 1 << " events." << std::endl;
+
+    const unsigned int n = 10000000;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<n; ++i)
+        TRACE_INFO("test.time", i, 0);
+    std::chrono::duration<double, std::nano> on = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i<n; ++i)
+        TRACE_DEBUG("test.time", i, 0);
+    std::chrono::duration<double, std::nano> off = std::chrono::steady_clock::now() - start;
+    std::cout << "A trace point takes " << on.count() / n << "ns; one compiled out "
+              << off.count() / n << "ns." << std::endl;
+
+    std::cout << "All trace tests completed successfully." << std::endl;
+}
@@ -0,0 +1,130 @@
+// Check that the unitigs of random graphs hold every node once, follow
+// the graph's edges, cannot be extended, and are the same whatever the
+// number of threads.  Then compact the graph of a sample data file.
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <log4cxx/logger.h>
+#include <log4cxx/basicconfigurator.h>
+
+#include "unitigset.h"
+#include "testutils.h"
+
+void
+checkunitigs(const sparsedebruijn& g, const unitigset& us)
+{
+    const unsigned int k = g.get_k();
+    std::vector<unsigned int> seen(g.size(), 0);
+    for (size_t u=0; u<us.size(); ++u) {
+        const unitigset::unitig_t& t = us[u];
+        check(t.seq.length() == t.nkmers + k - 1, "unitig length");
+        sparsedebruijn::index_t i = t.first;
+        uint64_t coverage = 0;
+        for (uint64_t m=0; m<t.nkmers; ++m) {
+            check(g.kmer(i) == t.seq.substr(m, k), "unitig " + t.seq + " does not spell its nodes");
+            check(us.find(i) == u, "node in the wrong unitig");
+            ++seen[i];
+            coverage += g.count(i);
+            if (m + 1 < t.nkmers) {
+                check(g.outdegree(i) == 1, "unitig " + t.seq + " runs through a branch");
+                sparsedebruijn::index_t j = sparsedebruijn::npos;
+                g.out_edges(i, [&](const sparsedebruijn::index_t n, const profilecount_t) { j = n; });
+                check(g.indegree(j) == 1, "unitig " + t.seq + " runs into a join");
+                i = j;
+            }
+        }
+        check(i == t.last && coverage == t.coverage, "unitig end or coverage");
+        if (t.circular)
+            continue;
+        // maximal: the ends cannot be extended
+        bool extends = false;
+        if (g.outdegree(t.last) == 1)
+            g.out_edges(t.last, [&](const sparsedebruijn::index_t j, const profilecount_t) {
+                extends = g.indegree(j) == 1 && j != t.last;
+            });
+        check(!extends, "unitig " + t.seq + " could go on");
+        if (g.indegree(t.first) == 1)
+            g.in_edges(t.first, [&](const sparsedebruijn::index_t w) {
+                extends = g.outdegree(w) == 1 && w != t.first;
+            });
+        check(!extends, "unitig " + t.seq + " could start earlier");
+    }
+    for (sparsedebruijn::index_t i=0; i<g.size(); ++i)
+        check(seen[i] == 1, "node " + g.kmer(i) + " is not in exactly one unitig");
+}
+
+int main()
+{
+    log4cxx::BasicConfigurator::configure();
+    std::mt19937 rng(45);
+
+    intbase_t ib;
+    std::string alphabet;
+    for (unsigned int i=0; i<ib.get_alphabetsize(); ++i) {
+        base_t b = ib.int_to_base(i);
+        if (b.length() == 1)
+            alphabet += b;
+    }
+
+    kmerencoder encoder;
+    unsigned int ncircular = 0;
+    for (unsigned int trial=0; trial<200; ++trial) {
+        const unsigned int k = 2 + trial % 9;
+        if (!encoder.exact(k+1))
+            continue;
+        fastavec_t seqs;
+        for (unsigned int s=0; s<1 + rng() % 6; ++s) {
+            std::string seq;
+            for (unsigned int i=rng() % 200; i>0; --i)
+                seq += alphabet[rng() % alphabet.length()];
+            // a repeated piece makes a cycle
+            if (trial % 5 == 0 && seq.length() > 2*k)
+                seq = seq.substr(0, k+3) + seq.substr(0, k+3) + seq.substr(0, k+3);
+            seqs.push_back(FastaRecord("seq" + std::to_string(s), seq));
+        }
+        sparsedebruijn g(k);
+        g.build(seqs, 1 + trial % 3);
+        unitigset one, several;
+        one.build(g, 1);
+        several.build(g, 4);
+        checkunitigs(g, one);
+        check(one.size() == several.size(), "unitig count depends on the threads");
+        for (size_t u=0; u<one.size(); ++u) {
+            check(one[u].seq == several[u].seq, "unitigs depend on the threads");
+            ncircular += one[u].circular;
+        }
+    }
+    std::cout << "The unitigs cover the graphs exactly and cannot be extended ("
+              << ncircular << " were cycles)." << std::endl;
+
+    const char *sample = "data/AF091148.fasta";
+    if (access(sample, R_OK) != 0) {
+        std::cout << "No " << sample << " (run from the top directory); skipping the timing." << std::endl;
+        return 0;
+    }
+    fastavec_t seqs = readfastafile(sample);
+    const unsigned int nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int k : { 15, 31 }) {
+        if (!encoder.exact(k+1))
+            break;
+        for (unsigned int t=1; t<=nthreads; t *= 2) {
+            auto start = std::chrono::steady_clock::now();
+            sparsedebruijn g(k);
+            g.build(seqs, t);
+            std::chrono::duration<double> built = std::chrono::steady_clock::now() - start;
+            start = std::chrono::steady_clock::now();
+            unitigset us;
+            us.build(g, t);
+            std::chrono::duration<double> compacted = std::chrono::steady_clock::now() - start;
+            checkunitigs(g, us);
+            std::cout << "k = " << k << ", " << t << " threads: " << g.size() << " kmers in "
+                      << us.size() << " unitigs; counted in " << built.count() << "s, compacted in "
+                      << compacted.count() << "s" << std::endl;
+        }
+    }
+
+    std::cout << "All unitig tests completed successfully." << std::endl;
+}
@@ -0,0 +1,37 @@
+/*!
+ * @brief what the test programs share
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TESTUTILS_H
+#define TESTUTILS_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+//! stop the test, saying what failed, unless ok
+inline void
+check(const bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        abort();
+    }
+}
+
+#endif // TESTUTILS_H
@@ -0,0 +1,210 @@
+/*!
+ * @brief trace points that compile to nothing unless asked for
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*! @file trace.h
+ * A trace point records an event: a name (a string literal) and two
+ * integers, e.g.
+ *     TRACE_DEBUG("dbg.set_outptr", node, base);
+ * Which trace points exist is decided when compiling, by TRACE_LEVEL
+ * (e.g. -DTRACE_LEVEL=4 in CXXFLAGS):
+ *     0  none (the default)
+ *     1  TRACE_ERROR
+ *     2  and TRACE_WARN
+ *     3  and TRACE_INFO
+ *     4  and TRACE_DEBUG
+ * A trace point above the level is nothing at all; its arguments are
+ * not even evaluated.
+ *
+ * Each thread records into a ring buffer of its own, so recording takes
+ * no lock and never waits: a clock read, a few stores and a release
+ * store of the buffer's head.  Only the last TRACE_EVENTS events of each
+ * thread are kept.  trace::dump() writes every thread's events, oldest
+ * first, whenever it is called; trace::dumponsignal() has a signal (e.g.
+ * SIGUSR1) do it.  Events that a thread overwrites while they are being
+ * dumped are left out, not dumped half-written, and so is the oldest of
+ * a full buffer, which the thread may be writing over as it is dumped.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <err.h>
+#include <signal.h>
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 4096   //!< kept per thread; a power of two
+#endif
+
+namespace trace {
+
+enum level_t { error = 1, warn, info, debug };
+
+struct event_t {
+    uint64_t ns;            //!< since the first event of the run
+    const char *name;
+    uint64_t a, b;
+    level_t level;
+};
+
+//! one thread's events; only that thread writes to it
+struct ringbuffer {
+    event_t events[TRACE_EVENTS];
+    std::atomic<uint64_t> head;     //!< events ever recorded
+    unsigned int thread;            //!< the order threads first traced in
+
+    ringbuffer(const unsigned int t) : head(0), thread(t) {};
+};
+
+/* Every buffer ever made.  Buffers outlive their threads so that a dump
+ * after the threads have finished still has their events.
+ */
+inline std::mutex buffersmutex;
+inline std::vector<std::shared_ptr<ringbuffer>> buffers;
+inline const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+//! @brief this thread's buffer, made the first time the thread traces
+inline ringbuffer&
+mybuffer()
+{
+    thread_local ringbuffer *mine = nullptr;
+    if (mine == nullptr) {
+        std::lock_guard<std::mutex> lock(buffersmutex);
+        buffers.push_back(std::make_shared<ringbuffer>(buffers.size()));
+        mine = buffers.back().get();
+    }
+    return *mine;
+}
+
+inline void
+record(const level_t level, const char *name, const uint64_t a, const uint64_t b)
+{
+    ringbuffer& r = mybuffer();
+    const uint64_t h = r.head.load(std::memory_order_relaxed);
+    event_t& e = r.events[h % TRACE_EVENTS];
+    e.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    e.name = name;
+    e.a = a;
+    e.b = b;
+    e.level = level;
+    r.head.store(h + 1, std::memory_order_release);
+}
+
+/*! @brief write every thread's events, one a line, in time order:
+ * nanoseconds, thread, level, name, a, b
+ */
+inline void
+dump(std::ostream& os)
+{
+    const char *levels[] = { "", "error", "warn", "info", "debug" };
+    std::vector<std::pair<event_t, unsigned int>> all;
+    std::lock_guard<std::mutex> lock(buffersmutex);
+    for (auto r=buffers.begin(); r != buffers.end(); ++r) {
+        const uint64_t h = (*r)->head.load(std::memory_order_acquire);
+        const uint64_t first = h > TRACE_EVENTS ? h - TRACE_EVENTS : 0;
+        std::vector<event_t> copy;
+        for (uint64_t i=first; i<h; ++i)
+            copy.push_back((*r)->events[i % TRACE_EVENTS]);
+        // anything the thread has since written over, or is writing over
+        // now (event now - TRACE_EVENTS, in event now's slot), may be torn;
+        // the fence keeps the copying above from moving past this load
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t now = (*r)->head.load(std::memory_order_relaxed);
+        const uint64_t safe = now + 1 > TRACE_EVENTS ? now + 1 - TRACE_EVENTS : 0;
+        for (uint64_t i=std::max(first, safe); i<h; ++i)
+            all.push_back(std::make_pair(copy[i - first], (*r)->thread));
+    }
+    std::stable_sort(all.begin(), all.end(), [](const std::pair<event_t, unsigned int>& x,
+                                                const std::pair<event_t, unsigned int>& y) {
+        return x.first.ns < y.first.ns;
+    });
+    for (auto e=all.begin(); e != all.end(); ++e)
+        os << e->first.ns << " " << e->second << " " << levels[e->first.level] << " "
+           << e->first.name << " " << e->first.a << " " << e->first.b << "\n";
+    os.flush();
+}
+
+inline void
+dump(const std::string& fname)
+{
+    std::ofstream outf(fname);
+    if (!outf)
+        err(1, "Cannot create trace file %s", fname.c_str());
+    dump(outf);
+}
+
+/*! @brief dump to fname each time the process gets sig
+ * Call this before starting any other thread: sig is blocked here, the
+ * threads started later inherit that, and one thread of its own waits
+ * for the signal, where it is safe to write files.
+ */
+inline void
+dumponsignal(const int sig, const std::string& fname)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0)
+        errx(1, "pthread_sigmask to block signal %d failed", sig);
+    std::thread([set, fname]() {
+        int got;
+        while (sigwait(&set, &got) == 0) {
+            dump(fname);
+            std::cerr << "Trace written to " << fname << std::endl;
+        }
+    }).detach();
+}
+
+} // namespace trace
+
+#if TRACE_LEVEL >= 1
+#define TRACE_ERROR(name, a, b) trace::record(trace::error, name, (uint64_t)(a), (uint64_t)(b))
+#else
+#define TRACE_ERROR(name, a, b) do {} while (0)
+#endif
+#if TRACE_LEVEL >= 2
+#define TRACE_WARN(name, a, b) trace::record(trace::warn, name, (uint64_t)(a), (uint64_t)(b))
+#else
+#define TRACE_WARN(name, a, b) do {} while (0)
+#endif
+#if TRACE_LEVEL >= 3
+#define TRACE_INFO(name, a, b) trace::record(trace::info, name, (uint64_t)(a), (uint64_t)(b))
+#else
+#define TRACE_INFO(name, a, b) do {} while (0)
+#endif
+#if TRACE_LEVEL >= 4
+#define TRACE_DEBUG(name, a, b) trace::record(trace::debug, name, (uint64_t)(a), (uint64_t)(b))
+#else
+#define TRACE_DEBUG(name, a, b) do {} while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,173 @@
+/*!
+ * @brief the unitigs (maximal non-branching paths) of a de Bruijn graph
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unitigset.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <err.h>
+
+typedef sparsedebruijn::index_t index_t;
+
+//! the node after i in its unitig, or npos if i ends it
+index_t
+unitigset::next(const sparsedebruijn& g, const index_t i) const
+{
+    if (g.outdegree(i) != 1)
+        return sparsedebruijn::npos;
+    index_t j = sparsedebruijn::npos;
+    g.out_edges(i, [&](const index_t t, const profilecount_t) { j = t; });
+    return j != i && g.indegree(j) == 1 ? j : sparsedebruijn::npos;
+}
+
+//! the node before i in its unitig, or npos if i starts it
+index_t
+unitigset::prev(const sparsedebruijn& g, const index_t i) const
+{
+    if (g.indegree(i) != 1)
+        return sparsedebruijn::npos;
+    index_t j = sparsedebruijn::npos;
+    g.in_edges(i, [&](const index_t s) { j = s; });
+    return j != i && g.outdegree(j) == 1 ? j : sparsedebruijn::npos;
+}
+
+void
+unitigset::build(const sparsedebruijn& g, const unsigned int nthreads)
+{
+    graph = &g;
+    const index_t n = g.size();
+    std::unique_ptr<std::atomic<uint8_t>[]> visited(new std::atomic<uint8_t>[n]);
+    for (index_t i=0; i<n; ++i)
+        visited[i].store(0, std::memory_order_relaxed);
+    owner.assign(n, 0);
+    std::vector<std::vector<unitig_t>> found(nthreads);
+    const std::string separator = kmerencoder().separator();
+
+    // the unitig from first, flagging its nodes; for a cycle, first again ends it
+    auto walk = [&](const index_t first, const bool circular, std::vector<unitig_t>& out) {
+        intbase_t ib;
+        unitig_t u;
+        u.first = first;
+        u.circular = circular;
+        u.nkmers = 0;
+        u.coverage = 0;
+        u.seq = g.kmer(first);
+        index_t i = first;
+        while (true) {
+            visited[i].store(1, std::memory_order_relaxed);
+            ++u.nkmers;
+            u.coverage += g.count(i);
+            u.last = i;
+            i = next(g, i);
+            if (i == sparsedebruijn::npos || i == first)
+                break;
+            u.seq += separator + ib.int_to_base(g.base(i, g.get_k() - 1));
+        }
+        out.push_back(u);
+    };
+
+    // the starts, with a node before them that is not in their unitig
+    std::atomic<uint64_t> nextblock(0);
+    auto starts = [&](const unsigned int t) {
+        for (uint64_t b=nextblock.fetch_add(blocksize); b<n; b=nextblock.fetch_add(blocksize))
+            for (index_t i=b; i<std::min((uint64_t)n, b + blocksize); ++i)
+                if (prev(g, i) == sparsedebruijn::npos && visited[i].exchange(1) == 0)
+                    walk(i, false, found[t]);
+    };
+    // the cycles, each from its smallest node
+    auto cycles = [&](const unsigned int t) {
+        for (uint64_t b=nextblock.fetch_add(blocksize); b<n; b=nextblock.fetch_add(blocksize))
+            for (index_t i=b; i<std::min((uint64_t)n, b + blocksize); ++i) {
+                if (visited[i].load(std::memory_order_relaxed) != 0)
+                    continue;
+                index_t j = next(g, i);
+                while (j != sparsedebruijn::npos && j > i)
+                    j = next(g, j);
+                if (j == i)
+                    walk(i, true, found[t]);
+            }
+    };
+    auto run = [&](const std::function<void(unsigned int)>& pass) {
+        nextblock = 0;
+        std::vector<std::thread> threads;
+        for (unsigned int t=0; t<nthreads; ++t)
+            threads.emplace_back(pass, t);
+        for (auto th=threads.begin(); th != threads.end(); ++th)
+            th->join();
+    };
+    run(starts);
+    run(cycles);
+
+    unitigs.clear();
+    for (auto f=found.begin(); f != found.end(); ++f)
+        unitigs.insert(unitigs.end(), f->begin(), f->end());
+    std::sort(unitigs.begin(), unitigs.end(), [](const unitig_t& a, const unitig_t& b) {
+        return a.first < b.first;
+    });
+    uint64_t total = 0;
+    for (uint32_t u=0; u<unitigs.size(); ++u) {
+        index_t i = unitigs[u].first;
+        for (uint64_t m=0; m<unitigs[u].nkmers; ++m, i = next(g, i))
+            owner[i] = u;
+        total += unitigs[u].nkmers;
+    }
+    if (total != n)
+        errx(1, "unitigset: %llu of %llu nodes are in unitigs",
+             (unsigned long long)total, (unsigned long long)n);
+}
+
+void
+unitigset::write(const std::string& fname) const
+{
+    std::ofstream outf(fname);
+    if (!outf)
+        err(1, "Cannot create unitig file %s", fname.c_str());
+    for (size_t u=0; u<unitigs.size(); ++u)
+        outf << ">" << u << " LN:i:" << unitigs[u].seq.length() << " KC:i:" << unitigs[u].coverage
+             << " km:f:" << std::fixed << std::setprecision(1)
+             << (double)unitigs[u].coverage / unitigs[u].nkmers << std::endl
+             << unitigs[u].seq << std::endl;
+    outf.close();
+    if (!outf)
+        err(1, "Writing unitig file %s failed", fname.c_str());
+}
+
+void
+unitigset::graphviz(const std::string fname, const std::string comment) const
+{
+    std::ofstream outf;
+    outf.open(fname);
+    outf << "digraph G {" << std::endl;
+    outf << "graph [fontname = \"helvetica\"];" << std::endl;
+    outf << "graph [label = \"" << comment << "\"];" << std::endl;
+    for (size_t u=0; u<unitigs.size(); ++u)
+        outf << "  " << u << " [label=\"" << u << " length " << unitigs[u].seq.length()
+             << " coverage " << unitigs[u].coverage << "\"];" << std::endl;
+    for (size_t u=0; u<unitigs.size(); ++u)
+        graph->out_edges(unitigs[u].last, [&](const index_t j, const profilecount_t c) {
+            outf << "  " << u << " -> " << owner[j] << " [label=\"" << c << "\"];" << std::endl;
+        });
+    outf << "}"  << std::endl;
+    outf.close();
+}
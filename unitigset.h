@@ -0,0 +1,92 @@
+/*!
+ * @brief the unitigs (maximal non-branching paths) of a de Bruijn graph
+ *
+ * Copyright (C) 2018  Kenneth Ingham
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITIGSET_H
+#define UNITIGSET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FastaRecord.h"
+#include "sparsedebruijn.h"
+
+/*! @class unitigset
+ * @brief the compacted de Bruijn graph: every node of a sparsedebruijn
+ * graph in exactly one unitig
+ *
+ * Two nodes u -> v are in the same unitig when u's only edge out goes to
+ * v and v's only edge in comes from u.  A node with no such predecessor
+ * starts a unitig, which runs forward until that stops being true.  The
+ * threads take the nodes in blocks and walk from every start they find;
+ * starts are claimed with an atomic visited flag, and every node walked
+ * over is flagged.  What is left unflagged are cycles with no start; each
+ * is walked by the thread holding its smallest node, so no cycle comes
+ * out twice.
+ *
+ * The unitigs are numbered in the order of their first nodes, so the
+ * result does not depend on the number of threads.
+ */
+class unitigset {
+public:
+    struct unitig_t {
+        sparsedebruijn::index_t first;  //!< node the unitig starts with
+        sparsedebruijn::index_t last;   //!< and ends with
+        uint64_t nkmers;
+        uint64_t coverage;              //!< sum of the node counts
+        bool circular;                  //!< last's edge out goes back to first
+        std::string seq;
+    };
+
+private:
+    std::vector<unitig_t> unitigs;
+    //! the unitig each node is in
+    std::vector<uint32_t> owner;
+    const sparsedebruijn *graph = nullptr;
+
+    sparsedebruijn::index_t next(const sparsedebruijn& g, const sparsedebruijn::index_t i) const;
+    sparsedebruijn::index_t prev(const sparsedebruijn& g, const sparsedebruijn::index_t i) const;
+
+public:
+    //! nodes handed to a thread at a time
+    static const uint32_t blocksize = 4096;
+
+    //! @brief compact g, which must outlive the unitigset for graphviz()
+    void build(const sparsedebruijn& g, const unsigned int nthreads = 1);
+
+    size_t size() const {
+        return unitigs.size();
+    };
+    const unitig_t& operator[](const size_t u) const {
+        return unitigs[u];
+    };
+    //! @brief the unitig holding node i
+    uint32_t find(const sparsedebruijn::index_t i) const {
+        return owner[i];
+    };
+    /*! @brief FASTA, one record per unitig, with its length, kmer count
+     * and mean kmer coverage in the header as BCALM writes them, e.g.
+     * ">12 LN:i:57 KC:i:138 km:f:2.9"
+     */
+    void write(const std::string& fname) const;
+    //! @brief a node per unitig, an edge for each graph edge between unitigs
+    void graphviz(const std::string fname, const std::string comment = "") const;
+};
+
+#endif // UNITIGSET_H